@@ -0,0 +1,709 @@
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+// Microbenchmarks of the codec components on synthetic data (make bench)
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../src/pbwt.h"
+#include "../src/format.h"
+#include "../src/text_pp.h"
+#include "../src/annot.h"
+#include "../src/buffer.h"
+#include "../src/bsc.h"
+#include "../src/archive.h"
+#include "../src/cfile.h"
+#include "../src/cpu_dispatch.h"
+#include "synth.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// ************************************************************************************
+// Access to the internals benchmarked in isolation (declared as a friend in CCompressedFile and CBuffer)
+class CBenchAccess
+{
+public:
+	static void StartRunLenEncoding(CCompressedFile& cf)
+	{
+		if (!cf.rce)
+			cf.rce = new CRangeEncoder<CVectorIOStream>(*cf.vios_o);
+
+		cf.v_vios_o.clear();
+		cf.rce->Start();
+		cf.ctx_prefix = cf.context_prefix_mask;
+		cf.ctx_symbol = cf.context_symbol_mask;
+	}
+
+	static void EncodeRunLen(CCompressedFile& cf, const vector<pair<uint32_t, uint32_t>>& v_runs, vector<uint8_t>& v_output)
+	{
+		StartRunLenEncoding(cf);
+
+		for (auto& x : v_runs)
+		{
+			cf.encode_run_len(x.first, x.second);
+			if (x.second == 0)
+			{
+				cf.ctx_prefix = cf.context_prefix_mask;
+				cf.ctx_symbol = cf.context_symbol_mask;
+			}
+		}
+
+		cf.rce->End();
+		v_output = cf.v_vios_o;
+	}
+
+	static void DecodeRunLen(CCompressedFile& cf, const vector<uint8_t>& v_input, size_t no_runs, vector<pair<uint32_t, uint32_t>>& v_runs)
+	{
+		if (!cf.rcd)
+			cf.rcd = new CRangeDecoder<CVectorIOStream>(*cf.vios_i);
+
+		cf.v_vios_i = v_input;
+		cf.vios_i->RestartRead();
+		cf.rcd->Start();
+		cf.ctx_prefix = cf.context_prefix_mask;
+		cf.ctx_symbol = cf.context_symbol_mask;
+
+		v_runs.resize(no_runs);
+
+		for (auto& x : v_runs)
+		{
+			cf.decode_run_len(x.first, x.second);
+			if (x.second == 0)
+			{
+				cf.ctx_prefix = cf.context_prefix_mask;
+				cf.ctx_symbol = cf.context_symbol_mask;
+			}
+		}
+
+		cf.rcd->End();
+	}
+
+	static void PermuteForward(CBuffer& buf)
+	{
+		buf.permute_integer_series_forward();
+	}
+
+	static void PermuteBackward(CBuffer& buf)
+	{
+		buf.permute_integer_series_backward();
+	}
+
+	static vector<uint32_t>& BufferSizes(CBuffer& buf)
+	{
+		return buf.v_size;
+	}
+
+	static vector<uint8_t>& BufferData(CBuffer& buf)
+	{
+		return buf.v_data;
+	}
+};
+
+// ************************************************************************************
+class CBenchRunner
+{
+	struct result_t {
+		string name;
+		size_t bytes;
+		size_t symbols;
+		size_t output_bytes;
+		double time;
+		bool ok;
+	};
+
+	uint32_t no_reps;
+	string filter;
+	vector<result_t> v_results;
+
+public:
+	CBenchRunner(uint32_t _no_reps, const string& _filter) : no_reps(_no_reps), filter(_filter)
+	{}
+
+	bool Enabled(const string& name)
+	{
+		return filter.empty() || name.find(filter) != string::npos;
+	}
+
+	// fun returns the time [s] of its measured part; the median over the repetitions is reported
+	void Run(const string& name, size_t bytes, size_t symbols, function<double(size_t&, bool&)> fun)
+	{
+		if (!Enabled(name))
+			return;
+
+		vector<double> v_times;
+		size_t output_bytes = 0;
+		bool ok = true;
+
+		for (uint32_t i = 0; i < no_reps; ++i)
+		{
+			bool rep_ok = true;
+			v_times.emplace_back(fun(output_bytes, rep_ok));
+			ok &= rep_ok;
+		}
+
+		sort(v_times.begin(), v_times.end());
+
+		v_results.push_back(result_t{ name, bytes, symbols, output_bytes, v_times[v_times.size() / 2], ok });
+		Print(v_results.back());
+	}
+
+	void PrintHeader()
+	{
+		cout << left << setw(28) << "benchmark" << right << setw(12) << "input [MB]" << setw(12) << "output [MB]"
+			<< setw(12) << "time [ms]" << setw(12) << "MB/s" << setw(14) << "Msymbols/s" << "  check\n";
+	}
+
+	void Print(const result_t& r)
+	{
+		double t = max(r.time, 1e-9);
+
+		cout << left << setw(28) << r.name << right << fixed
+			<< setprecision(2) << setw(12) << r.bytes / 1e6 << setw(12) << r.output_bytes / 1e6
+			<< setprecision(2) << setw(12) << r.time * 1e3
+			<< setprecision(1) << setw(12) << r.bytes / 1e6 / t << setw(14) << r.symbols / 1e6 / t
+			<< "  " << (r.ok ? "ok" : "FAIL") << endl;
+	}
+
+	bool AllOk()
+	{
+		return all_of(v_results.begin(), v_results.end(), [](const result_t& r) {return r.ok; });
+	}
+};
+
+// ************************************************************************************
+double seconds_since(const steady_clock::time_point& t)
+{
+	return duration<double>(steady_clock::now() - t).count();
+}
+
+// ************************************************************************************
+void bench_pbwt(CBenchRunner& runner, uint32_t no_samples, uint32_t no_variants)
+{
+	if (!runner.Enabled("pbwt") && !runner.Enabled("run_len"))
+		return;
+
+	CSynthData synth(1);
+	vector<vector<uint32_t>> v_variants(no_variants);
+	uint32_t no_haplotypes = 2 * no_samples;
+	const size_t neglect_limit = 10;
+
+	synth.StartHaplotypes(no_haplotypes);
+	for (auto& x : v_variants)
+		synth.NextVariantHaplotypes(x);
+
+	size_t no_symbols = (size_t) no_haplotypes * no_variants;
+	vector<vector<pair<uint32_t, uint32_t>>> v_rles(no_variants);
+
+	runner.Run("pbwt_encode_flexible", no_symbols * 4, no_symbols, [&](size_t& output_bytes, bool& ok) {
+		CPBWT pbwt;
+		pbwt.StartForward(no_haplotypes, neglect_limit);
+		output_bytes = 0;
+
+		auto t = steady_clock::now();
+		for (uint32_t i = 0; i < no_variants; ++i)
+		{
+			pbwt.EncodeFlexible(3, v_variants[i], v_rles[i]);
+			output_bytes += v_rles[i].size() * 8;
+		}
+
+		return seconds_since(t);
+	});
+
+	runner.Run("pbwt_decode_flexible", no_symbols * 4, no_symbols, [&](size_t& output_bytes, bool& ok) {
+		CPBWT pbwt;
+		vector<uint32_t> v_output;
+		pbwt.StartReverse(no_haplotypes, neglect_limit);
+		output_bytes = no_symbols * 4;
+
+		double time = 0;
+		for (uint32_t i = 0; i < no_variants; ++i)
+		{
+			auto t = steady_clock::now();
+			pbwt.DecodeFlexible(3, v_rles[i], v_output);
+			time += seconds_since(t);
+
+			ok &= v_output == v_variants[i];
+		}
+
+		return time;
+	});
+
+	// Runs of all variants as stored in the GT stream (the last run of a variant has length 0)
+	vector<pair<uint32_t, uint32_t>> v_runs;
+	for (auto& x : v_rles)
+	{
+		v_runs.insert(v_runs.end(), x.begin(), x.end());
+		if (!x.empty())
+			v_runs.back().second = 0;
+	}
+
+	vector<uint8_t> v_rc;
+
+	runner.Run("run_len_encode", v_runs.size() * 8, v_runs.size(), [&](size_t& output_bytes, bool& ok) {
+		CCompressedFile cf;
+
+		auto t = steady_clock::now();
+		CBenchAccess::EncodeRunLen(cf, v_runs, v_rc);
+		double time = seconds_since(t);
+
+		output_bytes = v_rc.size();
+
+		return time;
+	});
+
+	runner.Run("run_len_decode", v_runs.size() * 8, v_runs.size(), [&](size_t& output_bytes, bool& ok) {
+		CCompressedFile cf;
+		vector<pair<uint32_t, uint32_t>> v_decoded;
+
+		auto t = steady_clock::now();
+		CBenchAccess::DecodeRunLen(cf, v_rc, v_runs.size(), v_decoded);
+		double time = seconds_since(t);
+
+		output_bytes = v_decoded.size() * 8;
+		ok = v_decoded == v_runs;
+
+		return time;
+	});
+}
+
+// ************************************************************************************
+void bench_format(CBenchRunner& runner, uint32_t no_samples, uint32_t no_variants)
+{
+	CSynthData synth(2);
+
+	vector<pair<string, function<void(vector<uint32_t>&, vector<uint8_t>&)>>> v_fields = {
+		{ "dp", [&](vector<uint32_t>& v_size, vector<uint8_t>& v_data) {synth.FormatDP(no_variants, no_samples, v_size, v_data); } },
+		{ "ad", [&](vector<uint32_t>& v_size, vector<uint8_t>& v_data) {synth.FormatAD(no_variants, no_samples, v_size, v_data); } },
+		{ "pl", [&](vector<uint32_t>& v_size, vector<uint8_t>& v_data) {synth.FormatPL(no_variants, no_samples, v_size, v_data); } }
+	};
+
+	for (auto& field : v_fields)
+	{
+		string name_enc = "format_encode_" + field.first;
+		string name_dec = "format_decode_" + field.first;
+
+		if (!runner.Enabled(name_enc) && !runner.Enabled(name_dec))
+			continue;
+
+		vector<uint32_t> v_size;
+		vector<uint8_t> v_data, v_compressed;
+
+		field.second(v_size, v_data);
+
+		runner.Run(name_enc, v_data.size(), v_data.size() / 4, [&](size_t& output_bytes, bool& ok) {
+			CFormatCompress fc;
+			auto v_size_tmp = v_size;
+			auto v_data_tmp = v_data;
+
+			fc.SetNoSamples(no_samples);
+
+			auto t = steady_clock::now();
+			fc.EncodeFormat(v_size_tmp, v_data_tmp, v_compressed);
+			double time = seconds_since(t);
+
+			output_bytes = v_compressed.size();
+
+			return time;
+		});
+
+		runner.Run(name_dec, v_data.size(), v_data.size() / 4, [&](size_t& output_bytes, bool& ok) {
+			CFormatCompress fc;
+			auto v_size_tmp = v_size;
+			auto v_compressed_tmp = v_compressed;
+			vector<uint8_t> v_decoded(v_data.size());
+
+			fc.SetNoSamples(no_samples);
+
+			auto t = steady_clock::now();
+			fc.DecodeFormat(v_size_tmp, v_compressed_tmp, v_decoded);
+			double time = seconds_since(t);
+
+			output_bytes = v_decoded.size();
+			ok = v_decoded == v_data;
+
+			return time;
+		});
+	}
+}
+
+// ************************************************************************************
+void bench_text(CBenchRunner& runner, uint32_t no_variants)
+{
+	if (!runner.Enabled("text_pp"))
+		return;
+
+	CSynthData synth(3);
+	vector<uint8_t> v_text, v_encoded;
+
+	synth.InfoText(no_variants, v_text);
+
+	runner.Run("text_pp_encode", v_text.size(), v_text.size(), [&](size_t& output_bytes, bool& ok) {
+		CTextPreprocessing tp;
+		auto v_input = v_text;
+
+		auto t = steady_clock::now();
+		tp.EncodeText(v_input, v_encoded);
+		double time = seconds_since(t);
+
+		output_bytes = v_encoded.size();
+
+		return time;
+	});
+
+	runner.Run("text_pp_decode", v_text.size(), v_text.size(), [&](size_t& output_bytes, bool& ok) {
+		CTextPreprocessing tp;
+		auto v_input = v_encoded;
+		vector<uint8_t> v_decoded;
+
+		auto t = steady_clock::now();
+		tp.DecodeText(v_input, v_decoded);
+		double time = seconds_since(t);
+
+		output_bytes = v_decoded.size();
+		ok = v_decoded == v_text;
+
+		return time;
+	});
+}
+
+// ************************************************************************************
+// Round trip of all kinds of columns of the annotation codec, with and without reference columns
+void bench_annot(CBenchRunner& runner, uint32_t no_variants)
+{
+	if (!runner.Enabled("annot"))
+		return;
+
+	CSynthData synth(7);
+	string schema;
+	vector<string> v_names;
+	vector<uint32_t> v_size;
+	vector<uint8_t> v_data, v_encoded;
+	bool encoded = false;
+
+	synth.InfoAnnotations(no_variants, schema, v_size, v_data);
+	CAnnotationCodec::ParseSchema(schema, "CSQ", v_names);
+	CBSCWrapper::InitLibrary(1);
+
+	runner.Run("annot_encode", v_data.size(), v_size.size(), [&](size_t& output_bytes, bool& ok) {
+		CAnnotationCodec codec((uint32_t) v_names.size(), 1);
+
+		auto t = steady_clock::now();
+		ok = encoded = codec.Encode(v_size, v_data, v_encoded);
+		double time = seconds_since(t);
+
+		output_bytes = v_encoded.size();
+
+		return time;
+	});
+
+	runner.Run("annot_decode", v_data.size(), v_size.size(), [&](size_t& output_bytes, bool& ok) {
+		CAnnotationCodec codec((uint32_t) v_names.size(), 1);
+		vector<uint8_t> v_decoded;
+
+		auto t = steady_clock::now();
+		ok = encoded && codec.Decode(v_size, v_encoded, v_decoded);
+		double time = seconds_since(t);
+
+		output_bytes = v_decoded.size();
+		ok &= v_decoded == v_data;
+
+		return time;
+	});
+}
+
+// ************************************************************************************
+void bench_buffer(CBenchRunner& runner, size_t no_values)
+{
+	if (!runner.Enabled("buffer"))
+		return;
+
+	CSynthData synth(4);
+	vector<int32_t> v_values;
+	const uint32_t series_size = 4;
+
+	synth.Integers(no_values - no_values % series_size, v_values);
+
+	vector<uint32_t> v_size;
+	vector<uint8_t> v_data;
+	size_t no_bytes = v_values.size() * 4;
+
+	runner.Run("buffer_varint_write", no_bytes, v_values.size(), [&](size_t& output_bytes, bool& ok) {
+		CBuffer buf;
+
+		auto t = steady_clock::now();
+		for (size_t i = 0; i < v_values.size(); i += series_size)
+			buf.WriteIntVarSize((char*) (v_values.data() + i), series_size);
+		buf.GetBuffer(v_size, v_data);
+		double time = seconds_since(t);
+
+		output_bytes = v_data.size();
+
+		return time;
+	});
+
+	runner.Run("buffer_varint_read", no_bytes, v_values.size(), [&](size_t& output_bytes, bool& ok) {
+		CBuffer buf;
+		auto v_size_tmp = v_size;
+		auto v_data_tmp = v_data;
+		vector<int32_t> v_decoded;
+		v_decoded.reserve(v_values.size());
+
+		buf.SetBuffer(v_size_tmp, v_data_tmp);
+
+		auto t = steady_clock::now();
+		for (size_t i = 0; i < v_size.size(); ++i)
+		{
+			char* p;
+			uint32_t size;
+
+			buf.ReadIntVarSize(p, size);
+			v_decoded.insert(v_decoded.end(), (int32_t*) p, (int32_t*) p + size);
+			delete[] p;
+		}
+		double time = seconds_since(t);
+
+		output_bytes = v_decoded.size() * 4;
+		ok = v_decoded == v_values;
+
+		return time;
+	});
+
+	vector<uint8_t> v_permuted;
+
+	runner.Run("buffer_permute_forward", v_data.size(), v_values.size(), [&](size_t& output_bytes, bool& ok) {
+		CBuffer buf;
+		CBenchAccess::BufferSizes(buf) = v_size;
+		CBenchAccess::BufferData(buf) = v_data;
+
+		auto t = steady_clock::now();
+		CBenchAccess::PermuteForward(buf);
+		double time = seconds_since(t);
+
+		v_permuted = CBenchAccess::BufferData(buf);
+		output_bytes = v_permuted.size();
+
+		return time;
+	});
+
+	runner.Run("buffer_permute_backward", v_data.size(), v_values.size(), [&](size_t& output_bytes, bool& ok) {
+		CBuffer buf;
+		CBenchAccess::BufferSizes(buf) = v_size;
+		CBenchAccess::BufferData(buf) = v_permuted;
+
+		auto t = steady_clock::now();
+		CBenchAccess::PermuteBackward(buf);
+		double time = seconds_since(t);
+
+		output_bytes = CBenchAccess::BufferData(buf).size();
+		ok = CBenchAccess::BufferData(buf) == v_data;
+
+		return time;
+	});
+}
+
+// ************************************************************************************
+void bench_bsc(CBenchRunner& runner, size_t no_bytes)
+{
+	if (!runner.Enabled("bsc"))
+		return;
+
+	CSynthData synth(5);
+	vector<uint8_t> v_input, v_compressed;
+
+	synth.Bytes(no_bytes, v_input);
+
+	CBSCWrapper::InitLibrary(1);
+
+	runner.Run("bsc_compress", v_input.size(), v_input.size(), [&](size_t& output_bytes, bool& ok) {
+		CBSCWrapper bsc;
+		bsc.InitCompress(bsc_params_t{ 25, 16, 64, LIBBSC_CODER_QLFC_ADAPTIVE });
+
+		auto t = steady_clock::now();
+		bsc.Compress(v_input, v_compressed);
+		double time = seconds_since(t);
+
+		output_bytes = v_compressed.size();
+
+		return time;
+	});
+
+	runner.Run("bsc_decompress", v_input.size(), v_input.size(), [&](size_t& output_bytes, bool& ok) {
+		auto v_compressed_tmp = v_compressed;
+		vector<uint8_t> v_decompressed;
+
+		auto t = steady_clock::now();
+		CBSCWrapper::Decompress(v_compressed_tmp, v_decompressed);
+		double time = seconds_since(t);
+
+		output_bytes = v_decompressed.size();
+		ok = v_decompressed == v_input;
+
+		return time;
+	});
+}
+
+// ************************************************************************************
+void bench_archive(CBenchRunner& runner, size_t no_bytes, const string& tmp_file_name)
+{
+	if (!runner.Enabled("archive"))
+		return;
+
+	CSynthData synth(6);
+	const size_t part_size = 1 << 20;
+	const int no_streams = 4;
+	vector<uint8_t> v_data;
+
+	synth.Bytes(part_size, v_data);
+
+	size_t no_parts = max<size_t>(1, no_bytes / part_size);
+	size_t total_bytes = no_parts * part_size;
+
+	runner.Run("archive_add_part", total_bytes, total_bytes, [&](size_t& output_bytes, bool& ok) {
+		CArchive archive(false);
+		vector<int> v_stream_ids;
+
+		if (!archive.Open(tmp_file_name))
+		{
+			ok = false;
+			return 0.0;
+		}
+
+		for (int i = 0; i < no_streams; ++i)
+			v_stream_ids.emplace_back(archive.RegisterStream("stream_" + to_string(i)));
+
+		auto t = steady_clock::now();
+		for (size_t i = 0; i < no_parts; ++i)
+		{
+			auto v_tmp = v_data;
+			archive.AddPart(v_stream_ids[i % no_streams], v_tmp, i);
+		}
+		archive.Close();
+		double time = seconds_since(t);
+
+		output_bytes = total_bytes;
+
+		return time;
+	});
+
+	runner.Run("archive_get_part", total_bytes, total_bytes, [&](size_t& output_bytes, bool& ok) {
+		CArchive archive(true);
+		vector<uint8_t> v_tmp;
+		size_t metadata;
+
+		if (!archive.Open(tmp_file_name))
+		{
+			ok = false;
+			return 0.0;
+		}
+
+		output_bytes = 0;
+
+		auto t = steady_clock::now();
+		for (int i = 0; i < no_streams; ++i)
+		{
+			int stream_id = archive.GetStreamId("stream_" + to_string(i));
+
+			while (archive.GetPart(stream_id, v_tmp, metadata))
+			{
+				output_bytes += v_tmp.size();
+				ok &= v_tmp == v_data;
+			}
+		}
+		double time = seconds_since(t);
+
+		archive.Close();
+		ok &= output_bytes == total_bytes;
+
+		return time;
+	});
+
+	remove(tmp_file_name.c_str());
+}
+
+// ************************************************************************************
+void usage()
+{
+	cerr << "vcfshark_bench [options] [filter]\n";
+	cerr << "Parameters:\n";
+	cerr << "  filter - run only benchmarks with names containing the filter (e.g., pbwt, format, annot, bsc)\n";
+	cerr << "Options:\n";
+	cerr << "  -r <value> - no. of repetitions; median time is reported (default: 5)\n";
+	cerr << "  -s <value> - no. of samples (default: 2000)\n";
+	cerr << "  -v <value> - no. of variants (default: 1000)\n";
+	cerr << "  -m <value> - size of byte-oriented inputs in MB (default: 32)\n";
+	cerr << "  -o <file>  - temporary archive file (default: vcfshark_bench.tmp)\n";
+}
+
+// ************************************************************************************
+int main(int argc, char** argv)
+{
+	uint32_t no_reps = 5;
+	uint32_t no_samples = 2000;
+	uint32_t no_variants = 1000;
+	size_t size_mb = 32;
+	string filter;
+	string tmp_file_name = "vcfshark_bench.tmp";
+
+	for (int i = 1; i < argc; ++i)
+	{
+		string par = argv[i];
+
+		if (par == "-r" && i + 1 < argc)
+			no_reps = max(1, atoi(argv[++i]));
+		else if (par == "-s" && i + 1 < argc)
+			no_samples = max(1, atoi(argv[++i]));
+		else if (par == "-v" && i + 1 < argc)
+			no_variants = max(1, atoi(argv[++i]));
+		else if (par == "-m" && i + 1 < argc)
+			size_mb = max(1, atoi(argv[++i]));
+		else if (par == "-o" && i + 1 < argc)
+			tmp_file_name = argv[++i];
+		else if (par == "-h" || par == "--help")
+		{
+			usage();
+			return 0;
+		}
+		else if (par[0] == '-')
+		{
+			cerr << "Unknown option : " << par << endl;
+			usage();
+			return 1;
+		}
+		else
+			filter = par;
+	}
+
+	cout << "Samples: " << no_samples << ", variants: " << no_variants << ", byte inputs: " << size_mb << " MB, repetitions: " << no_reps
+		<< ", ISA: " << CCPUDispatch::Instance().GetISAName() << "\n";
+
+	CBenchRunner runner(no_reps, filter);
+	runner.PrintHeader();
+
+	bench_pbwt(runner, no_samples, no_variants);
+	bench_format(runner, no_samples, no_variants);
+	bench_text(runner, no_variants * 50);
+	bench_annot(runner, no_variants * 10);
+	bench_buffer(runner, (size_mb << 20) / 4);
+	bench_bsc(runner, size_mb << 20);
+	bench_archive(runner, size_mb << 20, tmp_file_name);
+
+	return runner.AllOk() ? 0 : 1;
+}
+
+// EOF
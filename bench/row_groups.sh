@@ -0,0 +1,90 @@
+#!/bin/bash
+# *******************************************************************************************
+# This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+# The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+#
+# Author : Sebastian Deorowicz and Agnieszka Danek
+# Version: 1.0
+# Date   : 2020-12-18
+# *******************************************************************************************
+
+# Round trip of --row-groups for a no. of records that is and is not a multiple of the group size;
+# checks the table of groups reported by vcfshark verify and compares the decompressed records with
+# these of an archive of the same input compressed without --row-groups.
+# Inputs: plain genotypes, VEP-like CSQ annotations, gVCF with reference blocks (compressed with --gvcf)
+
+ROOT_DIR=$(cd "$(dirname "$0")/.." && pwd)
+VCFSHARK=${VCFSHARK:-$ROOT_DIR/vcfshark}
+SYNTH=${SYNTH:-$ROOT_DIR/vcfshark_synth}
+WORK_DIR=${WORK_DIR:-row_groups_work}
+
+NO_VARIANTS=4096
+
+mkdir -p "$WORK_DIR" || exit 1
+
+# name, vcfshark_synth options, vcfshark compress options
+run_input()
+{
+	local NAME=$1
+	local INPUT=$WORK_DIR/$NAME.vcf
+	local BASE=$WORK_DIR/${NAME}_base.vcf
+
+	if ! "$SYNTH" $2 -o "$INPUT"; then
+		echo "Cannot generate input ($NAME)" >&2
+		exit 1
+	fi
+
+	local NO_RECORDS=$(grep -vc '^#' "$INPUT")
+
+	if ! "$VCFSHARK" compress $3 "$INPUT" "$WORK_DIR/${NAME}_base.vcfshark" > /dev/null 2> "$WORK_DIR/run.log" ||
+		! "$VCFSHARK" decompress "$WORK_DIR/${NAME}_base.vcfshark" "$BASE" > /dev/null 2> "$WORK_DIR/run.log"; then
+		echo "Round trip without row groups failed ($NAME), see $WORK_DIR/run.log" >&2
+		exit 1
+	fi
+
+	if [ "$(grep -vc '^#' "$BASE")" != "$NO_RECORDS" ]; then
+		echo "Wrong no. of records after decompression ($NAME, no row groups)" >&2
+		exit 1
+	fi
+
+	# Group size is a divisor, is not a divisor and is not smaller than the no. of records
+	for SIZE in 1024 1000 $NO_RECORDS; do
+		local ARCHIVE=$WORK_DIR/${NAME}_$SIZE.vcfshark
+		local DECOMPRESSED=$WORK_DIR/${NAME}_$SIZE.vcf
+		local EXPECTED_GROUPS=$(( (NO_RECORDS + SIZE - 1) / SIZE ))
+
+		if ! "$VCFSHARK" compress $3 --row-groups "$SIZE" "$INPUT" "$ARCHIVE" > /dev/null 2> "$WORK_DIR/run.log"; then
+			echo "Compression failed ($NAME, row groups: $SIZE), see $WORK_DIR/run.log" >&2
+			exit 1
+		fi
+
+		if ! "$VCFSHARK" verify --decode "$ARCHIVE" > "$WORK_DIR/verify.log" 2>&1; then
+			echo "Verification failed ($NAME, row groups: $SIZE), see $WORK_DIR/verify.log" >&2
+			exit 1
+		fi
+
+		local NO_GROUPS=$(sed -n 's/^Row groups: //p' "$WORK_DIR/verify.log")
+		if [ "$NO_GROUPS" != "$EXPECTED_GROUPS" ]; then
+			echo "Wrong no. of row groups ($NAME, row groups: $SIZE): $NO_GROUPS instead of $EXPECTED_GROUPS" >&2
+			exit 1
+		fi
+
+		if ! "$VCFSHARK" decompress "$ARCHIVE" "$DECOMPRESSED" > /dev/null 2> "$WORK_DIR/run.log"; then
+			echo "Decompression failed ($NAME, row groups: $SIZE), see $WORK_DIR/run.log" >&2
+			exit 1
+		fi
+
+		if ! cmp -s <(grep -v '^#' "$BASE") <(grep -v '^#' "$DECOMPRESSED"); then
+			echo "Records differ from the archive without row groups ($NAME, row groups: $SIZE)" >&2
+			exit 1
+		fi
+
+		echo "$NAME, row groups $SIZE: $NO_GROUPS groups, ok"
+	done
+}
+
+run_input plain "-s 100 -v $NO_VARIANTS" ""
+run_input csq "-s 20 -v $NO_VARIANTS -A" ""
+run_input gvcf "-s 20 -v $NO_VARIANTS -g" "--gvcf"
+
+rm -rf "$WORK_DIR"
@@ -0,0 +1,133 @@
+#!/bin/bash
+# *******************************************************************************************
+# This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+# The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+#
+# Author : Sebastian Deorowicz and Agnieszka Danek
+# Version: 1.0
+# Date   : 2020-12-18
+# *******************************************************************************************
+
+# End-to-end scaling benchmark: compression and decompression of a synthetic cohort
+# for several numbers of threads; reports wall time, throughput, peak RSS and compression ratio
+
+usage()
+{
+	echo "scaling.sh [options]"
+	echo "Options:"
+	echo "  -s <value> - no. of samples (default: 2000)"
+	echo "  -v <value> - no. of variants (default: 20000)"
+	echo "  -t <list>  - numbers of threads (default: \"1 2 4 8\")"
+	echo "  -g \"<opts>\" - extra options of vcfshark_synth, e.g., \"-f 32 -F GT,DP\""
+	echo "  -i <file>  - use this VCF instead of generating a synthetic one"
+	echo "  -w <dir>   - working directory (default: scaling_work)"
+	echo "  -o <file>  - save results as TSV (default: print only)"
+}
+
+ROOT_DIR=$(cd "$(dirname "$0")/.." && pwd)
+VCFSHARK=${VCFSHARK:-$ROOT_DIR/vcfshark}
+SYNTH=${SYNTH:-$ROOT_DIR/vcfshark_synth}
+
+NO_SAMPLES=2000
+NO_VARIANTS=20000
+THREADS="1 2 4 8"
+SYNTH_OPTS=""
+INPUT=""
+WORK_DIR=scaling_work
+OUTPUT=""
+
+while getopts "s:v:t:g:i:w:o:h" opt; do
+	case $opt in
+		s) NO_SAMPLES=$OPTARG ;;
+		v) NO_VARIANTS=$OPTARG ;;
+		t) THREADS=$OPTARG ;;
+		g) SYNTH_OPTS=$OPTARG ;;
+		i) INPUT=$OPTARG ;;
+		w) WORK_DIR=$OPTARG ;;
+		o) OUTPUT=$OPTARG ;;
+		*) usage; exit 1 ;;
+	esac
+done
+
+mkdir -p "$WORK_DIR" || exit 1
+
+if [ -z "$INPUT" ]; then
+	INPUT=$WORK_DIR/synth_${NO_SAMPLES}_${NO_VARIANTS}.vcf
+	if [ ! -f "$INPUT" ]; then
+		echo "Generating $INPUT" >&2
+		"$SYNTH" -s "$NO_SAMPLES" -v "$NO_VARIANTS" $SYNTH_OPTS -o "$INPUT" || exit 1
+	fi
+fi
+
+# GNU time reports peak RSS; without it only wall time is measured
+if /usr/bin/time -f "%e" true > /dev/null 2>&1; then
+	HAS_GNU_TIME=1
+else
+	HAS_GNU_TIME=0
+fi
+
+# Runs a command; sets WALL (s) and RSS (MB)
+measure()
+{
+	local log=$WORK_DIR/time.log
+
+	if [ $HAS_GNU_TIME -eq 1 ]; then
+		/usr/bin/time -o "$log" -f "%e %M" "$@" > /dev/null 2> "$WORK_DIR/run.log" || return 1
+		read WALL RSS_KB < "$log"
+		RSS=$(awk -v x="$RSS_KB" 'BEGIN {printf "%.1f", x / 1024}')
+	else
+		local t0=$(date +%s.%N)
+		"$@" > /dev/null 2> "$WORK_DIR/run.log" || return 1
+		WALL=$(awk -v a="$t0" -v b="$(date +%s.%N)" 'BEGIN {printf "%.2f", b - a}')
+		RSS=NA
+	fi
+}
+
+INPUT_SIZE=$(stat -c %s "$INPUT")
+INPUT_MB=$(awk -v x="$INPUT_SIZE" 'BEGIN {printf "%.2f", x / 1e6}')
+NO_RECORDS=$(grep -vc '^#' "$INPUT")
+
+echo "Input: $INPUT ($INPUT_MB MB, $NO_RECORDS variants)" >&2
+
+RESULTS="mode	threads	wall_s	MB_per_s	peak_rss_MB	ratio"
+
+for T in $THREADS; do
+	ARCHIVE=$WORK_DIR/archive_t$T.vcfshark
+	DECOMPRESSED=$WORK_DIR/decompressed_t$T.vcf
+
+	if ! measure "$VCFSHARK" compress -t "$T" "$INPUT" "$ARCHIVE"; then
+		echo "Compression failed (threads: $T), see $WORK_DIR/run.log" >&2
+		exit 1
+	fi
+
+	ARCHIVE_SIZE=$(stat -c %s "$ARCHIVE")
+	RATIO=$(awk -v a="$INPUT_SIZE" -v b="$ARCHIVE_SIZE" 'BEGIN {printf "%.2f", a / b}')
+	SPEED=$(awk -v a="$INPUT_SIZE" -v t="$WALL" 'BEGIN {printf "%.2f", (t > 0 ? a / 1e6 / t : 0)}')
+	RESULTS="$RESULTS
+compress	$T	$WALL	$SPEED	$RSS	$RATIO"
+
+	if ! measure "$VCFSHARK" decompress -t "$T" "$ARCHIVE" "$DECOMPRESSED"; then
+		echo "Decompression failed (threads: $T), see $WORK_DIR/run.log" >&2
+		exit 1
+	fi
+
+	SPEED=$(awk -v a="$INPUT_SIZE" -v t="$WALL" 'BEGIN {printf "%.2f", (t > 0 ? a / 1e6 / t : 0)}')
+	RESULTS="$RESULTS
+decompress	$T	$WALL	$SPEED	$RSS	$RATIO"
+
+	if [ "$(grep -vc '^#' "$DECOMPRESSED")" != "$NO_RECORDS" ]; then
+		echo "Wrong no. of variants after decompression (threads: $T)" >&2
+		exit 1
+	fi
+
+	rm -f "$DECOMPRESSED"
+done
+
+if command -v column > /dev/null; then
+	echo "$RESULTS" | column -t
+else
+	echo "$RESULTS"
+fi
+if [ -n "$OUTPUT" ]; then
+	echo "$RESULTS" > "$OUTPUT"
+fi
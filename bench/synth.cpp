@@ -0,0 +1,291 @@
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include "synth.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+// ************************************************************************************
+CSynthData::CSynthData(uint64_t seed) : mt(seed)
+{
+	no_founders = 0;
+	min_af = 5e-5;
+	max_af = 0.5;
+}
+
+// ************************************************************************************
+void CSynthData::SetAlleleFrequencyRange(double _min_af, double _max_af)
+{
+	max_af = min(max(_max_af, 1e-9), 1.0);
+	min_af = min(max(_min_af, 1e-9), max_af);
+}
+
+// ************************************************************************************
+double CSynthData::allele_frequency()
+{
+	uniform_real_distribution<double> dist(0.0, 1.0);
+
+	return max_af * pow(min_af / max_af, dist(mt));
+}
+
+// ************************************************************************************
+void CSynthData::StartHaplotypes(uint32_t no_haplotypes, uint32_t _no_founders)
+{
+	no_founders = max(1u, _no_founders);
+	v_founder_alleles.assign(no_founders, 0);
+	v_hap_founder.resize(no_haplotypes);
+
+	uniform_int_distribution<uint32_t> dist(0, no_founders - 1);
+
+	for (auto& x : v_hap_founder)
+		x = dist(mt);
+}
+
+// ************************************************************************************
+// Values are allele ids + 1 (0 is reserved for missing), as in the GT input of CPBWT::EncodeFlexible
+uint32_t CSynthData::NextVariantHaplotypes(vector<uint32_t>& v_haps, double switch_prob, double multi_allelic_rate)
+{
+	uniform_real_distribution<double> dist(0.0, 1.0);
+	uniform_int_distribution<uint32_t> dist_founder(0, no_founders - 1);
+
+	double af = allele_frequency();
+	bool multi_allelic = dist(mt) < multi_allelic_rate;
+
+	for (auto& x : v_founder_alleles)
+	{
+		double r = dist(mt);
+
+		if (r < af)
+			x = 1;
+		else if (multi_allelic && r < af * 1.25)
+			x = 2;
+		else
+			x = 0;
+	}
+
+	v_haps.resize(v_hap_founder.size());
+
+	for (size_t i = 0; i < v_hap_founder.size(); ++i)
+	{
+		if (dist(mt) < switch_prob)
+			v_hap_founder[i] = dist_founder(mt);
+
+		uint32_t allele = v_founder_alleles[v_hap_founder[i]];
+
+		// Private mutations
+		if (dist(mt) < 1e-4)
+			allele = 1;
+
+		v_haps[i] = allele + 1;
+	}
+
+	return multi_allelic ? 3 : 2;
+}
+
+// ************************************************************************************
+void CSynthData::FormatDP(uint32_t no_variants, uint32_t no_samples, vector<uint32_t>& v_size, vector<uint8_t>& v_data)
+{
+	v_size.assign(no_variants, no_samples);
+	v_data.resize((size_t) no_variants * no_samples * 4);
+
+	int32_t* p = (int32_t*) v_data.data();
+
+	for (uint32_t i = 0; i < no_variants; ++i)
+	{
+		poisson_distribution<int32_t> dist(20 + (int32_t) (mt() % 20));
+
+		for (uint32_t j = 0; j < no_samples; ++j)
+			*p++ = dist(mt);
+	}
+}
+
+// ************************************************************************************
+void CSynthData::FormatAD(uint32_t no_variants, uint32_t no_samples, vector<uint32_t>& v_size, vector<uint8_t>& v_data)
+{
+	v_size.assign(no_variants, 2 * no_samples);
+	v_data.resize((size_t) no_variants * no_samples * 8);
+
+	int32_t* p = (int32_t*) v_data.data();
+	uniform_real_distribution<double> dist_u(0.0, 1.0);
+
+	for (uint32_t i = 0; i < no_variants; ++i)
+	{
+		poisson_distribution<int32_t> dist(30);
+		double af = allele_frequency();
+
+		for (uint32_t j = 0; j < no_samples; ++j)
+		{
+			int32_t dp = dist(mt);
+			int32_t alt = dist_u(mt) < af ? dp / 2 : 0;
+
+			*p++ = dp - alt;
+			*p++ = alt;
+		}
+	}
+}
+
+// ************************************************************************************
+void CSynthData::FormatPL(uint32_t no_variants, uint32_t no_samples, vector<uint32_t>& v_size, vector<uint8_t>& v_data)
+{
+	v_size.assign(no_variants, 3 * no_samples);
+	v_data.resize((size_t) no_variants * no_samples * 12);
+
+	int32_t* p = (int32_t*) v_data.data();
+	uniform_real_distribution<double> dist_u(0.0, 1.0);
+
+	for (uint32_t i = 0; i < no_variants; ++i)
+	{
+		double af = allele_frequency();
+
+		for (uint32_t j = 0; j < no_samples; ++j)
+		{
+			int32_t q = 30 + (int32_t) (mt() % 60);
+
+			if (dist_u(mt) < af)
+			{
+				*p++ = q;
+				*p++ = 0;
+				*p++ = 3 * q;
+			}
+			else
+			{
+				*p++ = 0;
+				*p++ = q;
+				*p++ = 10 * q / 3;
+			}
+		}
+	}
+}
+
+// ************************************************************************************
+void CSynthData::InfoText(uint32_t no_variants, vector<uint8_t>& v_data)
+{
+	static const vector<string> v_consequences = { "missense_variant", "synonymous_variant", "intron_variant", "upstream_gene_variant",
+		"downstream_gene_variant", "3_prime_UTR_variant", "5_prime_UTR_variant", "splice_region_variant", "stop_gained" };
+	static const vector<string> v_impacts = { "LOW", "MODERATE", "HIGH", "MODIFIER" };
+	static const vector<string> v_bases = { "A", "C", "G", "T" };
+
+	v_data.clear();
+
+	for (uint32_t i = 0; i < no_variants; ++i)
+	{
+		uint32_t no_transcripts = 1 + (uint32_t) (mt() % 4);
+		uint32_t gene = (uint32_t) (mt() % 2000);
+
+		string str;
+
+		for (uint32_t j = 0; j < no_transcripts; ++j)
+		{
+			if (j)
+				str += ",";
+
+			str += v_bases[mt() % 4] + "|" + v_consequences[mt() % v_consequences.size()] + "|" + v_impacts[mt() % v_impacts.size()] +
+				"|GENE" + to_string(gene) + "|ENSG" + to_string(10000000 + gene) + "|Transcript|ENST" + to_string(20000000 + gene * 8 + j) +
+				"|protein_coding|" + to_string(1 + mt() % 20) + "/20||||" + to_string(mt() % 5000) + "|||||";
+		}
+
+		v_data.insert(v_data.end(), str.begin(), str.end());
+		v_data.emplace_back(0);
+	}
+}
+
+// ************************************************************************************
+// Subfields are chosen to give every kind of column of CAnnotationCodec: Allele, Consequence (dict), Gene (dict, prefix
+// of Gene_biotype), Feature (text, prefix of HGVSc and Feature_tag), HGVSc (tokens with a reference column), Gene_biotype
+// (dict with a reference column), cDNA_position (numeric), DISTANCE (empty), HGVSc_short (tokens), Feature_tag
+// (text with a reference column)
+void CSynthData::InfoAnnotations(uint32_t no_variants, string& schema, vector<uint32_t>& v_size, vector<uint8_t>& v_data)
+{
+	static const vector<string> v_consequences = { "missense_variant", "synonymous_variant", "intron_variant", "upstream_gene_variant",
+		"downstream_gene_variant", "3_prime_UTR_variant", "5_prime_UTR_variant", "splice_region_variant", "stop_gained" };
+	static const vector<string> v_biotypes = { "protein_coding", "lncRNA", "nonsense_mediated_decay" };
+	static const string bases = "ACGT";
+
+	auto letters = [&](uint32_t len) {
+		string s;
+		for (uint32_t i = 0; i < len; ++i)
+			s.push_back((char) ('a' + mt() % 26));
+		return s;
+	};
+
+	schema = "##INFO=<ID=CSQ,Number=.,Type=String,Description=\"Consequence annotations from Ensembl VEP. "
+		"Format: Allele|Consequence|Gene|Feature|HGVSc|Gene_biotype|cDNA_position|DISTANCE|HGVSc_short|Feature_tag\">\n";
+
+	v_size.clear();
+	v_data.clear();
+
+	for (uint32_t i = 0; i < no_variants; ++i)
+	{
+		uint32_t no_transcripts = 1 + (uint32_t) (mt() % 4);
+		uint32_t gene = (uint32_t) (mt() % 200);
+		string str;
+
+		// Some variants have no annotations
+		if (mt() % 50 != 0)
+			for (uint32_t j = 0; j < no_transcripts; ++j)
+			{
+				string g = "ENSG" + to_string(10000000 + gene);
+				string f = "ENST" + to_string(20000000 + gene * 8 + j);
+
+				if (j)
+					str += ",";
+
+				str += string(1, bases[mt() % 4]) + "|" + v_consequences[mt() % v_consequences.size()] + "|" + g + "|" + f + "|";
+				if (mt() % 5)
+					str += f + ":c." + to_string(1 + mt() % 5000) + bases[mt() % 4] + ">" + bases[mt() % 4];
+				str += "|" + (mt() % 10 ? g + ":" : string()) + v_biotypes[mt() % v_biotypes.size()];
+				str += "|" + (mt() % 4 ? to_string(mt() % 3000) : string()) + "||c." + to_string(1 + mt() % 5000) + bases[mt() % 4] + ">" + bases[mt() % 4] + "|";
+				str += (mt() % 8 ? f : string()) + ":" + letters(3);
+
+				// Rarely, subfields beyond the schema
+				if (mt() % 100 == 0)
+					str += "|extra";
+			}
+
+		v_data.insert(v_data.end(), str.begin(), str.end());
+		v_data.emplace_back(0);
+		v_size.emplace_back((uint32_t) str.size() + 1);
+	}
+}
+
+// ************************************************************************************
+void CSynthData::Integers(size_t n, vector<int32_t>& v_data)
+{
+	geometric_distribution<int32_t> dist(0.05);
+	uniform_real_distribution<double> dist_u(0.0, 1.0);
+
+	v_data.resize(n);
+
+	for (auto& x : v_data)
+	{
+		double r = dist_u(mt);
+
+		if (r < 0.9)
+			x = dist(mt);
+		else if (r < 0.95)
+			x = -dist(mt);
+		else
+			x = (int32_t) (mt() & 0xfffffff);
+	}
+}
+
+// ************************************************************************************
+void CSynthData::Bytes(size_t n, vector<uint8_t>& v_data)
+{
+	vector<int32_t> v_ints;
+
+	Integers((n + 3) / 4, v_ints);
+
+	v_data.resize(n);
+	memcpy(v_data.data(), v_ints.data(), n);
+}
+
+// EOF
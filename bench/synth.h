@@ -0,0 +1,61 @@
+#pragma once
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <random>
+
+using namespace std;
+
+// ************************************************************************************
+// Generators of synthetic inputs for benchmarks (deterministic for a given seed)
+class CSynthData
+{
+	mt19937_64 mt;
+
+	uint32_t no_founders;
+	double min_af;
+	double max_af;
+	vector<uint8_t> v_founder_alleles;
+	vector<uint32_t> v_hap_founder;
+
+	double allele_frequency();
+
+public:
+	CSynthData(uint64_t seed = 1);
+
+	// Alternative allele frequencies are log-uniform in [_min_af, _max_af] (many rare variants as in real cohorts)
+	void SetAlleleFrequencyRange(double _min_af, double _max_af);
+
+	// Haplotypes copy mosaics of founder haplotypes (switches with the given probability per variant)
+	void StartHaplotypes(uint32_t no_haplotypes, uint32_t _no_founders = 32);
+	// Returns the no. of alleles of the variant (2, or 3 for multi-allelic variants)
+	uint32_t NextVariantHaplotypes(vector<uint32_t>& v_haps, double switch_prob = 0.001, double multi_allelic_rate = 0.05);
+
+	// FORMAT-like integer data (DP, AD, PL) in the layout of CBuffer::WriteInt
+	void FormatDP(uint32_t no_variants, uint32_t no_samples, vector<uint32_t>& v_size, vector<uint8_t>& v_data);
+	void FormatAD(uint32_t no_variants, uint32_t no_samples, vector<uint32_t>& v_size, vector<uint8_t>& v_data);
+	void FormatPL(uint32_t no_variants, uint32_t no_samples, vector<uint32_t>& v_size, vector<uint8_t>& v_data);
+
+	// INFO-like text (annotations with a limited vocabulary), zero separated
+	void InfoText(uint32_t no_variants, vector<uint8_t>& v_data);
+
+	// VEP-like INFO/CSQ values (with the header line of the schema) in the layout of a text key
+	void InfoAnnotations(uint32_t no_variants, string& schema, vector<uint32_t>& v_size, vector<uint8_t>& v_data);
+
+	// Integers with a skewed distribution of magnitudes
+	void Integers(size_t n, vector<int32_t>& v_data);
+
+	// Bytes of moderate compressibility
+	void Bytes(size_t n, vector<uint8_t>& v_data);
+};
+
+// EOF
@@ -0,0 +1,502 @@
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+// Generator of synthetic cohort VCF files (haplotypes are mosaics of founder haplotypes)
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+#include "synth.h"
+
+using namespace std;
+
+// ************************************************************************************
+struct synth_params_t
+{
+	uint32_t no_samples = 1000;
+	uint32_t no_variants = 10000;
+	uint32_t no_founders = 64;
+	double switch_prob = 0.001;
+	double multi_allelic_rate = 0.05;
+	double min_af = 5e-5;
+	double max_af = 0.5;
+	double missing_rate = 0.0;
+	uint64_t seed = 1;
+	string chrom = "chr20";
+	string fields = "GT,DP,AD,PL,GQ";
+	string output_file_name = "-";
+	bool annotations = false;
+	bool gvcf = false;
+
+	bool has_dp = false;
+	bool has_ad = false;
+	bool has_pl = false;
+	bool has_gq = false;
+};
+
+// ************************************************************************************
+class CVCFWriter
+{
+	FILE* f;
+	string buf;
+
+public:
+	CVCFWriter() : f(nullptr)
+	{}
+
+	~CVCFWriter()
+	{
+		Close();
+	}
+
+	bool Open(const string& file_name)
+	{
+		f = file_name == "-" ? stdout : fopen(file_name.c_str(), "wb");
+		buf.reserve(1 << 24);
+
+		return f != nullptr;
+	}
+
+	void Close()
+	{
+		if (!f)
+			return;
+
+		Flush();
+		if (f != stdout)
+			fclose(f);
+		f = nullptr;
+	}
+
+	string& Buf()
+	{
+		return buf;
+	}
+
+	void Flush()
+	{
+		fwrite(buf.data(), 1, buf.size(), f);
+		buf.clear();
+	}
+
+	void FlushIfLarge()
+	{
+		if (buf.size() > (1u << 23))
+			Flush();
+	}
+};
+
+// ************************************************************************************
+void append_uint(string& str, uint32_t x)
+{
+	char tmp[12];
+	int len = 0;
+
+	do
+	{
+		tmp[len++] = (char) ('0' + x % 10);
+		x /= 10;
+	} while (x);
+
+	while (len)
+		str.push_back(tmp[--len]);
+}
+
+// ************************************************************************************
+void write_header(CVCFWriter& writer, const synth_params_t& params, const string& csq_schema)
+{
+	string& s = writer.Buf();
+
+	s += "##fileformat=VCFv4.2\n";
+	s += "##source=vcfshark_synth (seed=" + to_string(params.seed) + ")\n";
+	s += "##contig=<ID=" + params.chrom + ",length=250000000>\n";
+	s += "##INFO=<ID=AC,Number=A,Type=Integer,Description=\"Allele count in genotypes\">\n";
+	s += "##INFO=<ID=AN,Number=1,Type=Integer,Description=\"Total number of alleles in called genotypes\">\n";
+	s += "##INFO=<ID=AF,Number=A,Type=Float,Description=\"Allele frequency\">\n";
+	if (params.has_dp)
+		s += "##INFO=<ID=DP,Number=1,Type=Integer,Description=\"Combined depth\">\n";
+	if (params.gvcf)
+	{
+		s += "##INFO=<ID=END,Number=1,Type=Integer,Description=\"End position of the reference block\">\n";
+		s += "##ALT=<ID=NON_REF,Description=\"Any possible alternative allele at this location\">\n";
+	}
+	s += csq_schema;
+	s += "##FILTER=<ID=LowQual,Description=\"Low quality\">\n";
+	s += "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n";
+	if (params.has_dp)
+		s += "##FORMAT=<ID=DP,Number=1,Type=Integer,Description=\"Read depth\">\n";
+	if (params.has_ad)
+		s += "##FORMAT=<ID=AD,Number=R,Type=Integer,Description=\"Allelic depths\">\n";
+	if (params.has_pl)
+		s += "##FORMAT=<ID=PL,Number=G,Type=Integer,Description=\"Phred-scaled genotype likelihoods\">\n";
+	if (params.has_gq)
+		s += "##FORMAT=<ID=GQ,Number=1,Type=Integer,Description=\"Genotype quality\">\n";
+
+	s += "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT";
+	for (uint32_t i = 0; i < params.no_samples; ++i)
+		s += "\tS" + to_string(i + 1);
+	s += "\n";
+}
+
+// ************************************************************************************
+// Reference-confidence block of a gVCF; FORMAT values are as of a homozygous reference genotype
+void write_ref_block(CVCFWriter& writer, const synth_params_t& params, mt19937_64& mt, uint32_t start, uint32_t end)
+{
+	string& s = writer.Buf();
+	poisson_distribution<uint32_t> dist_dp(15 + (uint32_t) (mt() % 30));
+
+	s += params.chrom;
+	s += '\t';
+	append_uint(s, start);
+	s += "\t.\t";
+	s += "ACGT"[mt() % 4];
+	s += "\t<NON_REF>\t.\t.\tEND=";
+	append_uint(s, end);
+	s += '\t';
+	s += "GT";
+	if (params.has_dp)	s += ":DP";
+	if (params.has_ad)	s += ":AD";
+	if (params.has_pl)	s += ":PL";
+	if (params.has_gq)	s += ":GQ";
+
+	for (uint32_t j = 0; j < params.no_samples; ++j)
+	{
+		uint32_t dp = dist_dp(mt);
+		uint32_t gq = min(99u, 3 * dp);
+
+		s += "\t0/0";
+		if (params.has_dp)
+		{
+			s += ':';
+			append_uint(s, dp);
+		}
+		if (params.has_ad)
+		{
+			s += ':';
+			append_uint(s, dp);
+			s += ",0";
+		}
+		if (params.has_pl)
+		{
+			s += ":0,";
+			append_uint(s, gq + 10);
+			s += ',';
+			append_uint(s, 2 * (gq + 10));
+		}
+		if (params.has_gq)
+		{
+			s += ':';
+			append_uint(s, gq);
+		}
+	}
+
+	s += '\n';
+}
+
+// ************************************************************************************
+bool generate(const synth_params_t& params)
+{
+	CVCFWriter writer;
+
+	if (!writer.Open(params.output_file_name))
+	{
+		cerr << "Cannot open: " << params.output_file_name << endl;
+		return false;
+	}
+
+	CSynthData synth(params.seed);
+	mt19937_64 mt(params.seed + 1);
+	uniform_real_distribution<double> dist_u(0.0, 1.0);
+	geometric_distribution<uint32_t> dist_gap(0.01);
+	const char bases[] = "ACGT";
+
+	synth.SetAlleleFrequencyRange(params.min_af, params.max_af);
+	synth.StartHaplotypes(2 * params.no_samples, params.no_founders);
+
+	// Separate generator, so the other fields are the same with and without annotations
+	CSynthData synth_annot(params.seed + 2);
+	string csq_schema;
+	vector<uint32_t> v_csq_size;
+	vector<uint8_t> v_csq;
+
+	if (params.annotations)
+		synth_annot.InfoAnnotations(0, csq_schema, v_csq_size, v_csq);
+
+	write_header(writer, params, csq_schema);
+
+	vector<uint32_t> v_haps;
+	vector<uint32_t> v_ac(3);
+	vector<uint32_t> v_ad(3);
+	string format = "GT";
+	uint32_t pos = 10000;
+
+	if (params.has_dp)	format += ":DP";
+	if (params.has_ad)	format += ":AD";
+	if (params.has_pl)	format += ":PL";
+	if (params.has_gq)	format += ":GQ";
+
+	for (uint32_t i = 0; i < params.no_variants; ++i)
+	{
+		uint32_t no_alleles = synth.NextVariantHaplotypes(v_haps, params.switch_prob, params.multi_allelic_rate);
+		uint32_t prev_pos = pos;
+		pos += 1 + dist_gap(mt);
+
+		if (params.gvcf && pos > prev_pos + 1)
+			write_ref_block(writer, params, mt, prev_pos + 1, pos - 1);
+
+		fill(v_ac.begin(), v_ac.end(), 0);
+		uint32_t an = 0;
+
+		for (uint32_t j = 0; j < 2 * params.no_samples; ++j)
+			if (params.missing_rate > 0 && dist_u(mt) < params.missing_rate)
+				v_haps[j] = 0;
+			else
+			{
+				++v_ac[v_haps[j] - 1];
+				++an;
+			}
+
+		string& s = writer.Buf();
+
+		// Variant description
+		uint32_t ref_id = (uint32_t) (mt() % 4);
+		s += params.chrom;
+		s += '\t';
+		append_uint(s, pos);
+		s += "\t.\t";
+		s += bases[ref_id];
+		s += '\t';
+		for (uint32_t a = 1; a < no_alleles; ++a)
+		{
+			if (a > 1)
+				s += ',';
+			s += bases[(ref_id + a) % 4];
+		}
+		uint32_t qual = 30 + (uint32_t) (mt() % 2000);
+		s += '\t';
+		append_uint(s, qual);
+		s += qual < 50 ? "\tLowQual\t" : "\tPASS\t";
+
+		// INFO
+		s += "AC=";
+		for (uint32_t a = 1; a < no_alleles; ++a)
+		{
+			if (a > 1)
+				s += ',';
+			append_uint(s, v_ac[a]);
+		}
+		s += ";AN=";
+		append_uint(s, an);
+		s += ";AF=";
+		for (uint32_t a = 1; a < no_alleles; ++a)
+		{
+			if (a > 1)
+				s += ',';
+			char tmp[32];
+			snprintf(tmp, sizeof(tmp), "%.4g", an ? (double) v_ac[a] / an : 0.0);
+			s += tmp;
+		}
+
+		uint32_t mean_dp = 15 + (uint32_t) (mt() % 30);
+		poisson_distribution<uint32_t> dist_dp(mean_dp);
+
+		if (params.has_dp)
+		{
+			s += ";DP=";
+			append_uint(s, mean_dp * params.no_samples);
+		}
+
+		if (params.annotations)
+		{
+			synth_annot.InfoAnnotations(1, csq_schema, v_csq_size, v_csq);
+			if (v_csq.size() > 1)
+			{
+				s += ";CSQ=";
+				s.append((const char*) v_csq.data(), v_csq.size() - 1);
+			}
+		}
+
+		s += '\t';
+		s += format;
+
+		// Samples
+		for (uint32_t j = 0; j < params.no_samples; ++j)
+		{
+			uint32_t h1 = v_haps[2 * j];
+			uint32_t h2 = v_haps[2 * j + 1];
+
+			s += '\t';
+			if (h1)
+				append_uint(s, h1 - 1);
+			else
+				s += '.';
+			s += '|';
+			if (h2)
+				append_uint(s, h2 - 1);
+			else
+				s += '.';
+
+			bool missing = !h1 || !h2;
+			uint32_t dp = missing ? 0 : dist_dp(mt);
+
+			if (params.has_dp)
+			{
+				s += ':';
+				append_uint(s, dp);
+			}
+
+			if (params.has_ad)
+			{
+				s += ':';
+				fill(v_ad.begin(), v_ad.end(), 0);
+				if (h1 == h2)
+					v_ad[h1 ? h1 - 1 : 0] = dp;
+				else if (!missing)
+				{
+					v_ad[h1 - 1] = dp / 2;
+					v_ad[h2 - 1] = dp - dp / 2;
+				}
+				for (uint32_t a = 0; a < no_alleles; ++a)
+				{
+					if (a)
+						s += ',';
+					append_uint(s, v_ad[a]);
+				}
+			}
+
+			uint32_t gq = missing ? 0 : min(99u, 3 * dp);
+
+			if (params.has_pl)
+			{
+				s += ':';
+				uint32_t g1 = missing ? 0 : min(h1, h2) - 1;
+				uint32_t g2 = missing ? 0 : max(h1, h2) - 1;
+				bool first = true;
+
+				// Genotype order of VCF: (0,0), (0,1), (1,1), (0,2), (1,2), (2,2)
+				for (uint32_t b = 0; b < no_alleles; ++b)
+					for (uint32_t a = 0; a <= b; ++a)
+					{
+						if (!first)
+							s += ',';
+						first = false;
+
+						uint32_t diff = (a != g1) + (b != g2);
+						append_uint(s, diff * (gq + 10));
+					}
+			}
+
+			if (params.has_gq)
+			{
+				s += ':';
+				append_uint(s, gq);
+			}
+		}
+
+		s += '\n';
+		writer.FlushIfLarge();
+	}
+
+	writer.Close();
+
+	return true;
+}
+
+// ************************************************************************************
+void usage()
+{
+	cerr << "vcfshark_synth [options]\n";
+	cerr << "Options:\n";
+	cerr << "  -s <value> - no. of samples (default: 1000)\n";
+	cerr << "  -v <value> - no. of variants (default: 10000)\n";
+	cerr << "  -f <value> - no. of founder haplotypes; fewer founders means more haplotype sharing (default: 64)\n";
+	cerr << "  -x <value> - probability of a switch of the copied founder per haplotype and variant (default: 0.001)\n";
+	cerr << "  -m <value> - fraction of multi-allelic variants (default: 0.05)\n";
+	cerr << "  -a <min_af> <max_af> - range of the log-uniform allele-frequency spectrum (default: 5e-5 0.5)\n";
+	cerr << "  -M <value> - fraction of missing haplotypes (default: 0)\n";
+	cerr << "  -F <list>  - FORMAT fields, subset of GT,DP,AD,PL,GQ (default: GT,DP,AD,PL,GQ)\n";
+	cerr << "  -A         - add VEP-like INFO/CSQ annotations\n";
+	cerr << "  -g         - gVCF: reference blocks (<NON_REF> ALT, END) between variants\n";
+	cerr << "  -c <name>  - chromosome name (default: chr20)\n";
+	cerr << "  -r <value> - random seed (default: 1)\n";
+	cerr << "  -o <file>  - output VCF file (default: stdout)\n";
+}
+
+// ************************************************************************************
+bool parse_params(int argc, char** argv, synth_params_t& params)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		string par = argv[i];
+
+		if (par == "-s" && i + 1 < argc)
+			params.no_samples = max(1, atoi(argv[++i]));
+		else if (par == "-v" && i + 1 < argc)
+			params.no_variants = max(0, atoi(argv[++i]));
+		else if (par == "-f" && i + 1 < argc)
+			params.no_founders = max(1, atoi(argv[++i]));
+		else if (par == "-x" && i + 1 < argc)
+			params.switch_prob = atof(argv[++i]);
+		else if (par == "-m" && i + 1 < argc)
+			params.multi_allelic_rate = atof(argv[++i]);
+		else if (par == "-a" && i + 2 < argc)
+		{
+			params.min_af = atof(argv[++i]);
+			params.max_af = atof(argv[++i]);
+		}
+		else if (par == "-M" && i + 1 < argc)
+			params.missing_rate = atof(argv[++i]);
+		else if (par == "-F" && i + 1 < argc)
+			params.fields = argv[++i];
+		else if (par == "-A")
+			params.annotations = true;
+		else if (par == "-g")
+			params.gvcf = true;
+		else if (par == "-c" && i + 1 < argc)
+			params.chrom = argv[++i];
+		else if (par == "-r" && i + 1 < argc)
+			params.seed = strtoull(argv[++i], nullptr, 10);
+		else if (par == "-o" && i + 1 < argc)
+			params.output_file_name = argv[++i];
+		else
+		{
+			if (par != "-h" && par != "--help")
+				cerr << "Unknown option : " << par << endl;
+			usage();
+			return false;
+		}
+	}
+
+	string fields = "," + params.fields + ",";
+	params.has_dp = fields.find(",DP,") != string::npos;
+	params.has_ad = fields.find(",AD,") != string::npos;
+	params.has_pl = fields.find(",PL,") != string::npos;
+	params.has_gq = fields.find(",GQ,") != string::npos;
+
+	return true;
+}
+
+// ************************************************************************************
+int main(int argc, char** argv)
+{
+	synth_params_t params;
+
+	if (!parse_params(argc, argv, params))
+		return 1;
+
+	return generate(params) ? 0 : 1;
+}
+
+// EOF
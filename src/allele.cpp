@@ -0,0 +1,318 @@
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include "allele.h"
+
+#include <algorithm>
+#include <cstring>
+
+// ************************************************************************************
+CAlleleCodec::CAlleleCodec()
+{
+	symbolic_tags = false;
+
+	fill_n(nuc_codes, 256, -1);
+
+	nuc_codes['A'] = 0;
+	nuc_codes['C'] = 1;
+	nuc_codes['G'] = 2;
+	nuc_codes['T'] = 3;
+}
+
+// ************************************************************************************
+CAlleleCodec::~CAlleleCodec()
+{
+}
+
+// ************************************************************************************
+void CAlleleCodec::SetSymbolicTags(bool _symbolic_tags)
+{
+	symbolic_tags = _symbolic_tags;
+}
+
+// ************************************************************************************
+bool CAlleleCodec::is_pure_acgt(const char* p, size_t len)
+{
+	if (len == 0)
+		return false;
+
+	for (size_t i = 0; i < len; ++i)
+		if (nuc_codes[(uint8_t)p[i]] < 0)
+			return false;
+
+	return true;
+}
+
+// ************************************************************************************
+void CAlleleCodec::encode_var_len(vector<uint8_t>& v_out, uint32_t x)
+{
+	while (x >= 128)
+	{
+		v_out.emplace_back((uint8_t)(128 + (x & 127)));
+		x >>= 7;
+	}
+
+	v_out.emplace_back((uint8_t)x);
+}
+
+// ************************************************************************************
+uint32_t CAlleleCodec::decode_var_len(const uint8_t*& p)
+{
+	uint32_t x = 0;
+	int shift = 0;
+
+	while (*p >= 128)
+	{
+		x += ((uint32_t)(*p++ & 127)) << shift;
+		shift += 7;
+	}
+
+	x += ((uint32_t) *p++) << shift;
+
+	return x;
+}
+
+// ************************************************************************************
+void CAlleleCodec::encode_allele(const char* p, size_t len, vector<uint8_t>& v_out)
+{
+	if (len == 1 && p[0] == '.')
+	{
+		v_out.emplace_back(tag_missing);
+		return;
+	}
+
+	if (symbolic_tags && len > 2 && p[0] == '<')
+	{
+		if (len == 9 && memcmp(p, "<NON_REF>", 9) == 0)
+		{
+			v_out.emplace_back(tag_non_ref);
+			return;
+		}
+		if (len == 3 && p[1] == '*' && p[2] == '>')
+		{
+			v_out.emplace_back(tag_any_alt);
+			return;
+		}
+	}
+
+	if (!is_pure_acgt(p, len))
+	{
+		v_out.emplace_back(tag_escape);
+		encode_var_len(v_out, (uint32_t)len);
+		v_out.insert(v_out.end(), p, p + len);
+		return;
+	}
+
+	if (len == 1)
+		v_out.emplace_back((uint8_t)nuc_codes[(uint8_t)p[0]]);
+	else if (len == 2)
+		v_out.emplace_back((uint8_t)(4 + nuc_codes[(uint8_t)p[0]] * 4 + nuc_codes[(uint8_t)p[1]]));
+	else if (len == 3)
+		v_out.emplace_back((uint8_t)(20 + nuc_codes[(uint8_t)p[0]] * 16 + nuc_codes[(uint8_t)p[1]] * 4 + nuc_codes[(uint8_t)p[2]]));
+	else
+	{
+		if (len <= tag_short_max_len)
+			v_out.emplace_back((uint8_t)(tag_packed_min + len - 4));
+		else
+		{
+			v_out.emplace_back(tag_packed_long);
+			encode_var_len(v_out, (uint32_t)len);
+		}
+
+		for (size_t i = 0; i < len; i += 4)
+		{
+			uint8_t x = 0;
+
+			for (size_t j = 0; j < 4 && i + j < len; ++j)
+				x += (uint8_t)(nuc_codes[(uint8_t)p[i + j]] << (2 * j));
+
+			v_out.emplace_back(x);
+		}
+	}
+}
+
+// ************************************************************************************
+void CAlleleCodec::decode_allele(const uint8_t*& p, string& str)
+{
+	uint32_t tag = *p++;
+	uint32_t len;
+
+	if (tag < 4)
+		str.push_back("ACGT"[tag]);
+	else if (tag < 20)
+	{
+		tag -= 4;
+		str.push_back("ACGT"[tag >> 2]);
+		str.push_back("ACGT"[tag & 3]);
+	}
+	else if (tag < tag_packed_min)
+	{
+		tag -= 20;
+		str.push_back("ACGT"[tag >> 4]);
+		str.push_back("ACGT"[(tag >> 2) & 3]);
+		str.push_back("ACGT"[tag & 3]);
+	}
+	else if (tag <= tag_packed_long)
+	{
+		if (tag == tag_packed_long)
+			len = decode_var_len(p);
+		else
+			len = tag - tag_packed_min + 4;
+
+		for (uint32_t i = 0; i < len; i += 4)
+		{
+			uint8_t x = *p++;
+
+			for (uint32_t j = 0; j < 4 && i + j < len; ++j, x >>= 2)
+				str.push_back("ACGT"[x & 3]);
+		}
+	}
+	else if (tag == tag_escape)
+	{
+		len = decode_var_len(p);
+		str.append((const char*)p, len);
+		p += len;
+	}
+	else if (tag == tag_missing)
+		str.push_back('.');
+	else if (tag == tag_non_ref)
+		str.append("<NON_REF>");
+	else if (tag == tag_any_alt)
+		str.append("<*>");
+}
+
+// ************************************************************************************
+void CAlleleCodec::EncodeRef(const string& ref, vector<uint8_t>& v_out)
+{
+	v_out.clear();
+
+	encode_allele(ref.c_str(), ref.size(), v_out);
+}
+
+// ************************************************************************************
+void CAlleleCodec::EncodeAlt(const string& alt, vector<uint8_t>& v_out)
+{
+	v_out.clear();
+
+	auto p = m_alt_dict.find(alt);
+
+	if (p != m_alt_dict.end())
+	{
+		v_out.emplace_back(tag_dict);
+		encode_var_len(v_out, p->second);
+
+		return;
+	}
+
+	const char* s = alt.c_str();
+	size_t len = alt.size();
+
+	if (len == 1 && s[0] == '.')
+	{
+		v_out.emplace_back(tag_missing);
+		return;
+	}
+
+	for (size_t i = 0; ; )
+	{
+		size_t j = i;
+		for (; j < len && s[j] != ','; ++j)
+			;
+
+		encode_allele(s + i, j - i, v_out);
+
+		if (j >= len)
+			break;
+		i = j + 1;
+	}
+
+	if (v_out.size() >= min_dict_entry_size && m_alt_dict.size() < max_dict_size)
+		m_alt_dict.emplace(alt, (uint32_t)m_alt_dict.size());
+}
+
+// ************************************************************************************
+void CAlleleCodec::DecodeRef(const uint8_t* p, uint32_t size, string& ref)
+{
+	ref.clear();
+
+	if (size)
+		decode_allele(p, ref);
+}
+
+// ************************************************************************************
+void CAlleleCodec::DecodeAlt(const uint8_t* p, uint32_t size, string& alt)
+{
+	alt.clear();
+
+	if (!size)
+		return;
+
+	if (*p == tag_dict)
+	{
+		++p;
+		alt = v_alt_dict[decode_var_len(p)];
+
+		return;
+	}
+
+	const uint8_t* p_end = p + size;
+
+	for (bool first = true; p < p_end; first = false)
+	{
+		if (!first)
+			alt.push_back(',');
+		decode_allele(p, alt);
+	}
+
+	if (size >= min_dict_entry_size && v_alt_dict.size() < max_dict_size)
+		v_alt_dict.emplace_back(alt);
+}
+
+// ************************************************************************************
+void CAlleleCodec::Reset()
+{
+	m_alt_dict.clear();
+	v_alt_dict.clear();
+}
+
+// ************************************************************************************
+void CAlleleCodec::SaveState(CState& state)
+{
+	vector<const string*> v_lists(m_alt_dict.size());
+
+	for (auto& x : m_alt_dict)
+		v_lists[x.second] = &x.first;
+
+	state.Write((uint64_t) v_lists.size());
+	for (auto p : v_lists)
+		state.Write(*p);
+}
+
+// ************************************************************************************
+bool CAlleleCodec::LoadState(CState& state)
+{
+	uint64_t size;
+	string alt;
+
+	m_alt_dict.clear();
+
+	if (!state.Read(size) || size > max_dict_size)
+		return false;
+
+	for (uint32_t i = 0; i < (uint32_t) size; ++i)
+	{
+		if (!state.Read(alt))
+			return false;
+		m_alt_dict.emplace(alt, i);
+	}
+
+	return true;
+}
+
+// EOF
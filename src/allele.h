@@ -0,0 +1,87 @@
+#pragma once
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "state.h"
+
+using namespace std;
+
+// ************************************************************************************
+// Typed codec for REF and ALT alleles
+// Every allele is stored as a self-delimiting code:
+//   0..3     - single nucleotide
+//   4..19    - two nucleotides
+//   20..83   - three nucleotides
+//   84..247  - pure ACGT allele of length 4..167 followed by nucleotides packed 4 per byte
+//   248      - pure ACGT allele of any length: length + packed nucleotides
+//   249      - escape: length + plain text
+//   250      - ALT list given as id in the dictionary of already seen lists
+//   251      - missing allele ('.')
+//   252      - symbolic allele <NON_REF> (gVCF reference blocks)
+//   253      - symbolic allele <*> (gVCF reference blocks)
+// ALT is a sequence of such codes (one per allele) or a single dictionary reference
+class CAlleleCodec
+{
+	const uint32_t tag_short_max_len = 167;
+	const uint8_t tag_packed_min = 84;
+	const uint8_t tag_packed_long = 248;
+	const uint8_t tag_escape = 249;
+	const uint8_t tag_dict = 250;
+	const uint8_t tag_missing = 251;
+	const uint8_t tag_non_ref = 252;
+	const uint8_t tag_any_alt = 253;
+
+	// ALT lists of encoded size at least min_dict_entry_size bytes are added to the dictionary
+	const size_t min_dict_entry_size = 3;
+	const uint32_t max_dict_size = 1u << 16;
+
+	unordered_map<string, uint32_t> m_alt_dict;
+	vector<string> v_alt_dict;
+
+	vector<uint8_t> v_tmp;
+
+	// Symbolic alleles of gVCF are coded as tags only if enabled (decoding supports them always)
+	bool symbolic_tags;
+
+	int8_t nuc_codes[256];
+
+	bool is_pure_acgt(const char* p, size_t len);
+
+	void encode_var_len(vector<uint8_t>& v_out, uint32_t x);
+	uint32_t decode_var_len(const uint8_t*& p);
+
+	void encode_allele(const char* p, size_t len, vector<uint8_t>& v_out);
+	void decode_allele(const uint8_t*& p, string& str);
+
+public:
+	CAlleleCodec();
+	~CAlleleCodec();
+
+	void SetSymbolicTags(bool _symbolic_tags);
+
+	void EncodeRef(const string& ref, vector<uint8_t>& v_out);
+	void EncodeAlt(const string& alt, vector<uint8_t>& v_out);
+
+	void DecodeRef(const uint8_t* p, uint32_t size, string& ref);
+	void DecodeAlt(const uint8_t* p, uint32_t size, string& alt);
+
+	// Forgets the dictionary of ALT lists (row groups are coded independently)
+	void Reset();
+
+	// Dictionary of ALT lists of the encoder (checkpoints of compression)
+	void SaveState(CState& state);
+	bool LoadState(CState& state);
+};
+
+// EOF
@@ -0,0 +1,746 @@
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstring>
+
+#include "annot.h"
+#include "string_dict.h"
+#include "text_pp.h"
+
+// ************************************************************************************
+CAnnotationCodec::CAnnotationCodec(uint32_t _no_fields, uint32_t _no_threads)
+{
+	no_fields = _no_fields;
+	no_threads = max(_no_threads, 1u);
+}
+
+// ************************************************************************************
+bool CAnnotationCodec::ParseSchema(const string& header, const string& key_name, vector<string>& v_names)
+{
+	v_names.clear();
+
+	size_t p = header.find("##INFO=<ID=" + key_name + ",");
+	if (p == string::npos)
+		return false;
+
+	size_t line_end = header.find('\n', p);
+	string line = header.substr(p, line_end == string::npos ? string::npos : line_end - p);
+
+	size_t desc_start = line.find("Description=\"");
+	if (desc_start == string::npos)
+		return false;
+
+	desc_start += 13;
+	size_t desc_end = desc_start;
+	while (desc_end < line.size() && !(line[desc_end] == '"' && line[desc_end - 1] != '\\'))
+		++desc_end;
+
+	string desc = line.substr(desc_start, desc_end - desc_start);
+	string list;
+
+	// VEP and bcftools: "... Format: Allele|Consequence|...", SnpEff: "...: 'Allele | Annotation | ...' "
+	size_t p_format = desc.find("Format:");
+	if (p_format != string::npos)
+		list = desc.substr(p_format + 7);
+	else
+	{
+		size_t q_first = desc.find('\'');
+		size_t q_last = desc.rfind('\'');
+
+		if (q_first == string::npos || q_last <= q_first)
+			return false;
+
+		list = desc.substr(q_first + 1, q_last - q_first - 1);
+	}
+
+	string name;
+	list.push_back('|');
+
+	for (auto c : list)
+		if (c == '|')
+		{
+			auto p_first = name.find_first_not_of(" \t'");
+			auto p_last = name.find_last_not_of(" \t'");
+
+			v_names.emplace_back(p_first == string::npos ? string() : name.substr(p_first, p_last - p_first + 1));
+			name.clear();
+		}
+		else
+			name.push_back(c);
+
+	return v_names.size() >= 2;
+}
+
+// ************************************************************************************
+void CAnnotationCodec::append_var(vector<uint8_t>& v, uint64_t x)
+{
+	for (; x >= 0x80; x >>= 7)
+		v.push_back((uint8_t) (0x80 | (x & 0x7f)));
+	v.push_back((uint8_t) x);
+}
+
+// ************************************************************************************
+bool CAnnotationCodec::read_var(const vector<uint8_t>& v, size_t& pos, uint64_t& x)
+{
+	x = 0;
+
+	for (int shift = 0; pos < v.size() && shift < 64; shift += 7)
+	{
+		uint8_t c = v[pos++];
+		x += ((uint64_t) (c & 0x7f)) << shift;
+
+		if (!(c & 0x80))
+			return true;
+	}
+
+	return false;
+}
+
+// ************************************************************************************
+// Only canonical numbers (without leading zeros) are coded as numbers, so they are restored exactly
+bool CAnnotationCodec::is_number(const uint8_t* p, uint32_t len) const
+{
+	if (len == 0)
+		return true;
+
+	if (len > max_numeric_len || (len > 1 && p[0] == '0'))
+		return false;
+
+	for (uint32_t i = 0; i < len; ++i)
+		if (p[i] < '0' || p[i] > '9')
+			return false;
+
+	return true;
+}
+
+// ************************************************************************************
+// Values of a column with a reference column are preceded by a flag telling if the reference value was removed.
+// In text columns the flags are kept in a separate stream, as the text can be tokenised (small bytes are codes there).
+void CAnnotationCodec::encode_column(const uint8_t* p_data, const vector<value_t>& v_values, column_desc_t& col)
+{
+	vector<uint8_t> v_raw;
+	vector<uint8_t> v_flags;
+	vector<uint8_t> v_value;
+	bool with_ref = col.ref != no_ref;
+
+	col.v_packed.clear();
+
+	auto get_value = [&](const value_t& x) {
+		v_value.clear();
+		if (with_ref)
+			v_value.push_back(x.prefixed ? flag_prefixed : flag_plain);
+		v_value.insert(v_value.end(), p_data + x.pos, p_data + x.pos + x.len);
+	};
+
+	if (!with_ref && all_of(v_values.begin(), v_values.end(), [](const value_t& x) {return x.len == 0; }))
+	{
+		col.type = column_t::empty;
+		return;
+	}
+
+	if (!with_ref && all_of(v_values.begin(), v_values.end(), [&](const value_t& x) {return is_number(p_data + x.pos, x.len); }))
+	{
+		col.type = column_t::numeric;
+
+		for (auto& x : v_values)
+		{
+			uint64_t val = 0;
+			for (uint32_t i = 0; i < x.len; ++i)
+				val = val * 10 + (p_data[x.pos + i] - '0');
+
+			append_var(v_raw, x.len ? val + 1 : 0);
+		}
+	}
+	else
+	{
+		CStringDict dict;
+		vector<uint8_t> v_dict;
+		vector<uint8_t> v_ids;
+		bool inserted;
+
+		for (auto& x : v_values)
+		{
+			get_value(x);
+			uint32_t id = dict.FindOrInsert(v_value.data(), (uint32_t) v_value.size(), inserted);
+
+			// New values are coded as 0, the others by distance from the last new value (recent values are frequent)
+			if (inserted)
+			{
+				v_dict.insert(v_dict.end(), v_value.begin(), v_value.end());
+				v_dict.push_back(0);
+				append_var(v_ids, 0);
+			}
+			else
+				append_var(v_ids, dict.Size() - id);
+		}
+
+		if (dict.Size() * max_dict_ratio <= v_values.size())
+		{
+			col.type = column_t::dict;
+
+			append_var(v_raw, dict.Size());
+			v_raw.insert(v_raw.end(), v_dict.begin(), v_dict.end());
+			v_raw.insert(v_raw.end(), v_ids.begin(), v_ids.end());
+		}
+		else
+		{
+			col.type = column_t::text;
+
+			for (auto& x : v_values)
+			{
+				if (with_ref)
+					v_flags.push_back(x.prefixed ? flag_prefixed : flag_plain);
+				v_raw.insert(v_raw.end(), p_data + x.pos, p_data + x.pos + x.len);
+				v_raw.push_back(0);
+			}
+		}
+	}
+
+	CBSCWrapper bsc;
+	vector<uint8_t> v_packed_flags;
+
+	bsc.InitCompress(p_bsc_column);
+	bsc.Compress(v_raw, col.v_packed);
+
+	if (!v_flags.empty())
+		bsc.Compress(v_flags, v_packed_flags);
+
+	// Free text (e.g., HGVS notation or ids of variants) can be smaller after tokenisation of words and numbers
+	if (col.type == column_t::text)
+	{
+		CTextPreprocessing text_pp;
+		vector<uint8_t> v_tokens, v_packed;
+
+		text_pp.EncodeText(v_raw, v_tokens);
+		bsc.Compress(v_tokens, v_packed);
+
+		if (v_packed.size() < col.v_packed.size())
+		{
+			col.type = column_t::tokens;
+			col.v_packed = move(v_packed);
+		}
+	}
+
+	// Flags go before the text: size of the packed flags, packed flags
+	if (!v_flags.empty())
+	{
+		vector<uint8_t> v_head;
+
+		append_var(v_head, v_packed_flags.size());
+		v_head.insert(v_head.end(), v_packed_flags.begin(), v_packed_flags.end());
+		col.v_packed.insert(col.v_packed.begin(), v_head.begin(), v_head.end());
+	}
+}
+
+// ************************************************************************************
+bool CAnnotationCodec::decode_column(column_desc_t& col)
+{
+	col.v_text.clear();
+	col.v_end.clear();
+
+	if (col.type == column_t::empty)
+		return true;
+
+	vector<uint8_t> v_raw;
+	vector<uint8_t> v_flags;
+	size_t pos = 0;
+	uint64_t x;
+
+	if (col.ref != no_ref && (col.type == column_t::text || col.type == column_t::tokens))
+	{
+		if (!read_var(col.v_packed, pos, x) || pos + x > col.v_packed.size())
+			return false;
+
+		vector<uint8_t> v_packed_flags(col.v_packed.begin() + pos, col.v_packed.begin() + pos + x);
+
+		col.v_packed.erase(col.v_packed.begin(), col.v_packed.begin() + pos + x);
+		CBSCWrapper::Decompress(v_packed_flags, v_flags);
+		pos = 0;
+
+		if (v_flags.empty())
+			return false;
+	}
+
+	CBSCWrapper::Decompress(col.v_packed, v_raw);
+
+	if (col.type == column_t::tokens)
+	{
+		CTextPreprocessing text_pp;
+		vector<uint8_t> v_tokens;
+
+		swap(v_raw, v_tokens);
+		text_pp.DecodeText(v_tokens, v_raw);
+		col.type = column_t::text;
+	}
+
+	switch (col.type)
+	{
+	case column_t::raw:
+		col.v_text = move(v_raw);
+		break;
+	case column_t::numeric:
+		while (pos < v_raw.size())
+		{
+			if (!read_var(v_raw, pos, x))
+				return false;
+
+			if (x)
+			{
+				string s = to_string(x - 1);
+				col.v_text.insert(col.v_text.end(), s.begin(), s.end());
+			}
+
+			col.v_end.push_back((uint32_t) col.v_text.size());
+		}
+		break;
+	case column_t::dict:
+	{
+		vector<uint32_t> v_dict_pos;
+		uint64_t no_seen = 0;
+
+		if (!read_var(v_raw, pos, x))
+			return false;
+
+		v_dict_pos.push_back((uint32_t) pos);
+		for (uint64_t i = 0; i < x; ++i)
+		{
+			while (pos < v_raw.size() && v_raw[pos])
+				++pos;
+			if (pos++ >= v_raw.size())
+				return false;
+
+			v_dict_pos.push_back((uint32_t) pos);
+		}
+
+		while (pos < v_raw.size())
+		{
+			uint64_t code, id;
+
+			if (!read_var(v_raw, pos, code) || code > no_seen || (!code && no_seen == x))
+				return false;
+
+			id = code ? no_seen - code : no_seen++;
+
+			col.v_text.insert(col.v_text.end(), v_raw.begin() + v_dict_pos[id], v_raw.begin() + v_dict_pos[id + 1] - 1);
+			col.v_end.push_back((uint32_t) col.v_text.size());
+		}
+		break;
+	}
+	case column_t::text:
+	{
+		// Flags are put back in front of the values, as in the other kinds of columns
+		bool at_start = true;
+
+		col.v_text.reserve(v_raw.size() + v_flags.size());
+		for (auto c : v_raw)
+		{
+			if (at_start && !v_flags.empty())
+			{
+				if (col.v_end.size() >= v_flags.size())
+					return false;
+				col.v_text.push_back(v_flags[col.v_end.size()]);
+			}
+
+			at_start = c == 0;
+
+			if (c)
+				col.v_text.push_back(c);
+			else
+				col.v_end.push_back((uint32_t) col.v_text.size());
+		}
+
+		if (!v_flags.empty() && col.v_end.size() != v_flags.size())
+			return false;
+		break;
+	}
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+// ************************************************************************************
+void CAnnotationCodec::run_parallel(uint32_t no_tasks, const function<bool(uint32_t)>& task, bool& ok)
+{
+	atomic<uint32_t> next_task(0);
+	atomic<bool> all_ok(true);
+
+	auto worker = [&] {
+		for (uint32_t i = next_task++; i < no_tasks; i = next_task++)
+			if (!task(i))
+				all_ok = false;
+	};
+
+	uint32_t no_workers = min(no_threads, no_tasks);
+	vector<thread> v_threads;
+
+	for (uint32_t i = 1; i < no_workers; ++i)
+		v_threads.emplace_back(worker);
+
+	worker();
+
+	for (auto& t : v_threads)
+		t.join();
+
+	ok = all_ok;
+}
+
+// ************************************************************************************
+// Value without trailing zeros (terminators of strings); zeros inside are not allowed
+bool CAnnotationCodec::value_range(const vector<uint8_t>& v_data, size_t pos, uint32_t size, uint32_t& end, uint32_t& no_zeros)
+{
+	if (pos + size > v_data.size())
+		return false;
+
+	const uint8_t* p_data = v_data.data();
+
+	end = (uint32_t) (pos + size);
+	no_zeros = 0;
+
+	for (; end > pos && p_data[end - 1] == 0; --end)
+		++no_zeros;
+
+	return no_zeros <= max_trailing_zeros && find(p_data + pos, p_data + end, 0) == p_data + end;
+}
+
+// ************************************************************************************
+void CAnnotationCodec::split_annotations(const uint8_t* p_data, uint32_t start, uint32_t end, vector<value_t>& v_fields,
+	const function<void(vector<value_t>&)>& callback)
+{
+	uint32_t field_start = start;
+
+	v_fields.clear();
+
+	for (uint32_t i = start; i <= end; ++i)
+	{
+		if (i < end && p_data[i] != '|' && p_data[i] != ',')
+			continue;
+
+		v_fields.push_back(value_t{ field_start, i - field_start, false });
+		field_start = i + 1;
+
+		if (i == end || p_data[i] == ',')
+		{
+			callback(v_fields);
+			v_fields.clear();
+		}
+	}
+}
+
+// ************************************************************************************
+// Reference of a column is the earlier column whose value starts most of its values
+void CAnnotationCodec::choose_refs(const vector<uint32_t>& v_size, const vector<uint8_t>& v_data, vector<uint32_t>& v_ref)
+{
+	v_ref.assign(no_fields, no_ref);
+
+	if (no_fields > max_ref_fields)
+		return;
+
+	vector<uint32_t> v_cnt((size_t) no_fields * no_fields, 0);
+	vector<uint32_t> v_no_present(no_fields, 0);
+	vector<value_t> v_fields;
+	const uint8_t* p_data = v_data.data();
+	uint32_t no_sampled = 0;
+	uint32_t end, no_zeros;
+	size_t pos = 0;
+
+	for (size_t i = 0; i < v_size.size() && no_sampled < ref_sample_size; pos += v_size[i++])
+	{
+		if (!value_range(v_data, pos, v_size[i], end, no_zeros))
+			break;
+
+		if (pos == end)
+			continue;
+
+		split_annotations(p_data, (uint32_t) pos, end, v_fields, [&](vector<value_t>& v_fields) {
+			uint32_t nf = min((uint32_t) v_fields.size(), no_fields);
+
+			++no_sampled;
+
+			for (uint32_t j = 1; j < nf; ++j)
+			{
+				auto& x = v_fields[j];
+
+				if (!x.len)
+					continue;
+
+				++v_no_present[j];
+
+				for (uint32_t k = 0; k < j; ++k)
+				{
+					auto& r = v_fields[k];
+
+					if (r.len >= min_ref_len && r.len <= x.len && memcmp(p_data + r.pos, p_data + x.pos, r.len) == 0)
+						++v_cnt[(size_t) j * no_fields + k];
+				}
+			}
+		});
+	}
+
+	for (uint32_t j = 1; j < no_fields; ++j)
+	{
+		auto p_best = max_element(v_cnt.begin() + (size_t) j * no_fields, v_cnt.begin() + (size_t) j * no_fields + j);
+
+		if (*p_best >= min_ref_cnt && 2 * *p_best >= v_no_present[j])
+			v_ref[j] = (uint32_t) (p_best - (v_cnt.begin() + (size_t) j * no_fields));
+	}
+}
+
+// ************************************************************************************
+// Structure of a value: no. of trailing zeros, no. of annotations, no. of subfields of each annotation (0 - as in the schema)
+bool CAnnotationCodec::Encode(const vector<uint32_t>& v_size, const vector<uint8_t>& v_data, vector<uint8_t>& v_output)
+{
+	vector<uint8_t> v_struct;
+	vector<vector<value_t>> v_values(no_fields + 1);			// subfields beyond the schema are kept in the last column
+	vector<uint32_t> v_ref;
+	vector<value_t> v_fields;
+	const uint8_t* p_data = v_data.data();
+	uint64_t no_annotations = 0;
+	uint64_t no_regular = 0;
+	uint32_t end, no_zeros;
+	size_t pos = 0;
+
+	v_output.clear();
+
+	choose_refs(v_size, v_data, v_ref);
+
+	for (auto size : v_size)
+	{
+		if (!value_range(v_data, pos, size, end, no_zeros))
+			return false;
+
+		uint32_t start = (uint32_t) pos;
+
+		append_var(v_struct, no_zeros);
+		pos += size;
+
+		if (start == end)
+		{
+			append_var(v_struct, 0);
+			continue;
+		}
+
+		append_var(v_struct, 1 + count(p_data + start, p_data + end, ','));
+
+		split_annotations(p_data, start, end, v_fields, [&](vector<value_t>& v_fields) {
+			uint32_t nf = (uint32_t) v_fields.size();
+
+			append_var(v_struct, nf == no_fields ? 0 : nf);
+			no_regular += nf == no_fields;
+			++no_annotations;
+
+			for (uint32_t j = 0; j < nf; ++j)
+			{
+				value_t x = v_fields[j];
+
+				if (j < no_fields && v_ref[j] != no_ref)
+				{
+					auto& r = v_fields[v_ref[j]];
+
+					x.prefixed = r.len && r.len <= x.len && memcmp(p_data + r.pos, p_data + x.pos, r.len) == 0;
+					if (x.prefixed)
+					{
+						x.pos += r.len;
+						x.len -= r.len;
+					}
+				}
+
+				v_values[min(j, no_fields)].push_back(x);
+			}
+		});
+	}
+
+	if (2 * no_regular < no_annotations)
+		return false;
+
+	vector<column_desc_t> v_columns(no_fields + 2);
+	bool ok;
+
+	for (uint32_t i = 0; i < no_fields + 2; ++i)
+		v_columns[i].ref = (i >= 1 && i <= no_fields) ? v_ref[i - 1] : no_ref;
+
+	run_parallel(no_fields + 2, [&](uint32_t i) {
+		if (i == 0)
+		{
+			CBSCWrapper bsc;
+
+			v_columns[0].type = column_t::raw;
+			bsc.InitCompress(p_bsc_column);
+			bsc.Compress(v_struct, v_columns[0].v_packed);
+		}
+		else
+			encode_column(p_data, v_values[i - 1], v_columns[i]);
+
+		return true;
+	}, ok);
+
+	append_var(v_output, no_fields);
+
+	for (auto& col : v_columns)
+	{
+		v_output.push_back((uint8_t) col.type);
+
+		if (col.type != column_t::empty)
+		{
+			append_var(v_output, col.ref == no_ref ? 0 : col.ref + 1);
+			append_var(v_output, col.v_packed.size());
+			v_output.insert(v_output.end(), col.v_packed.begin(), col.v_packed.end());
+		}
+	}
+
+	return ok;
+}
+
+// ************************************************************************************
+bool CAnnotationCodec::Decode(const vector<uint32_t>& v_size, const vector<uint8_t>& v_input, vector<uint8_t>& v_output)
+{
+	vector<column_desc_t> v_columns(no_fields + 2);
+	size_t pos = 0;
+	uint64_t x;
+
+	v_output.clear();
+
+	if (!read_var(v_input, pos, x) || x != no_fields)
+		return false;
+
+	for (uint32_t i = 0; i < no_fields + 2; ++i)
+	{
+		auto& col = v_columns[i];
+
+		if (pos >= v_input.size())
+			return false;
+
+		col.type = (column_t) v_input[pos++];
+		col.ref = no_ref;
+
+		if (col.type != column_t::empty)
+		{
+			if (!read_var(v_input, pos, x))
+				return false;
+
+			// Reference column has to precede the column in an annotation
+			if (x)
+			{
+				if (i < 1 || i > no_fields || x > i - 1)
+					return false;
+				col.ref = (uint32_t) (x - 1);
+			}
+
+			if (!read_var(v_input, pos, x) || pos + x > v_input.size())
+				return false;
+
+			col.v_packed.assign(v_input.begin() + pos, v_input.begin() + pos + x);
+			pos += x;
+		}
+	}
+
+	bool ok;
+
+	run_parallel(no_fields + 2, [&](uint32_t i) {
+		if (i == 0 && v_columns[0].type != column_t::raw && v_columns[0].type != column_t::empty)
+			return false;
+
+		bool r = decode_column(v_columns[i]);
+		v_columns[i].v_packed.clear();
+		v_columns[i].v_packed.shrink_to_fit();
+
+		return r;
+	}, ok);
+
+	if (!ok)
+		return false;
+
+	// Annotations are assembled from the columns in the order of the structure stream
+	auto& v_struct = v_columns[0].v_text;
+	vector<uint32_t> v_col_pos(no_fields + 1, 0);
+	vector<size_t> v_field_start(no_fields, 0);
+	vector<size_t> v_field_end(no_fields, 0);
+	size_t struct_pos = 0;
+
+	for (auto size : v_size)
+	{
+		size_t start = v_output.size();
+		uint64_t no_zeros, no_annotations, no_subfields;
+
+		if (!read_var(v_struct, struct_pos, no_zeros) || !read_var(v_struct, struct_pos, no_annotations))
+			return false;
+
+		for (uint64_t i = 0; i < no_annotations; ++i)
+		{
+			if (!read_var(v_struct, struct_pos, no_subfields))
+				return false;
+
+			if (i)
+				v_output.push_back(',');
+
+			if (!no_subfields)
+				no_subfields = no_fields;
+
+			for (uint64_t j = 0; j < no_subfields; ++j)
+			{
+				uint32_t col_id = (uint32_t) min<uint64_t>(j, no_fields);
+				auto& col = v_columns[1 + col_id];
+				auto& col_pos = v_col_pos[col_id];
+
+				if (j)
+					v_output.push_back('|');
+
+				size_t field_start = v_output.size();
+
+				if (col.type != column_t::empty)
+				{
+					if (col_pos >= col.v_end.size())
+						return false;
+
+					uint32_t val_start = col_pos ? col.v_end[col_pos - 1] : 0;
+					uint32_t val_end = col.v_end[col_pos++];
+
+					if (col.ref != no_ref)
+					{
+						if (val_start == val_end)
+							return false;
+
+						uint8_t flag = col.v_text[val_start++];
+
+						if (flag == flag_prefixed)
+						{
+							size_t len = v_field_end[col.ref] - v_field_start[col.ref];
+
+							v_output.resize(field_start + len);
+							copy_n(v_output.begin() + v_field_start[col.ref], len, v_output.begin() + field_start);
+						}
+						else if (flag != flag_plain)
+							return false;
+					}
+
+					v_output.insert(v_output.end(), col.v_text.begin() + val_start, col.v_text.begin() + val_end);
+				}
+
+				if (j < no_fields)
+				{
+					v_field_start[j] = field_start;
+					v_field_end[j] = v_output.size();
+				}
+			}
+		}
+
+		v_output.insert(v_output.end(), no_zeros, 0);
+
+		if (v_output.size() - start != size)
+			return false;
+	}
+
+	return true;
+}
+
+// EOF
@@ -0,0 +1,88 @@
+#pragma once
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "bsc.h"
+
+using namespace std;
+
+// ************************************************************************************
+// Columnar coding of structured annotations (INFO/CSQ of VEP, INFO/ANN of SnpEff, INFO/BCSQ of bcftools).
+// A value is a list of annotations separated by ',', each made of subfields separated by '|' as declared in the header.
+// A part is split into a structure stream (no. of annotations and subfields) and a stream per subfield column.
+// Each column is coded as numbers, a dictionary of values or (possibly tokenised) text, whatever fits its values, and
+// compressed separately, so the columns can be coded and decoded in parallel (no_threads; 1 when the codec is run in
+// a thread of a pool that already works on many parts). Parts are independent of each other.
+class CAnnotationCodec
+{
+	enum class column_t : uint8_t { empty, numeric, dict, text, tokens, raw };
+
+	typedef struct {
+		uint32_t pos;
+		uint32_t len;
+		bool prefixed;								// value of the reference column was removed from the front
+	} value_t;
+
+	typedef struct {
+		column_t type;
+		uint32_t ref;
+		vector<uint8_t> v_packed;
+
+		// Decoding: values stored one after another
+		vector<uint8_t> v_text;
+		vector<uint32_t> v_end;
+	} column_desc_t;
+
+	const bsc_params_t p_bsc_column = { 25, 16, 64, LIBBSC_CODER_QLFC_ADAPTIVE };
+	const uint32_t max_numeric_len = 18;
+	const uint32_t max_dict_ratio = 4;				// dictionary is used if no. of values >= max_dict_ratio * no. of distinct ones
+	const uint32_t max_trailing_zeros = 3;
+
+	// Subfields often start with the value of an earlier one (e.g., HGVSc with the transcript id), which is then
+	// removed from them; the reference columns are chosen from the first annotations of a part
+	const uint32_t no_ref = ~0u;
+	const uint32_t ref_sample_size = 1024;
+	const uint32_t min_ref_len = 4;
+	const uint32_t min_ref_cnt = 16;
+	const uint32_t max_ref_fields = 256;
+	const uint8_t flag_prefixed = 1;
+	const uint8_t flag_plain = 2;
+
+	uint32_t no_fields;
+	uint32_t no_threads;
+
+	static void append_var(vector<uint8_t>& v, uint64_t x);
+	static bool read_var(const vector<uint8_t>& v, size_t& pos, uint64_t& x);
+
+	bool value_range(const vector<uint8_t>& v_data, size_t pos, uint32_t size, uint32_t& end, uint32_t& no_zeros);
+	void split_annotations(const uint8_t* p_data, uint32_t start, uint32_t end, vector<value_t>& v_fields, const function<void(vector<value_t>&)>& callback);
+	void choose_refs(const vector<uint32_t>& v_size, const vector<uint8_t>& v_data, vector<uint32_t>& v_ref);
+
+	bool is_number(const uint8_t* p, uint32_t len) const;
+	void encode_column(const uint8_t* p_data, const vector<value_t>& v_values, column_desc_t& col);
+	bool decode_column(column_desc_t& col);
+	void run_parallel(uint32_t no_tasks, const function<bool(uint32_t)>& task, bool& ok);
+
+public:
+	CAnnotationCodec(uint32_t _no_fields, uint32_t _no_threads);
+
+	// Names of subfields declared for INFO/key_name in the header (after "Format:" or between quotes in the Description)
+	static bool ParseSchema(const string& header, const string& key_name, vector<string>& v_names);
+
+	// Returns false if the values do not look like annotations of the schema (the part should be coded as text then)
+	bool Encode(const vector<uint32_t>& v_size, const vector<uint8_t>& v_data, vector<uint8_t>& v_output);
+	bool Decode(const vector<uint32_t>& v_size, const vector<uint8_t>& v_input, vector<uint8_t>& v_output);
+};
+
+// EOF
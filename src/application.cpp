@@ -13,8 +13,16 @@
 
 #include <iostream>
 #include <vector>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <map>
+#include <cctype>
+#include <functional>
+#include <sys/stat.h>
 
 using namespace std;
+using namespace std::chrono;
 
 // ******************************************************************************
 CApplication::CApplication(const CParams &_params)
@@ -31,9 +39,79 @@ CApplication::~CApplication()
 {
 }
 
+// ******************************************************************************
+void CApplication::init_stats(const string& mode, const string& input_file_name, const string& output_file_name, CCompressedFile* cfile)
+{
+	if (params.stats_file_name.empty())
+		return;
+
+	stats.reset(new CStats);
+	stats->SetRun(mode, input_file_name, output_file_name, params.no_threads);
+	cfile->SetStats(stats.get());
+}
+
+// ******************************************************************************
+void CApplication::name_stats_items(CVCF* vcf)
+{
+	if (!stats)
+		return;
+
+	for (size_t i = 0; i < keys.size(); ++i)
+		stats->SetItemName(i, vcf->GetKeyName(keys[i]));
+}
+
+// ******************************************************************************
+void CApplication::save_stats(uint64_t no_variants, uint32_t no_samples, double total_time)
+{
+	if (!stats)
+		return;
+
+	stats->SetDataset(no_variants, no_samples);
+	stats->SetTotalTime(total_time);
+
+	CArchive archive(true);
+	if (archive.Open(params.db_file_name))
+		stats->AddArchiveStreams(archive);
+
+	if (!stats->SaveJSON(params.stats_file_name))
+		cerr << "Cannot save statistics to: " << params.stats_file_name << endl;
+}
+
+// ******************************************************************************
+void CApplication::init_mem_governor(CCompressedFile* cfile)
+{
+	if (!params.max_memory)
+		return;
+
+	mem_governor.reset(new CMemoryGovernor(params.max_memory));
+	cfile->SetMemoryGovernor(mem_governor.get());
+}
+
+// ******************************************************************************
+// Approximate size of the field data of a batch of variants
+int64_t CApplication::batch_memory(const vector<pair<variant_desc_t, vector<field_desc>>>& v_batch)
+{
+	int64_t r = 0;
+
+	for (auto& x : v_batch)
+		for (auto& f : x.second)
+			r += f.data_size * 4;
+
+	return r;
+}
+
+// ******************************************************************************
+void CApplication::report_mem_governor()
+{
+	if (mem_governor)
+		mem_governor->Report(cerr);
+}
+
 // ******************************************************************************
 bool CApplication::CompressDB()
 {
+	auto t_start = high_resolution_clock::now();
+
 	CBarrier barrier(3);
 	unique_ptr<CVCF> vcf(new CVCF());
 	unique_ptr<CCompressedFile> cfile(new CCompressedFile());
@@ -62,6 +140,9 @@ bool CApplication::CompressDB()
 	cfile->SetPloidy(vcf->GetPloidy());
 	cfile->SetNoThreads(params.no_threads);
 
+	init_stats("compress", params.vcf_file_name, params.db_file_name, cfile.get());
+	init_mem_governor(cfile.get());
+
 	size_t i_variant = 0;
 
     for(int i = 0; i < no_flt_keys+no_info_keys+no_fmt_keys; i++)
@@ -79,6 +160,45 @@ bool CApplication::CompressDB()
             break;
         }
     }
+
+	if (params.gvcf)
+	{
+		// INFO/END of reference blocks is coded against POS
+		int end_key_id = -1;
+		auto p_end = InfoIdToFieldId.find(vcf->GetKeyId("END"));
+
+		if (p_end != InfoIdToFieldId.end() && keys[p_end->second].type == BCF_HT_INT)
+			end_key_id = (int) p_end->second;
+
+		cfile->SetGVCF(true, end_key_id);
+	}
+
+	if (!params.lossy_profile.empty())
+	{
+		CQuantizer quantizer;
+
+		if (!quantizer.SetProfile(params.lossy_profile))
+		{
+			cerr << "Incorrect lossy profile : " << params.lossy_profile << endl;
+			return false;
+		}
+
+		for (auto& field : quantizer.GetFields())
+		{
+			auto p_key = FormatIdToFieldId.find(vcf->GetKeyId(field));
+
+			if (p_key != FormatIdToFieldId.end() && keys[p_key->second].type == BCF_HT_INT && (int) p_key->second != gt_key_id)
+				quantizer.BindKey(field, p_key->second, (uint32_t) keys.size());
+			else
+				cerr << "Lossy profile: " << field << " is not an integer FORMAT field of the input - ignored" << endl;
+		}
+
+		cfile->SetQuantizer(quantizer);
+	}
+
+	cfile->SetSampleOrder(params.sample_order);
+	cfile->SetRowGroupSize(params.row_group_size);
+	cfile->SetAppendOnly(params.append_only);
     
 	vcf->GetHeader(header);
 	vcf->GetSamplesList(v_samples);
@@ -86,19 +206,66 @@ bool CApplication::CompressDB()
 	cfile->AddSamples(v_samples);
     cfile->SetNoKeys((uint32_t)keys.size());
     cfile->SetKeys(keys);
+
+	// Structured annotations (VEP, SnpEff, bcftools csq) are coded in columns of the subfields declared in the header
+	for (auto name : { "CSQ", "ANN", "BCSQ" })
+	{
+		auto p_key = InfoIdToFieldId.find(vcf->GetKeyId(name));
+		vector<string> v_names;
+
+		if (p_key != InfoIdToFieldId.end() && keys[p_key->second].type == BCF_HT_STR && CAnnotationCodec::ParseSchema(header, name, v_names))
+			cfile->SetAnnotationKey(p_key->second, (uint32_t) v_names.size());
+	}
     
 	function_data_item_t empty_data_map;
 
 	vector<bool> v_empty(no_flt_keys + no_info_keys + no_fmt_keys, true);
 
-	if (!cfile->OpenForWriting(params.db_file_name, no_flt_keys + no_info_keys + no_fmt_keys))
+	// Compression of an interrupted run is continued from its last checkpoint: the input records compressed
+	// before it are skipped and the archive is truncated to it
+	string state_file_name = params.db_file_name + ".resume";
+	string state_signature = resume_signature(header, v_samples.size());
+	CState resume_state;
+	uint64_t no_resumed_variants = 0;
+	bool resume = false;
+
+	if (params.resume)
+	{
+		string signature;
+
+		if (!resume_state.Load(state_file_name))
+			cerr << "No state of compression in " << state_file_name << " - compression starts from the beginning\n";
+		else if (!resume_state.Read(signature) || signature != state_signature || !resume_state.Read(no_resumed_variants))
+		{
+			cerr << "State of compression in " << state_file_name << " does not match the input file and options\n";
+			return false;
+		}
+		else if (vcf->SkipVariants(no_resumed_variants) != no_resumed_variants)
+		{
+			cerr << "Input file is shorter than the compressed part of the archive\n";
+			return false;
+		}
+		else
+		{
+			cout << "Resuming after " << no_resumed_variants << " variants\n";
+			resume = true;
+		}
+	}
+
+	if (!cfile->OpenForWriting(params.db_file_name, no_flt_keys + no_info_keys + no_fmt_keys, resume ? &resume_state : nullptr))
 		return false;
 
+	name_stats_items(vcf.get());
+
 	// Thread reading VCF files in parts
 	unique_ptr<thread> t_io(new thread([&] {
+		TRACE_THREAD_NAME("vcf_reader");
+
 		while (!end_of_processing)
 		{
+			TRACE_BUSY("vcf_read_batch", "io");
 			vector<pair<int, int>> data_to_remove, size_to_remove;
+			double t_cpu = stats ? CStats::ThreadTime() : 0;
 
 			v_vcf_data_io.clear();
 			for (size_t i = 0; i < no_variants_in_buf; ++i)
@@ -158,6 +325,9 @@ bool CApplication::CompressDB()
 
 			}
 
+			if (stats)
+				stats->AddStage(stats_stage_t::parse, CStats::ThreadTime() - t_cpu);
+
 			barrier.count_down_and_wait();
 			barrier.count_down_and_wait();
         }
@@ -165,8 +335,13 @@ bool CApplication::CompressDB()
 
 	// Thread making PBWT and compressing data
 	unique_ptr<thread> t_vcf(new thread([&] {
+		TRACE_THREAD_NAME("cfile_writer");
+
 		while (!end_of_processing)
 		{
+			TRACE_BUSY("cfile_set_batch", "buffer");
+			double t_cpu = stats ? CStats::ThreadTime() : 0;
+
 			for (size_t i = 0; i < v_vcf_data_compress.size(); ++i)
             {
 				i_variant++;
@@ -183,16 +358,36 @@ bool CApplication::CompressDB()
                     }
                 }
             }
+
+			if (stats)
+				stats->AddStage(stats_stage_t::buffer, CStats::ThreadTime() - t_cpu);
+
             barrier.count_down_and_wait();
 			barrier.count_down_and_wait();
 		}
 	}));
 
 	// Synchronization
-	size_t no_variants = 0;
+	size_t no_variants = no_resumed_variants;
+	size_t no_checkpoint_variants = no_variants;
+	int64_t batch_compress_memory = 0;
 	while (!end_of_processing)
 	{
 		barrier.count_down_and_wait();
+
+		// Both threads wait here, so all counted variants are already passed to cfile
+		if (params.checkpoint_interval && no_variants >= no_checkpoint_variants + params.checkpoint_interval)
+		{
+			save_checkpoint(cfile.get(), state_file_name, state_signature, no_variants);
+			no_checkpoint_variants = no_variants;
+		}
+
+		if (mem_governor)
+		{
+			int64_t batch_io_memory = batch_memory(v_vcf_data_io);
+			mem_governor->Set(mem_component_t::batches, batch_io_memory + batch_compress_memory);
+			batch_compress_memory = batch_io_memory;
+		}
 		swap(v_vcf_data_compress, v_vcf_data_io);
 		if (v_vcf_data_compress.empty())
 			end_of_processing = true;
@@ -208,32 +403,105 @@ bool CApplication::CompressDB()
 
 	cfile->Close();
 
+	// The archive is complete, so the state is not needed (an interruption during optimisation means starting from the beginning)
+	remove(state_file_name.c_str());
+
 	vcf->Close();
 	cout << endl;
 
+	cfile->SetHotFile(params.hot_file);
 	cfile->OptimizeDB(function_size_graph, function_data_graph);
 
 	cout << endl;
 
+	save_stats(no_variants - no_resumed_variants, (uint32_t) v_samples.size(), duration<double>(high_resolution_clock::now() - t_start).count());
+	report_mem_governor();
+
 	return true;
 }
 
+// ******************************************************************************
+// Input file and options that have to be the same when compression is resumed
+// The size and modification time detect an input replaced under the same name (not available for a stream),
+// the hash of the header - a different input of a stream
+string CApplication::resume_signature(const string& header, size_t no_samples)
+{
+	string file_id;
+	struct stat st;
+
+	if (stat(params.vcf_file_name.c_str(), &st) == 0)
+		file_id = to_string((uint64_t) st.st_size) + "\t" + to_string((int64_t) st.st_mtime);
+
+	return params.vcf_file_name + "\t" + file_id + "\t" + to_string(hash<string>()(header)) + "\t" + to_string(keys.size()) + "\t" + to_string(no_samples) + "\t" + to_string(params.neglect_limit) + "\t" +
+		(params.gvcf ? "gvcf" : "") + "\t" + params.lossy_profile + "\t" + (params.sample_order ? "pbwt-format-order" : "") + "\t" +
+		to_string(params.row_group_size);
+}
+
+// ******************************************************************************
+bool CApplication::save_checkpoint(CCompressedFile* cfile, const string& state_file_name, const string& signature, uint64_t no_variants)
+{
+	CState state;
+
+	state.Write(signature);
+	state.Write(no_variants);
+
+	if (!cfile->Checkpoint(state) || !state.Save(state_file_name))
+	{
+		cerr << "Cannot save state of compression to " << state_file_name << endl;
+		return false;
+	}
+
+	return true;
+}
+
+// ******************************************************************************
+// Output file of a contig (--split-by-chrom): prefix + contig name (with characters unsafe in file names replaced);
+// contigs mapped to a name already used get a numeric suffix, so no file is overwritten
+string CApplication::chrom_file_name(const string& chrom, set<string>& s_file_names)
+{
+	string name = chrom;
+
+	for (auto& c : name)
+		if (!isalnum((unsigned char) c) && c != '.' && c != '_' && c != '-')
+			c = '_';
+
+	// Indexed VCF files must be BGZF-compressed
+	string ext = params.out_type == file_type::BCF ? ".bcf" : (params.build_index ? ".vcf.gz" : ".vcf");
+	string file_name = params.vcf_file_name + name + ext;
+
+	for (uint32_t i = 2; s_file_names.count(file_name); ++i)
+		file_name = params.vcf_file_name + name + "_" + to_string(i) + ext;
+
+	s_file_names.insert(file_name);
+
+	return file_name;
+}
+
 // ******************************************************************************
 bool CApplication::DecompressDB()
 {
+	auto t_start = high_resolution_clock::now();
+
 	CBarrier barrier(3);
 	unique_ptr<CVCF> vcf(new CVCF());
 	unique_ptr<CCompressedFile> cfile(new CCompressedFile());
 	bool end_of_processing = false;
 
-	if (!vcf->OpenForWriting(params.vcf_file_name, params.out_type, params.bcf_compression_level))
+	// When splitting by contig, vcf is used only as a source of the header and the output file name is a prefix
+	if (!params.split_by_chrom && !vcf->OpenForWriting(params.vcf_file_name, params.out_type, params.bcf_compression_level))
 	{
 		cerr << "Cannot open: " << params.vcf_file_name << endl;
 		return false;
 	}
 
+	if (params.no_threads > 1 && !params.split_by_chrom)
+		vcf->SetNoCompressionThreads(params.no_threads / 2 ? params.no_threads / 2 : 1);
+
 	cfile->SetNoThreads(params.no_threads);
 
+	init_stats("decompress", params.db_file_name, params.vcf_file_name, cfile.get());
+	init_mem_governor(cfile.get());
+
 	if (!cfile->OpenForReading(params.db_file_name))
 		return false;
 
@@ -248,15 +516,102 @@ bool CApplication::DecompressDB()
 	cfile->GetHeader(header);
 	cfile->GetSamples(v_samples);
     cfile->GetKeys(keys);
+
+	if (!cfile->GetLossyProfile().empty())
+	{
+		cout << "Lossy archive, quantisation profile: " << cfile->GetLossyProfile() << endl;
+		header += "##VCFSharkQuantisation=\"" + cfile->GetLossyProfile() + "\"\n";
+	}
+
 	vcf->SetHeader(header);
 	vcf->AddSamples(v_samples);
-	vcf->WriteHeader();
+	if (!params.split_by_chrom)
+	{
+		vcf->WriteHeader();
+		if (params.build_index && !vcf->EnableIndexing())
+		{
+			cerr << "Cannot build index of " << params.vcf_file_name << " (BGZF-compressed output is required)" << endl;
+			return false;
+		}
+	}
 	vcf->SetPloidy(cfile->GetPloidy());
 
+	name_stats_items(vcf.get());
+
+	// Writer of the current contig (--split-by-chrom) is opened when the first record of the contig appears and closed
+	// when the contig changes (records of a contig are contiguous in sorted archives)
+	// Errors of the writing thread stop the processing after the current batch (nullptr if a writer cannot be opened)
+	unique_ptr<CVCF> chrom_writer;
+	string writer_chrom;
+	set<string> s_chroms;
+	set<string> s_file_names;
+	bool write_failed = false;
+
+	auto get_writer = [&](const string& chrom) -> CVCF* {
+		if (!params.split_by_chrom)
+			return vcf.get();
+
+		if (chrom_writer && chrom == writer_chrom)
+			return chrom_writer.get();
+
+		if (chrom_writer && !chrom_writer->Close())
+			return nullptr;
+		chrom_writer.reset();
+
+		if (!s_chroms.insert(chrom).second)
+		{
+			cerr << "Records of contig " << chrom << " are not contiguous (--split-by-chrom requires a sorted archive)" << endl;
+			return nullptr;
+		}
+
+		string file_name = chrom_file_name(chrom, s_file_names);
+		unique_ptr<CVCF> writer(new CVCF());
+
+		if (!writer->OpenForWriting(file_name, params.out_type, params.bcf_compression_level))
+		{
+			cerr << "Cannot open: " << file_name << endl;
+			return nullptr;
+		}
+
+		// Each contig file has its own BGZF compression thread
+		writer->SetNoCompressionThreads(1);
+
+		writer->SetHeader(header);
+		writer->AddSamples(v_samples);
+		writer->WriteHeader();
+		writer->SetPloidy(cfile->GetPloidy());
+
+		if (params.build_index && !writer->EnableIndexing())
+		{
+			cerr << "Cannot build index of " << file_name << " (BGZF-compressed output is required)" << endl;
+			writer->Close();
+			return nullptr;
+		}
+
+		chrom_writer = move(writer);
+		writer_chrom = chrom;
+
+		return chrom_writer.get();
+	};
+
+	// Formatting of records costs more than decoding for wide cohorts, so each batch is split into contiguous ranges
+	// formatted by several threads and written in order.
+	// The index is updated by htslib when records are written, so for indexed output VCF text is rendered by the writer
+	bool text_output = params.out_type == file_type::VCF && !params.build_index;
+
+	vector<unique_ptr<CVCFFormatter>> v_formatters;
+	for (uint32_t i = 0; i < max(params.no_threads, 1u); ++i)
+		v_formatters.emplace_back(new CVCFFormatter(vcf->vcf_hdr, text_output));
+
 	// Thread making rev-PBWT and decompressing data
 	unique_ptr<thread> t_vcf(new thread([&] {
+		TRACE_THREAD_NAME("cfile_reader");
+
 		while (!end_of_processing)
 		{
+			TRACE_BUSY("cfile_get_batch", "buffer");
+			double t_cpu = stats ? CStats::ThreadTime() : 0;
+
 			v_vcf_data_compress.clear();
 
 			for (size_t i = 0; i < no_variants_in_buf && i_variant < no_variants; ++i, ++i_variant)
@@ -264,6 +619,9 @@ bool CApplication::DecompressDB()
 				v_vcf_data_compress.push_back(make_pair(variant_desc_t(), vector<field_desc>(keys.size())));
 				cfile->GetVariant(v_vcf_data_compress.back().first, v_vcf_data_compress.back().second);
 			}
+
+			if (stats)
+				stats->AddStage(stats_stage_t::buffer, CStats::ThreadTime() - t_cpu);
 			
 			barrier.count_down_and_wait();
 			barrier.count_down_and_wait();
@@ -272,33 +630,102 @@ bool CApplication::DecompressDB()
 
 	// Thread writing VCF files in parts
 	unique_ptr<thread> t_io(new thread([&] {
+		TRACE_THREAD_NAME("vcf_writer");
+
 		while (!end_of_processing)
 		{
-			for (size_t i = 0; i < v_vcf_data_io.size(); ++i)
-            {
-                vcf->SetVariant(v_vcf_data_io[i].first, v_vcf_data_io[i].second, keys);
-                
-                for(size_t j = 0; j< keys.size(); ++j)
-                    if(v_vcf_data_io[i].second[j].data_size)
-                    {
-                        delete[] v_vcf_data_io[i].second[j].data;
-                        v_vcf_data_io[i].second[j].data = nullptr;
-                        v_vcf_data_io[i].second[j].data_size = 0;
-                    }
-            }
+			TRACE_BUSY("vcf_write_batch", "io");
+			double t_cpu = stats ? CStats::ThreadTime() : 0;
+
+			// Contiguous ranges of records (within a single contig when splitting by contig)
+			size_t no_records = v_vcf_data_io.size();
+			size_t max_range_size = max(min_records_per_formatter, (no_records + v_formatters.size() - 1) / v_formatters.size());
+			vector<pair<size_t, size_t>> v_ranges;
+
+			for (size_t i = 0; i < no_records;)
+			{
+				size_t j = min(no_records, i + max_range_size);
+
+				if (params.split_by_chrom)
+					for (size_t k = i + 1; k < j; ++k)
+						if (v_vcf_data_io[k].first.chrom != v_vcf_data_io[i].first.chrom)
+						{
+							j = k;
+							break;
+						}
+
+				v_ranges.emplace_back(i, j);
+				i = j;
+			}
+
+			for (size_t r = 0; r < v_ranges.size() && !write_failed; r += v_formatters.size())
+			{
+				size_t no_parts = min(v_formatters.size(), v_ranges.size() - r);
+
+				vector<thread> v_format_threads;
+				vector<uint8_t> v_format_ok(no_parts, 1);
+
+				for (size_t i = 1; i < no_parts; ++i)
+					v_format_threads.emplace_back([&, i] {
+						TRACE_THREAD_NAME("vcf_formatter");
+						TRACE_BUSY("vcf_format_range", "io");
+						double t_format = stats ? CStats::ThreadTime() : 0;
+
+						v_format_ok[i] = v_formatters[i]->Format(v_vcf_data_io, v_ranges[r + i].first, v_ranges[r + i].second, keys);
+
+						if (stats)
+							stats->AddStage(stats_stage_t::vcf_output, CStats::ThreadTime() - t_format);
+					});
+
+				v_format_ok[0] = v_formatters[0]->Format(v_vcf_data_io, v_ranges[r].first, v_ranges[r].second, keys);
+
+				for (auto& t : v_format_threads)
+					t.join();
+
+				for (size_t i = 0; i < no_parts && !write_failed; ++i)
+				{
+					if (!v_format_ok[i])
+					{
+						cerr << "Cannot format records " << v_ranges[r + i].first << "-" << v_ranges[r + i].second << " of a batch" << endl;
+						write_failed = true;
+						break;
+					}
+
+					CVCF* writer = get_writer(v_vcf_data_io[v_ranges[r + i].first].first.chrom);
+
+					if (!writer)
+						write_failed = true;
+					else if (!writer->WriteFormatted(*v_formatters[i]))
+					{
+						cerr << "Error writing " << params.vcf_file_name << endl;
+						write_failed = true;
+					}
+				}
+			}
+
             v_vcf_data_io.clear();
 
+			if (stats)
+				stats->AddStage(stats_stage_t::vcf_output, CStats::ThreadTime() - t_cpu);
+
 			barrier.count_down_and_wait();
 			barrier.count_down_and_wait();
 		}
 	}));
 
 	// Synchronization
+	int64_t batch_io_memory = 0;
 	while (!end_of_processing)
 	{
 		barrier.count_down_and_wait();
+		if (mem_governor)
+		{
+			int64_t batch_compress_memory = batch_memory(v_vcf_data_compress);
+			mem_governor->Set(mem_component_t::batches, batch_compress_memory + batch_io_memory);
+			batch_io_memory = batch_compress_memory;
+		}
 		swap(v_vcf_data_compress, v_vcf_data_io);
-		if (v_vcf_data_io.empty())
+		if (v_vcf_data_io.empty() || write_failed)
 			end_of_processing = true;
 
 		cout << i_variant << "\r";
@@ -310,10 +737,128 @@ bool CApplication::DecompressDB()
 	t_io->join();
 
 	cfile->Close();
-	vcf->Close();
+
+	// Closing saves the index of a compressed output, so it can fail too
+	if (!vcf->Close())
+	{
+		cerr << "Cannot close output file " << params.vcf_file_name << endl;
+		write_failed = true;
+	}
+	if (chrom_writer && !chrom_writer->Close())
+	{
+		cerr << "Cannot close output file of contig " << writer_chrom << endl;
+		write_failed = true;
+	}
 	cout << endl;
 
+	if (write_failed)
+		return false;
+
+	if (params.split_by_chrom)
+		cout << "Contig files: " << s_file_names.size() << endl;
+
+	save_stats(no_variants, (uint32_t) v_samples.size(), duration<double>(high_resolution_clock::now() - t_start).count());
+	report_mem_governor();
+
 	return true;
 }
 
+// ******************************************************************************
+// Signatures of all parts are checked in parallel; with --decode all variants are also decoded (without formatting)
+bool CApplication::VerifyDB()
+{
+	const size_t max_reported_errors = 20;
+
+	CArchive archive(true);
+	CArchive::verify_result_t result;
+
+	if (!archive.Open(params.db_file_name))
+	{
+		cerr << "Cannot open: " << params.db_file_name << endl;
+		return false;
+	}
+
+	vector<uint64_t> v_row_groups;
+
+	bool ok = archive.Verify(params.no_threads, result);
+	archive.GetRowGroups(v_row_groups);
+	archive.Close();
+
+	cout << "Streams: " << result.no_streams << ", parts: " << result.no_parts << " (" << result.no_bytes << " bytes)\n";
+	if (!v_row_groups.empty())
+	{
+		cout << "Row groups: " << v_row_groups.size() << endl;
+
+		auto p_empty = find(v_row_groups.begin(), v_row_groups.end(), 0);
+		if (p_empty != v_row_groups.end())
+		{
+			cerr << "Row group " << p_empty - v_row_groups.begin() << " is empty\n";
+			ok = false;
+		}
+	}
+	if (!result.signatures)
+		cout << "Archive does not store signatures of parts (older version or recovered archive); only the layout of parts was checked\n";
+
+	for (size_t i = 0; i < result.errors.size() && i < max_reported_errors; ++i)
+		cerr << result.errors[i] << endl;
+	if (result.errors.size() > max_reported_errors)
+		cerr << "... " << result.errors.size() - max_reported_errors << " more errors\n";
+
+	if (ok && params.verify_decode)
+	{
+		unique_ptr<CCompressedFile> cfile(new CCompressedFile());
+
+		cfile->SetNoThreads(params.no_threads);
+
+		if (!cfile->OpenForReading(params.db_file_name))
+			return false;
+
+		uint32_t no_variants = cfile->GetNoVariants();
+		variant_desc_t desc;
+
+		cfile->GetKeys(keys);
+
+		for (uint32_t i = 0; i < no_variants; ++i)
+		{
+			vector<field_desc> fields(keys.size());
+
+			if (!cfile->GetVariant(desc, fields))
+			{
+				cerr << "Cannot decode variant " << i << endl;
+				ok = false;
+				break;
+			}
+
+			for (auto& field : fields)
+				if (field.data_size)
+				{
+					delete[] field.data;
+					field.data = nullptr;
+					field.data_size = 0;
+				}
+
+			if ((i & 0xffff) == 0)
+			{
+				cout << i << "\r";
+				fflush(stdout);
+			}
+		}
+
+		cfile->Close();
+
+		if (ok && !v_row_groups.empty() && accumulate(v_row_groups.begin(), v_row_groups.end(), (uint64_t) 0) != no_variants)
+		{
+			cerr << "Row groups do not cover all variants\n";
+			ok = false;
+		}
+
+		if (ok)
+			cout << "Decoded variants: " << no_variants << endl;
+	}
+
+	cout << (ok ? "Archive is correct" : "Archive is corrupted") << endl;
+
+	return ok;
+}
+
 // EOF
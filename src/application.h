@@ -14,12 +14,14 @@
 #include <vector>
 #include <list>
 #include <deque>
+#include <set>
 #include <memory>
 
 #include "params.h"
 #include "vcf.h"
 #include "cfile.h"
-#include "vcf.h"
+#include "stats.h"
+#include "mem_governor.h"
 
 using namespace std;
 
@@ -27,6 +29,7 @@ using namespace std;
 class CApplication
 {
 	const size_t no_variants_in_buf = 8192u;
+	const size_t min_records_per_formatter = 256u;
 	const size_t max_size_of_function = 16384u;
 
 	typedef pair<uint8_t, uint32_t> run_desc_t;
@@ -52,12 +55,29 @@ class CApplication
 
     vector<key_desc> keys;
 
+	unique_ptr<CStats> stats;
+	unique_ptr<CMemoryGovernor> mem_governor;
+
+	void init_stats(const string& mode, const string& input_file_name, const string& output_file_name, CCompressedFile* cfile);
+	void name_stats_items(CVCF* vcf);
+	void save_stats(uint64_t no_variants, uint32_t no_samples, double total_time);
+
+	void init_mem_governor(CCompressedFile* cfile);
+	int64_t batch_memory(const vector<pair<variant_desc_t, vector<field_desc>>>& v_batch);
+	void report_mem_governor();
+
+	string chrom_file_name(const string& chrom, set<string>& s_file_names);
+
+	string resume_signature(const string& header, size_t no_samples);
+	bool save_checkpoint(CCompressedFile* cfile, const string& state_file_name, const string& signature, uint64_t no_variants);
+
 public:
 	CApplication(const CParams &_params);
 	~CApplication();
 
 	bool CompressDB();
 	bool DecompressDB();
+	bool VerifyDB();
 };
 
 // EOF
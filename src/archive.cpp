@@ -8,26 +8,60 @@
 // *******************************************************************************************
 
 #include "archive.h"
+#include "trace.h"
 
 #include <iostream>
 #include <cstdio>
 #include <utility>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
 
 #ifndef _WIN32
+#include <unistd.h>
 #define my_fseek	fseek
 #define my_ftell	ftell
+#define my_ftruncate(file, size)	ftruncate(fileno(file), size)
 #else
+#include <io.h>
 #define my_fseek	_fseeki64
 #define my_ftell	_ftelli64
+#define my_ftruncate(file, size)	_chsize_s(_fileno(file), size)
 #endif
 
 using namespace std;
+using namespace std::chrono;
+
+thread_local double CArchive::thread_io_time = 0;
 
 // ******************************************************************************
 CArchive::CArchive(bool _input_mode)
 {
 	f = nullptr;
+	f_hot = nullptr;
+	use_hot_file = false;
 	input_mode = _input_mode;
+	io_time = 0;
+
+	has_signatures = false;
+	v_row_groups.clear();
+	footer_offset = 0;
+
+	append_only = false;
+	sequential = false;
+	scan_eof = true;
+	complete = true;
+	scan_offset = 0;
+	file_size = 0;
+	checkpoint_offset = 0;
+	checkpoint_interval = 4 << 20;
+}
+
+// ******************************************************************************
+void CArchive::add_io_time(double time)
+{
+	io_time += time;
+	thread_io_time += time;
 }
 
 // ******************************************************************************
@@ -38,27 +72,196 @@ CArchive::~CArchive()
 }
 
 // ******************************************************************************
-bool CArchive::Open(string _file_name)
+bool CArchive::Open(string _file_name, bool _use_hot_file, bool _append_only)
 {
 	lock_guard<mutex> lck(mtx);
 
-	if (f)
+	if (f && f != stdin)
 		fclose(f);
+	if (f_hot)
+		fclose(f_hot);
+	f_hot = nullptr;
 
 	m_streams.clear();
+	v_pending.clear();
+	m_buffered.clear();
 	file_name = _file_name;
+	use_hot_file = _use_hot_file;
+	append_only = _append_only && !input_mode;
+	sequential = input_mode && file_name == "-";
+	scan_eof = true;
+	complete = true;
+	has_signatures = false;
+	v_row_groups.clear();
+
+	if (append_only && use_hot_file)
+	{
+		cerr << "Append-only archives cannot use the companion file\n";
+		return false;
+	}
 
-	f = fopen(file_name.c_str(), input_mode ? "rb" : "wb");
+	if (sequential)
+		f = stdin;
+	else
+		f = fopen(file_name.c_str(), input_mode ? "rb" : "wb");
+
+	if (!f)
+		return false;
 
 	setvbuf(f, nullptr, _IOFBF, 64 << 20);
 
+	auto t1 = high_resolution_clock::now();
+
+	bool ok = true;
+
+	f_offset = 0;
+	f_hot_offset = 0;
+
+	if (input_mode)
+	{
+		if (read_magic())
+		{
+			append_only = true;
+
+			if (!sequential && check_complete())
+				deserialize();
+			else
+			{
+				// Records are scanned from the beginning: at once for a file, on demand for a pipe
+				complete = false;
+				scan_eof = false;
+				footer_offset = file_size;
+
+				if (!sequential)
+				{
+					my_fseek(f, scan_offset, SEEK_SET);
+					while (scan_checkpoint())
+						;
+					my_fseek(f, 0, SEEK_SET);
+				}
+			}
+		}
+		else if (sequential)
+		{
+			cerr << "Only append-only archives can be read from a pipe\n";
+			ok = false;
+		}
+		else
+			deserialize();
+	}
+	else if (append_only)
+	{
+		f_offset += write(append_only_magic, f);
+		f_offset += write(append_only_version, f);
+		checkpoint_offset = f_offset;
+	}
+
+	ok = ok && (!use_hot_file || open_hot_file());
+
+	add_io_time(duration<double>(high_resolution_clock::now() - t1).count());
+
+	return ok;
+}
+
+// ******************************************************************************
+bool CArchive::Reopen(string _file_name, size_t _checkpoint_offset)
+{
+	lock_guard<mutex> lck(mtx);
+
+	if (input_mode)
+		return false;
+
+	if (f)
+		fclose(f);
+	if (f_hot)
+		fclose(f_hot);
+	f_hot = nullptr;
+
+	m_streams.clear();
+	v_pending.clear();
+	m_buffered.clear();
+	file_name = _file_name;
+	use_hot_file = false;
+	append_only = true;
+	sequential = false;
+	scan_eof = false;
+	complete = false;
+
+	f = fopen(file_name.c_str(), "r+b");
+
 	if (!f)
 		return false;
 
-	if (input_mode)
-		deserialize();
+	setvbuf(f, nullptr, _IOFBF, 64 << 20);
 
-	f_offset = 0;
+	auto t1 = high_resolution_clock::now();
+
+	if (!read_magic())
+	{
+		cerr << file_name << " is not an append-only archive\n";
+		fclose(f);
+		f = nullptr;
+		return false;
+	}
+
+	my_fseek(f, 0, SEEK_END);
+	file_size = (size_t) my_ftell(f);
+	my_fseek(f, scan_offset, SEEK_SET);
+
+	// Records up to the checkpoint are applied as in the recovery
+	bool checkpoint = false;
+
+	while (scan_offset < _checkpoint_offset && scan_record(checkpoint))
+		;
+
+	v_pending.clear();
+	scan_eof = true;
+	complete = true;
+
+	bool ok = checkpoint && scan_offset == _checkpoint_offset;
+
+	for (auto& stream : m_streams)
+	{
+		for (auto& part : stream.second.parts)
+			ok &= part.offset != missing_offset;
+
+		stream.second.signatures.resize(stream.second.parts.size(), 0);
+	}
+
+	if (!ok)
+	{
+		cerr << "Checkpoint not found in " << file_name << endl;
+		fclose(f);
+		f = nullptr;
+		return false;
+	}
+
+	fflush(f);
+	ok = my_ftruncate(f, _checkpoint_offset) == 0;
+	my_fseek(f, _checkpoint_offset, SEEK_SET);
+
+	f_offset = _checkpoint_offset;
+	f_hot_offset = 0;
+	checkpoint_offset = _checkpoint_offset;
+
+	add_io_time(duration<double>(high_resolution_clock::now() - t1).count());
+
+	return ok;
+}
+
+// ******************************************************************************
+bool CArchive::open_hot_file()
+{
+	f_hot = fopen(HotFileName(file_name).c_str(), input_mode ? "rb" : "wb");
+
+	if (!f_hot)
+	{
+		cerr << "Cannot open " << HotFileName(file_name) << endl;
+		return false;
+	}
+
+	// Hot streams are small, so a smaller buffer is enough
+	setvbuf(f_hot, nullptr, _IOFBF, 8 << 20);
 
 	return true;
 }
@@ -71,16 +274,30 @@ bool CArchive::Close()
 	if (!f)
 		return false;
 
+	TRACE_BUSY("archive_close", "archive");
+
 	if (input_mode)
 	{
-		fclose(f);
+		if (f != stdin)
+			fclose(f);
 		f = nullptr;
+		m_buffered.clear();
 	}
 	else
 	{
+		auto t1 = high_resolution_clock::now();
+
 		serialize();
 		fclose(f);
 		f = nullptr;
+
+		add_io_time(duration<double>(high_resolution_clock::now() - t1).count());
+	}
+
+	if (f_hot)
+	{
+		fclose(f_hot);
+		f_hot = nullptr;
 	}
 
 	return true;
@@ -166,6 +383,10 @@ bool CArchive::serialize()
 {
 	size_t footer_size = 0;
 
+	// In the append-only variant the footer is preceded by a record that makes it distinguishable from a truncated file
+	if (append_only)
+		write_checkpoint(tag_footer);
+
 	// Store stream part offsets
 	footer_size += write(m_streams.size(), f);
 
@@ -185,9 +406,44 @@ bool CArchive::serialize()
 			str_size += part.size;
 		}
 
-//#ifdef LOG_INFO
+#ifdef LOG_INFO
 		cerr << stream.first << ": " << stream.second.stream_name << "  raw size: " << stream.second.raw_size << "   packed size: " << str_size << endl;
-//#endif
+#else
+		(void) str_size;
+#endif
+	}
+
+	// Extension (only with the companion file, so the footer of other archives is unchanged): ids of hot streams
+	if (use_hot_file)
+	{
+		size_t no_hot = 0;
+		for (auto& stream : m_streams)
+			if (stream.second.hot)
+				++no_hot;
+
+		footer_size += write(hot_file_marker, f);
+		footer_size += write(no_hot, f);
+
+		for (auto& stream : m_streams)
+			if (stream.second.hot)
+				footer_size += write((size_t) stream.first, f);
+	}
+
+	// Extension: signatures of parts (ignored by older versions, as it follows the hot streams)
+	footer_size += write(signatures_marker, f);
+
+	for (auto& stream : m_streams)
+		for (auto x : stream.second.signatures)
+			footer_size += write_fixed((size_t) x, f);
+
+	// Extension (only in archives with row groups)
+	if (!v_row_groups.empty())
+	{
+		footer_size += write(row_groups_marker, f);
+		footer_size += write(v_row_groups.size(), f);
+
+		for (auto x : v_row_groups)
+			footer_size += write((size_t) x, f);
 	}
 
 	write_fixed(footer_size, f);
@@ -204,28 +460,87 @@ bool CArchive::deserialize()
 	read_fixed(footer_size, f);
 
 	my_fseek(f, -(long)(8 + footer_size), SEEK_END);
+	footer_offset = (size_t) my_ftell(f);
+
+	size_t footer_read = 0;
 
 	// Load stream part offsets
 	size_t n_streams;
-	read(n_streams, f);
+	footer_read += read(n_streams, f);
 
 	for (size_t i = 0; i < n_streams; ++i)
 	{
 		m_streams[(int) i] = stream_t();
 		auto& stream_second = m_streams[(int) i];
 
-		read(stream_second.stream_name, f);
-		read(stream_second.cur_id, f);
-		read(stream_second.raw_size, f);
+		footer_read += read(stream_second.stream_name, f);
+		footer_read += read(stream_second.cur_id, f);
+		footer_read += read(stream_second.raw_size, f);
 
 		stream_second.parts.resize(stream_second.cur_id);
 		for (size_t j = 0; j < stream_second.cur_id; ++j)
 		{
-			read(stream_second.parts[j].offset, f);
-			read(stream_second.parts[j].size, f);
+			footer_read += read(stream_second.parts[j].offset, f);
+			footer_read += read(stream_second.parts[j].size, f);
 		}
 
 		stream_second.cur_id = 0;
+		stream_second.hot = false;
+	}
+
+	// Optional extensions: hot streams stored in the companion file, signatures of parts, row groups
+	while (footer_read < footer_size)
+	{
+		string marker;
+		size_t marker_size = read(marker, f);
+
+		if (!marker_size)
+			break;
+		footer_read += marker_size;
+
+		if (marker == hot_file_marker)
+		{
+			size_t no_hot, id;
+
+			use_hot_file = true;
+			footer_read += read(no_hot, f);
+			for (size_t i = 0; i < no_hot; ++i)
+			{
+				footer_read += read(id, f);
+				if (m_streams.count((int) id))
+					m_streams[(int) id].hot = true;
+			}
+		}
+		else if (marker == signatures_marker)
+		{
+			size_t x;
+
+			for (auto& stream : m_streams)
+			{
+				stream.second.signatures.resize(stream.second.parts.size());
+				for (auto& sig : stream.second.signatures)
+				{
+					footer_read += read_fixed(x, f);
+					sig = x;
+				}
+			}
+
+			has_signatures = true;
+		}
+		else if (marker == row_groups_marker)
+		{
+			size_t no_groups, x;
+
+			footer_read += read(no_groups, f);
+			v_row_groups.resize(no_groups);
+			for (auto& group : v_row_groups)
+			{
+				footer_read += read(x, f);
+				group = x;
+			}
+		}
+		else
+			break;
 	}
 	
 	my_fseek(f, 0, SEEK_SET);
@@ -234,7 +549,334 @@ bool CArchive::deserialize()
 }
 
 // ******************************************************************************
-int CArchive::RegisterStream(string stream_name)
+size_t CArchive::write_tag(uint8_t tag)
+{
+	putc(tag, f);
+
+	return 1;
+}
+
+// ******************************************************************************
+// Checkpoint (or footer) record: tag and its own position (so it cannot be confused with a torn write)
+void CArchive::write_checkpoint(uint8_t tag)
+{
+	size_t rec_pos = f_offset;
+
+	f_offset += write_tag(tag);
+	f_offset += write_fixed(rec_pos ^ record_check, f);
+
+	checkpoint_offset = f_offset;
+
+	if (tag == tag_checkpoint)
+		fflush(f);
+}
+
+// ******************************************************************************
+bool CArchive::Checkpoint()
+{
+	lock_guard<mutex> lck(mtx);
+
+	if (input_mode || !append_only || !f)
+		return false;
+
+	auto t1 = high_resolution_clock::now();
+
+	write_checkpoint(tag_checkpoint);
+
+	add_io_time(duration<double>(high_resolution_clock::now() - t1).count());
+
+	return true;
+}
+
+// ******************************************************************************
+bool CArchive::read_magic()
+{
+	string magic(append_only_magic.size() + 1, ' ');
+
+	scan_offset = fread(&magic[0], 1, magic.size(), f);
+
+	if (scan_offset != magic.size() || magic != append_only_magic + '\0')
+	{
+		if (!sequential)
+			my_fseek(f, 0, SEEK_SET);
+		return false;
+	}
+
+	size_t version;
+	scan_offset += read(version, f);
+
+	if (version > append_only_version)
+	{
+		cerr << "Unsupported version of the append-only archive\n";
+		return false;
+	}
+
+	return true;
+}
+
+// ******************************************************************************
+// The footer is valid if it is preceded by the footer record pointing to itself
+bool CArchive::check_complete()
+{
+	size_t footer_size, check;
+
+	my_fseek(f, 0, SEEK_END);
+	file_size = (size_t) my_ftell(f);
+
+	if (file_size < scan_offset + 17)
+		return false;
+
+	my_fseek(f, -8, SEEK_END);
+	read_fixed(footer_size, f);
+
+	if (footer_size > file_size - scan_offset - 17)
+		return false;
+
+	size_t rec_pos = file_size - 8 - footer_size - 9;
+
+	my_fseek(f, rec_pos, SEEK_SET);
+	int tag = getc(f);
+	read_fixed(check, f);
+
+	return tag == tag_footer && check == (rec_pos ^ record_check);
+}
+
+// ******************************************************************************
+// Read a single record; false at the end of file, for a truncated or invalid record and after the footer record
+bool CArchive::scan_record(bool& checkpoint)
+{
+	size_t rec_pos = scan_offset;
+	record_t rec;
+	size_t x;
+
+	checkpoint = false;
+
+	int tag = getc(f);
+	if (tag == EOF)
+		return false;
+
+	++scan_offset;
+	rec.tag = (uint8_t) tag;
+
+	if (rec.tag == tag_stream)
+	{
+		scan_offset += read(x, f);
+		rec.stream_id = (int) x;
+		scan_offset += read(rec.name, f);
+	}
+	else if (rec.tag == tag_part)
+	{
+		size_t size, metadata;
+
+		scan_offset += read(x, f);
+		rec.stream_id = (int) x;
+		scan_offset += read(rec.part_id, f);
+		scan_offset += read(size, f);
+
+		rec.part = part_t(scan_offset, size);
+		scan_offset += read(metadata, f);
+
+		if (feof(f))
+			return false;
+
+		if (sequential)
+		{
+			auto& bp = m_buffered[rec.part.offset];
+			bp.metadata = metadata;
+			bp.no_readers = 0;
+			bp.data.resize(size);
+
+			if (size && fread(bp.data.data(), 1, size, f) != size)
+				return false;
+		}
+		else if (scan_offset + size > file_size)
+			return false;
+
+		scan_offset += size;
+
+		if (!sequential)
+			my_fseek(f, scan_offset, SEEK_SET);
+	}
+	else if (rec.tag == tag_raw_size)
+	{
+		scan_offset += read(x, f);
+		rec.stream_id = (int) x;
+		scan_offset += read(rec.value, f);
+	}
+	else if (rec.tag == tag_link)
+	{
+		scan_offset += read(x, f);
+		rec.stream_id = (int) x;
+		scan_offset += read(rec.name, f);
+		scan_offset += read(x, f);
+		rec.target_id = (int) x;
+	}
+	else if (rec.tag == tag_checkpoint || rec.tag == tag_footer)
+	{
+		scan_offset += read_fixed(x, f);
+
+		if (x != (rec_pos ^ record_check))
+			return false;
+
+		apply_pending();
+		checkpoint = true;
+
+		if (rec.tag == tag_footer)
+		{
+			complete = true;
+			return false;
+		}
+
+		return true;
+	}
+	else
+		return false;
+
+	if (feof(f))
+		return false;
+
+	v_pending.emplace_back(rec);
+
+	return true;
+}
+
+// ******************************************************************************
+// Read records up to the next checkpoint; false if nothing new was applied
+bool CArchive::scan_checkpoint()
+{
+	if (scan_eof)
+		return false;
+
+	bool checkpoint = false;
+
+	while (!checkpoint)
+		if (!scan_record(checkpoint))
+		{
+			finish_scan();
+			return checkpoint;
+		}
+
+	return true;
+}
+
+// ******************************************************************************
+void CArchive::apply_pending()
+{
+	for (auto& rec : v_pending)
+	{
+		if (rec.tag == tag_stream)
+		{
+			auto& stream = m_streams[rec.stream_id];
+
+			stream = stream_t();
+			stream.stream_name = rec.name;
+			stream.cur_id = 0;
+			stream.raw_size = 0;
+			stream.hot = false;
+
+			continue;
+		}
+
+		auto p = m_streams.find(rec.stream_id);
+		if (p == m_streams.end())
+			continue;
+
+		auto& stream = p->second;
+
+		if (rec.tag == tag_part)
+		{
+			if (rec.part_id >= stream.parts.size())
+				stream.parts.resize(rec.part_id + 1, part_t(missing_offset, 0));
+			stream.parts[rec.part_id] = rec.part;
+
+			if (sequential)
+				m_buffered[rec.part.offset].no_readers = 1;
+		}
+		else if (rec.tag == tag_raw_size)
+			stream.raw_size = rec.value;
+		else if (rec.tag == tag_link && m_streams.count(rec.target_id))
+		{
+			stream = m_streams[rec.target_id];
+			stream.stream_name = rec.name;
+			stream.cur_id = 0;
+
+			// Parts shared with the target have to be buffered until both streams read them
+			if (sequential)
+				for (auto& part : stream.parts)
+				{
+					auto q = m_buffered.find(part.offset);
+					if (q != m_buffered.end())
+						++q->second.no_readers;
+				}
+		}
+	}
+
+	v_pending.clear();
+}
+
+// ******************************************************************************
+// Records after the last checkpoint are dropped and streams are cut at the first part not written before it
+void CArchive::finish_scan()
+{
+	scan_eof = true;
+	v_pending.clear();
+
+	if (!complete)
+		cerr << "Archive " << file_name << " is incomplete; it is recovered up to the last checkpoint\n";
+
+	for (auto& stream : m_streams)
+	{
+		auto& parts = stream.second.parts;
+
+		for (size_t i = 0; i < parts.size(); ++i)
+			if (parts[i].offset == missing_offset)
+			{
+				parts.resize(i);
+				break;
+			}
+	}
+
+	// Links are known now, so parts read by all streams can be released
+	for (auto p = m_buffered.begin(); p != m_buffered.end(); )
+		if (p->second.no_readers <= 0)
+			p = m_buffered.erase(p);
+		else
+			++p;
+}
+
+// ******************************************************************************
+bool CArchive::part_available(stream_t& stream)
+{
+	return stream.cur_id < stream.parts.size() && stream.parts[stream.cur_id].offset != missing_offset;
+}
+
+// ******************************************************************************
+bool CArchive::get_buffered_part(part_t& part, vector<uint8_t>& v_data, size_t& metadata)
+{
+	auto p = m_buffered.find(part.offset);
+
+	if (p == m_buffered.end())
+	{
+		cerr << "Part of the archive is no longer available in sequential reading\n";
+		return false;
+	}
+
+	metadata = part.size ? p->second.metadata : 0;
+
+	// Until the end of the archive is reached, a link to the stream can still appear
+	if (--p->second.no_readers <= 0 && scan_eof)
+	{
+		v_data = move(p->second.data);
+		m_buffered.erase(p);
+	}
+	else
+		v_data = p->second.data;
+
+	return true;
+}
+
+// ******************************************************************************
+int CArchive::RegisterStream(string stream_name, bool hot)
 {
 	lock_guard<mutex> lck(mtx);
 
@@ -243,6 +885,14 @@ int CArchive::RegisterStream(string stream_name)
 	m_streams[id] = stream_t();
 	m_streams[id].cur_id = 0;
 	m_streams[id].stream_name = stream_name;
+	m_streams[id].hot = hot && use_hot_file;
+
+	if (append_only && !input_mode)
+	{
+		f_offset += write_tag(tag_stream);
+		f_offset += write((size_t) id, f);
+		f_offset += write(stream_name, f);
+	}
 
 	return id;
 }
@@ -252,9 +902,13 @@ int CArchive::GetStreamId(string stream_name)
 {
 	lock_guard<mutex> lck(mtx);
 
-	for (auto& x : m_streams)
-		if (x.second.stream_name == stream_name)
-			return x.first;
+	// In sequential reading the stream can be registered later in the archive
+	do
+	{
+		for (auto& x : m_streams)
+			if (x.second.stream_name == stream_name)
+				return x.first;
+	} while (scan_checkpoint());
 
 	return -1;
 }
@@ -262,17 +916,52 @@ int CArchive::GetStreamId(string stream_name)
 // ******************************************************************************
 bool CArchive::AddPart(int stream_id, vector<uint8_t> &v_data, size_t metadata)
 {
-	lock_guard<mutex> lck(mtx);
+	TRACE_BUSY("archive_write", "archive");
+	unique_lock<mutex> lck(mtx, defer_lock);
+	{
+		TRACE_BLOCKED("archive_lock_wait", "archive");
+		lck.lock();
+	}
+
+	auto& stream = m_streams[stream_id];
+
+	stream.parts.push_back(part_t());
+	stream.signatures.push_back(signature(v_data) ^ metadata);
 
-	m_streams[stream_id].parts.push_back(part_t(f_offset, v_data.size()));
-	m_streams[stream_id].signatures.push_back(signature(v_data) ^ metadata);
+	return write_part(stream_id, stream.parts.size() - 1, v_data, metadata);
+}
+
+// ******************************************************************************
+// Must be called under the lock
+bool CArchive::write_part(int stream_id, size_t part_id, vector<uint8_t>& v_data, size_t metadata)
+{
+	auto& stream = m_streams[stream_id];
+	FILE* file = stream.hot ? f_hot : f;
+	size_t& offset = stream.hot ? f_hot_offset : f_offset;
 
-	f_offset += write(metadata, f);
+	auto t1 = high_resolution_clock::now();
 
-	if(v_data.size())
-		fwrite(v_data.data(), 1, v_data.size(), f);
+	// Parts can be completed out of order, so the header identifies the part
+	if (append_only)
+	{
+		offset += write_tag(tag_part);
+		offset += write((size_t) stream_id, file);
+		offset += write(part_id, file);
+		offset += write(v_data.size(), file);
+	}
 
-	f_offset += v_data.size();
+	stream.parts[part_id] = part_t(offset, v_data.size());
+
+	offset += write(metadata, file);
+	if (v_data.size())
+		fwrite(v_data.data(), 1, v_data.size(), file);
+
+	offset += v_data.size();
+
+	if (append_only && f_offset - checkpoint_offset >= checkpoint_interval)
+		write_checkpoint(tag_checkpoint);
+
+	add_io_time(duration<double>(high_resolution_clock::now() - t1).count());
 
 	return true;
 }
@@ -291,18 +980,18 @@ int CArchive::AddPartPrepare(int stream_id)
 // ******************************************************************************
 bool CArchive::AddPartComplete(int stream_id, int part_id, vector<uint8_t>& v_data, size_t metadata)
 {
-	lock_guard<mutex> lck(mtx);
+	TRACE_BUSY("archive_write", "archive");
+	unique_lock<mutex> lck(mtx, defer_lock);
+	{
+		TRACE_BLOCKED("archive_lock_wait", "archive");
+		lck.lock();
+	}
 	
-	m_streams[stream_id].parts[part_id] = part_t(f_offset, v_data.size());
-	m_streams[stream_id].signatures[part_id] = signature(v_data) ^ metadata;
+	auto& stream = m_streams[stream_id];
 
-	f_offset += write(metadata, f);
-	if (v_data.size())
-		fwrite(v_data.data(), 1, v_data.size(), f);
+	stream.signatures[part_id] = signature(v_data) ^ metadata;
 
-	f_offset += v_data.size();
-
-	return true;
+	return write_part(stream_id, (size_t) part_id, v_data, metadata);
 }
 
 // ******************************************************************************
@@ -311,6 +1000,13 @@ void CArchive::SetRawSize(int stream_id, size_t raw_size)
 	lock_guard<mutex> lck(mtx);
 	
 	m_streams[stream_id].raw_size = raw_size;
+
+	if (append_only && !input_mode)
+	{
+		f_offset += write_tag(tag_raw_size);
+		f_offset += write((size_t) stream_id, f);
+		f_offset += write(raw_size, f);
+	}
 }
 
 // ******************************************************************************
@@ -342,19 +1038,46 @@ size_t CArchive::GetCompressedSize(int stream_id)
 // ******************************************************************************
 bool CArchive::GetPart(int stream_id, vector<uint8_t> &v_data, size_t &metadata)
 {
-	lock_guard<mutex> lck(mtx);
+	TRACE_BUSY("archive_read", "archive");
+	unique_lock<mutex> lck(mtx, defer_lock);
+	{
+		TRACE_BLOCKED("archive_lock_wait", "archive");
+		lck.lock();
+	}
 	
 	auto& p = m_streams[stream_id];
 
+	auto t0 = high_resolution_clock::now();
+
+	// In sequential reading the part can be further in the archive
+	while (!part_available(p) && scan_checkpoint())
+		;
+
 	if (p.cur_id >= p.parts.size())
 		return false;
 
+	if (sequential)
+	{
+		bool r = get_buffered_part(p.parts[p.cur_id++], v_data, metadata);
+
+		add_io_time(duration<double>(high_resolution_clock::now() - t0).count());
+
+		return r;
+	}
+
 	v_data.resize(p.parts[p.cur_id].size);
 
-	my_fseek(f, p.parts[p.cur_id].offset, SEEK_SET);
+	FILE* file = p.hot ? f_hot : f;
+
+	if (!file)
+		return false;
+
+	auto t1 = high_resolution_clock::now();
+
+	my_fseek(file, p.parts[p.cur_id].offset, SEEK_SET);
 
 	if(p.parts[p.cur_id].size != 0)
-		read(metadata, f);
+		read(metadata, file);
 	else
 	{
 		metadata = 0;
@@ -362,7 +1085,9 @@ bool CArchive::GetPart(int stream_id, vector<uint8_t> &v_data, size_t &metadata)
 		return true;
 	}
 
-	auto r = fread(v_data.data(), 1, p.parts[p.cur_id].size, f);
+	auto r = fread(v_data.data(), 1, p.parts[p.cur_id].size, file);
+
+	add_io_time(duration<double>(high_resolution_clock::now() - t1).count());
 
 	p.cur_id++;
 
@@ -383,9 +1108,10 @@ bool CArchive::ResetStreamPartIterator(int stream_id)
 }
 
 // ******************************************************************************
+// Words are mixed with their positions, so reordered data have a different signature
 size_t CArchive::signature(vector<uint8_t>& v_data)
 {
-	size_t h = 0;
+	size_t h = v_data.size();
 
 	for (size_t i = 0; i < v_data.size(); i += 8)
 	{
@@ -393,6 +1119,8 @@ size_t CArchive::signature(vector<uint8_t>& v_data)
 		for (size_t j = 0; j < 8u && i + j < v_data.size(); ++j)
 			x = (x << 8) + (size_t)v_data[i + j];
 
+		x ^= (i + 8) * 0x9e3779b97f4a7c15ull;
+
 		x ^= x >> 33;
 		x *= 0xff51afd7ed558ccdL;
 		x ^= x >> 33;
@@ -408,10 +1136,205 @@ size_t CArchive::signature(vector<uint8_t>& v_data)
 // ******************************************************************************
 bool CArchive::LinkStream(int stream_id, string stream_name, int target_id)
 {
+	lock_guard<mutex> lck(mtx);
+
 	m_streams[stream_id] = m_streams[target_id];
 	m_streams[stream_id].stream_name = stream_name;
 
+	if (append_only && !input_mode)
+	{
+		f_offset += write_tag(tag_link);
+		f_offset += write((size_t) stream_id, f);
+		f_offset += write(stream_name, f);
+		f_offset += write((size_t) target_id, f);
+	}
+
 	return true;
 }
 
+// ******************************************************************************
+bool CArchive::GetStreamInfo(int stream_id, string& stream_name, size_t& no_parts, size_t& raw_size, size_t& packed_size)
+{
+	lock_guard<mutex> lck(mtx);
+
+	auto p = m_streams.find(stream_id);
+
+	if (p == m_streams.end())
+		return false;
+
+	stream_name = p->second.stream_name;
+	no_parts = p->second.parts.size();
+	raw_size = p->second.raw_size;
+	packed_size = 0;
+
+	for (auto& q : p->second.parts)
+		packed_size += q.size;
+
+	return true;
+}
+
+// ******************************************************************************
+bool CArchive::Verify(uint32_t no_threads, verify_result_t& result)
+{
+	lock_guard<mutex> lck(mtx);
+
+	result.no_streams = m_streams.size();
+	result.no_parts = 0;
+	result.no_bytes = 0;
+	result.no_bad_parts = 0;
+	result.signatures = has_signatures;
+	result.errors.clear();
+
+	if (!input_mode || !f || sequential)
+	{
+		result.errors.emplace_back("Only an archive file opened for reading can be verified");
+		return false;
+	}
+
+	auto t1 = high_resolution_clock::now();
+
+	if (!complete)
+		result.errors.emplace_back("Footer is missing; the archive was recovered up to the last checkpoint");
+
+	// Sizes of the regions of parts
+	size_t hot_size = 0;
+
+	if (use_hot_file)
+	{
+		my_fseek(f_hot, 0, SEEK_END);
+		hot_size = (size_t) my_ftell(f_hot);
+		my_fseek(f_hot, 0, SEEK_SET);
+	}
+
+	// Distinct parts (linked streams point at the same parts)
+	struct item_t {
+		bool hot;
+		size_t offset;
+		size_t size;
+		uint64_t signature;
+		string desc;
+		size_t end;
+		int status;				// 0 - correct, 1 - truncated, 2 - signature mismatch
+	};
+
+	vector<item_t> v_items;
+	map<pair<bool, size_t>, size_t> m_items;
+	map<string, int> m_names;
+
+	for (auto& stream : m_streams)
+	{
+		auto& s = stream.second;
+
+		if (!m_names.emplace(s.stream_name, stream.first).second)
+			result.errors.emplace_back("Duplicated stream name: " + s.stream_name);
+
+		for (size_t i = 0; i < s.parts.size(); ++i)
+		{
+			auto& part = s.parts[i];
+			uint64_t sig = i < s.signatures.size() ? s.signatures[i] : 0;
+			string desc = s.stream_name + " part " + to_string(i);
+
+			if (part.offset + 1 + part.size > (s.hot ? hot_size : footer_offset) || part.offset + 1 + part.size < part.offset)
+			{
+				result.errors.emplace_back(desc + " exceeds the " + (s.hot ? "companion file" : "region of parts"));
+				++result.no_bad_parts;
+				continue;
+			}
+
+			auto p = m_items.find(make_pair(s.hot, part.offset));
+
+			if (p == m_items.end())
+			{
+				m_items.emplace(make_pair(s.hot, part.offset), v_items.size());
+				v_items.push_back(item_t{ s.hot, part.offset, part.size, sig, desc, 0, 0 });
+			}
+			else if (v_items[p->second].size != part.size || (has_signatures && v_items[p->second].signature != sig))
+				result.errors.emplace_back(desc + " is inconsistent with " + v_items[p->second].desc + " at the same position");
+		}
+	}
+
+	// Parts are checked in the order of positions, so the reads of threads are close to each other
+	sort(v_items.begin(), v_items.end(), [](const item_t& x, const item_t& y) {
+		return make_pair(x.hot, x.offset) < make_pair(y.hot, y.offset);
+	});
+
+	atomic<size_t> next_item(0);
+	atomic<size_t> no_bytes(0);
+	atomic<bool> open_error(false);
+	vector<thread> v_threads;
+
+	for (uint32_t i = 0; i < max(no_threads, 1u); ++i)
+		v_threads.emplace_back([&] {
+			FILE* file_main = fopen(file_name.c_str(), "rb");
+			FILE* file_hot = use_hot_file ? fopen(HotFileName(file_name).c_str(), "rb") : nullptr;
+			vector<uint8_t> v_data;
+
+			if (!file_main || (use_hot_file && !file_hot))
+				open_error = true;
+			else
+				while (true)
+				{
+					size_t id = next_item++;
+					if (id >= v_items.size())
+						break;
+
+					auto& item = v_items[id];
+					FILE* file = item.hot ? file_hot : file_main;
+					size_t metadata;
+
+					my_fseek(file, item.offset, SEEK_SET);
+					size_t len = read(metadata, file);
+
+					v_data.resize(item.size);
+					if (!len || feof(file) || (item.size && fread(v_data.data(), 1, item.size, file) != item.size))
+					{
+						item.status = 1;
+						continue;
+					}
+
+					item.end = item.offset + len + item.size;
+					no_bytes += item.size;
+
+					if (has_signatures && (signature(v_data) ^ metadata) != item.signature)
+						item.status = 2;
+				}
+
+			if (file_main)
+				fclose(file_main);
+			if (file_hot)
+				fclose(file_hot);
+		});
+
+	for (auto& t : v_threads)
+		t.join();
+
+	if (open_error)
+		result.errors.emplace_back("Cannot open " + file_name + (use_hot_file ? " or its companion file" : ""));
+
+	for (size_t i = 0; i < v_items.size(); ++i)
+	{
+		auto& item = v_items[i];
+
+		if (item.status == 1)
+			result.errors.emplace_back(item.desc + " is truncated");
+		else if (item.status == 2)
+			result.errors.emplace_back(item.desc + ": signature mismatch");
+		else if (item.end > (item.hot ? hot_size : footer_offset))
+			result.errors.emplace_back(item.desc + " exceeds the " + (item.hot ? "companion file" : "region of parts"));
+		else if (i + 1 < v_items.size() && v_items[i + 1].hot == item.hot && item.end > v_items[i + 1].offset)
+			result.errors.emplace_back(item.desc + " overlaps " + v_items[i + 1].desc);
+		else
+			continue;
+
+		++result.no_bad_parts;
+	}
+
+	result.no_parts = v_items.size();
+	result.no_bytes = no_bytes;
+
+	add_io_time(duration<double>(high_resolution_clock::now() - t1).count());
+
+	return result.errors.empty() && !open_error;
+}
+
 // EOF
@@ -9,6 +9,7 @@
 // *******************************************************************************************
 
 #include <cstdio>
+#include <cstdint>
 #include <vector>
 #include <map>
 #include <list>
@@ -27,6 +28,43 @@ class CArchive
 	size_t f_offset;
 	string file_name;
 
+	// Optional companion file with hot (site-level) streams
+	FILE* f_hot;
+	size_t f_hot_offset;
+	bool use_hot_file;
+	const string hot_file_marker = "hot_streams";
+
+	// Signatures of parts are stored in the footer (extension), so the archive can be verified without decoding
+	const string signatures_marker = "part_signatures";
+	bool has_signatures;
+	size_t footer_offset;		// reading: end of the region of parts in the archive
+
+	// Row groups: part i of every stream of variants belongs to the i-th group; no. of variants in each group (extension)
+	const string row_groups_marker = "row_groups";
+	vector<uint64_t> v_row_groups;
+
+	// Append-only variant: every record (stream registration, part, raw size, link) is self-describing
+	// and checkpoints are written periodically, so a partially written archive can be recovered
+	// up to the last checkpoint and the archive can be read sequentially (also from a pipe)
+	bool append_only;
+	bool sequential;			// reading without seeking (stdin); parts are buffered until read by all streams
+	bool scan_eof;
+	bool complete;				// reading: footer present
+	size_t scan_offset;
+	size_t file_size;
+	size_t checkpoint_offset;	// writing: position of the last checkpoint
+	size_t checkpoint_interval;
+	const string append_only_magic = "VCFSHARK_APPEND_ONLY";
+	const size_t append_only_version = 1;
+	const size_t record_check = 0x5643465368726b41ull;
+	const size_t missing_offset = ~(size_t) 0;
+	const uint8_t tag_stream = 'S';
+	const uint8_t tag_part = 'P';
+	const uint8_t tag_raw_size = 'R';
+	const uint8_t tag_link = 'L';
+	const uint8_t tag_checkpoint = 'C';
+	const uint8_t tag_footer = 'F';
+
 	struct part_t{
 		size_t offset;
 		size_t size;
@@ -44,6 +82,7 @@ class CArchive
 		size_t raw_size;
 		vector<part_t> parts;
 		vector<uint64_t> signatures;
+		bool hot;			// parts are in the companion file
 	} stream_t;
 
 	map<int, stream_t> m_streams;
@@ -51,6 +90,33 @@ class CArchive
 
 	unordered_map<size_t, pair<int, int>> uo_signatures;
 
+	// Records read after the last checkpoint (applied when the next checkpoint is reached)
+	typedef struct {
+		uint8_t tag;
+		int stream_id;
+		int target_id;
+		size_t part_id;
+		size_t value;
+		part_t part;
+		string name;
+	} record_t;
+
+	// Parts read sequentially: metadata, data and number of streams that did not read them yet
+	typedef struct {
+		size_t metadata;
+		vector<uint8_t> data;
+		int no_readers;
+	} buffered_part_t;
+
+	vector<record_t> v_pending;
+	unordered_map<size_t, buffered_part_t> m_buffered;
+
+	// Time spent in file I/O (total and by the calling thread)
+	double io_time;
+	static thread_local double thread_io_time;
+
+	void add_io_time(double time);
+
 	bool serialize();
 	bool deserialize();
 	size_t write_fixed(size_t x, FILE* file);
@@ -61,14 +127,73 @@ class CArchive
 	size_t read(string& s, FILE* file);
 	size_t signature(vector<uint8_t>& v_data);
 
+	bool write_part(int stream_id, size_t part_id, vector<uint8_t>& v_data, size_t metadata);
+	bool open_hot_file();
+
+	size_t write_tag(uint8_t tag);
+	void write_checkpoint(uint8_t tag);
+	bool read_magic();
+	bool check_complete();
+	bool scan_record(bool& checkpoint);
+	bool scan_checkpoint();
+	void apply_pending();
+	void finish_scan();
+	bool part_available(stream_t& stream);
+	bool get_buffered_part(part_t& part, vector<uint8_t>& v_data, size_t& metadata);
+
 public:
+	// Result of the verification of the archive
+	typedef struct {
+		size_t no_streams;
+		size_t no_parts;			// distinct parts (linked streams share them)
+		size_t no_bytes;
+		size_t no_bad_parts;
+		bool signatures;			// signatures of parts were checked (absent in older and recovered archives)
+		vector<string> errors;
+	} verify_result_t;
+
 	CArchive(bool _input_mode);
 	~CArchive();
 
-	bool Open(string _file_name);
+	// With _use_hot_file (writing) parts of hot streams go to the companion file (file name + ".hot");
+	// in reading mode the companion file is opened if the archive uses it
+	// With _append_only (writing) the append-only variant is written (not combined with the companion file);
+	// in reading mode it is detected, an incomplete archive is recovered and "-" means stdin
+	bool Open(string _file_name, bool _use_hot_file = false, bool _append_only = false);
 	bool Close();
 
-	int RegisterStream(string stream_name);
+	// Append-only variant: make everything written so far recoverable
+	bool Checkpoint();
+
+	// Append-only variant (writing): continue an interrupted archive from its checkpoint ending at checkpoint_offset;
+	// everything written after it is discarded
+	bool Reopen(string _file_name, size_t _checkpoint_offset);
+
+	// Position just after the last checkpoint
+	size_t GetCheckpointOffset()
+	{
+		lock_guard<mutex> lck(mtx);
+
+		return checkpoint_offset;
+	}
+
+	bool IsAppendOnly()
+	{
+		return append_only;
+	}
+
+	// False for an append-only archive without a footer (recovered up to the last checkpoint)
+	bool IsComplete()
+	{
+		return complete;
+	}
+
+	static string HotFileName(const string& file_name)
+	{
+		return file_name + ".hot";
+	}
+
+	int RegisterStream(string stream_name, bool hot = false);
 	int GetStreamId(string stream_name);
 
 	bool AddPart(int stream_id, vector<uint8_t> &v_data, size_t metadata = 0);
@@ -83,6 +208,38 @@ public:
 
 	bool LinkStream(int stream_id, string stream_name, int target_id);
 
+	// Table of row groups stored in the footer (empty if the archive has none)
+	void SetRowGroups(const vector<uint64_t>& _v_row_groups)
+	{
+		lock_guard<mutex> lck(mtx);
+
+		v_row_groups = _v_row_groups;
+	}
+
+	void GetRowGroups(vector<uint64_t>& _v_row_groups)
+	{
+		lock_guard<mutex> lck(mtx);
+
+		_v_row_groups = v_row_groups;
+	}
+	bool GetStreamInfo(int stream_id, string& stream_name, size_t& no_parts, size_t& raw_size, size_t& packed_size);
+
+	// Reading mode: check the consistency of the footer (unique stream names, parts within the file and not overlapping)
+	// and signatures of all parts; parts are read by no_threads threads, each with its own file handle
+	bool Verify(uint32_t no_threads, verify_result_t& result);
+
+	double GetIOTime()
+	{
+		lock_guard<mutex> lck(mtx);
+
+		return io_time;
+	}
+
+	static double GetThreadIOTime()
+	{
+		return thread_io_time;
+	}
+
 
 	size_t GetNoStreams()
 	{
@@ -8,6 +8,8 @@
 // *******************************************************************************************
 
 #include "buffer.h"
+#include "varint.h"
+#include "cpu_dispatch.h"
 
 #include <algorithm>
 #include <cstring>
@@ -43,6 +45,18 @@ bool CBuffer::IsFull(void)
 	return v_data.size() + 4 * v_size.size() >= max_size;
 }
 
+// ************************************************************************************
+bool CBuffer::HasData(void) const
+{
+	return !v_size.empty();
+}
+
+// ************************************************************************************
+size_t CBuffer::GetMemoryUsage(void) const
+{
+	return v_data.capacity() + 4 * v_size.capacity();
+}
+
 // ************************************************************************************
 void CBuffer::WriteFlag(uint8_t flag)
 {
@@ -144,80 +158,7 @@ uint32_t CBuffer::encode_var_int(char* p)
 // ************************************************************************************
 uint32_t CBuffer::decode_var_int(uint8_t* p, uint32_t &val)
 {
-	int code = p[0];
-
-	val = 0;
-
-	if (code == 0)
-		return 1;
-	else if (code == 1)
-	{
-		val = 0x80000000u;
-		return 1;
-	}
-	else if (code < 126)
-	{
-		val = code - 1;
-		return 1;
-	}
-	else if (code < 250)
-	{
-		val = (uint32_t) (((int)code) - 250);
-		return 1;
-	}
-	else if (code == 250)
-	{
-		val += (uint32_t)p[1];		val <<= 8;
-		val += (uint32_t)p[2];
-		return 3;
-	}
-	else if (code == 251)
-	{
-		val += (uint32_t)p[1];		val <<= 8;
-		val += (uint32_t)p[2];
-		
-		val = (uint32_t) -((int)val);
-
-		return 3;
-	}
-	else if (code == 252)
-	{
-		val += (uint32_t)p[1];		val <<= 8;
-		val += (uint32_t)p[2];		val <<= 8;
-		val += (uint32_t)p[3];
-		return 4;
-	}
-	else if (code == 253)
-	{
-		val += (uint32_t)p[1];		val <<= 8;
-		val += (uint32_t)p[2];		val <<= 8;
-		val += (uint32_t)p[3];
-		
-		val = (uint32_t) -((int)val);
-
-		return 4;
-	}
-	else if (code == 254)
-	{
-		val += (uint32_t)p[1];		val <<= 8;
-		val += (uint32_t)p[2];		val <<= 8;
-		val += (uint32_t)p[3];		val <<= 8;
-		val += (uint32_t)p[4];
-		return 5;
-	}
-	else if (code == 255)
-	{
-		val += (uint32_t)p[1];		val <<= 8;
-		val += (uint32_t)p[2];		val <<= 8;
-		val += (uint32_t)p[3];		val <<= 8;
-		val += (uint32_t)p[4];
-		
-		val = (uint32_t) -((int)val);
-
-		return 5;
-	}
-
-	return 0;	// !!! Never should be here
+	return ::decode_var_int(p, val);
 }
 
 // ************************************************************************************
@@ -629,15 +570,8 @@ void CBuffer::ReadIntVarSize(char*& p, uint32_t& size)
 	if (size)
 	{
 		p = new char[size * 4];
-		uint32_t val;
 
-		uint8_t* q = v_data.data();
-
-		for (size_t i = 0; i < size; ++i)
-		{
-			v_data_pos += decode_var_int(q + v_data_pos, val);
-			memcpy(p + 4 * i, &val, 4);
-		}
+		v_data_pos += (uint32_t) CPUKernels().decode_var_ints(v_data.data() + v_data_pos, (uint32_t*) p, size);
 	}
 	else
 		p = nullptr;
@@ -666,6 +600,24 @@ void CBuffer::ReadReal(char*& p, uint32_t& size)
 		p = nullptr;
 }
 
+// ************************************************************************************
+// Reads a single real value (stored by WriteReal with size 1); returns false if the value is absent
+bool CBuffer::ReadReal(float& x)
+{
+	if (v_size.empty())
+		return false;
+
+	uint32_t size = v_size[v_size_pos++];
+
+	if (!size)
+		return false;
+
+	copy_n(v_data.begin() + v_data_pos, 4, (uint8_t*) &x);
+	v_data_pos += 4 * size;
+
+	return true;
+}
+
 // ************************************************************************************
 void CBuffer::FuncReal(char*& p, uint32_t& size, char* src_p, uint32_t src_size)
 {
@@ -719,6 +671,40 @@ void CBuffer::ReadText(char*& p, uint32_t& size)
 		p = nullptr;
 }
 
+// ************************************************************************************
+void CBuffer::ReadText(string& str)
+{
+	str.clear();
+
+	if (v_size.empty())
+		return;
+
+	uint32_t size = v_size[v_size_pos++];
+
+	if (size)
+	{
+		str.assign((const char*)v_data.data() + v_data_pos, size);
+		v_data_pos += size;
+	}
+}
+
+// ************************************************************************************
+// Returns pointer to the text stored in the buffer (valid until the next SetBuffer)
+void CBuffer::ReadTextView(const uint8_t*& p, uint32_t& size)
+{
+	if (v_size.empty())
+	{
+		p = nullptr;
+		size = 0;
+
+		return;
+	}
+
+	size = v_size[v_size_pos++];
+	p = v_data.data() + v_data_pos;
+	v_data_pos += size;
+}
+
 // ************************************************************************************
 void CBuffer::SetBuffer(vector<uint32_t>& _v_size, vector<uint8_t>& _v_data)
 {
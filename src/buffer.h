@@ -9,6 +9,7 @@
 // *******************************************************************************************
 
 #include <vector>
+#include <string>
 #include <cstdint>
 #include "defs.h"
 
@@ -16,6 +17,8 @@ using namespace std;
 
 // ************************************************************************************
 class CBuffer {
+	friend class CBenchAccess;		// microbenchmarks of the permutations (bench/)
+
 public:
 	enum class buffer_t {none, flag, integer, real, text};
 
@@ -60,6 +63,8 @@ public:
 	void WriteText(char* p, uint32_t size);
 	void GetBuffer(vector<uint32_t>& _v_size, vector<uint8_t>& _v_data);
 	bool IsFull(void);
+	bool HasData(void) const;
+	size_t GetMemoryUsage(void) const;
 
 	// Input buffer methods
 	void ReadFlag(uint8_t &flag);
@@ -67,7 +72,10 @@ public:
 	void ReadIntVarSize(char* &p, uint32_t& size);
 	void ReadInt64(int64_t &x);
 	void ReadReal(char* &p, uint32_t& size);
+	bool ReadReal(float &x);
 	void ReadText(char* &p, uint32_t& size);
+	void ReadText(string& str);
+	void ReadTextView(const uint8_t* &p, uint32_t& size);
 	void SetBuffer(vector<uint32_t>& _v_size, vector<uint8_t>& _v_data);
 
 	void SetFunction(function_data_item_t& _fun);
@@ -8,9 +8,12 @@
 // *******************************************************************************************
 
 #include <memory>
+#include <cstdlib>
 #include <iostream>
+#include <chrono>
 
 using namespace std;
+using namespace std::chrono;
 
 #include "cfile.h"
 #include "utils.h"
@@ -31,6 +34,31 @@ CCompressedFile::CCompressedFile()
 
 	rce = nullptr;
 	rcd = nullptr;
+
+	gt_cursor_pos = 0;
+	gt_cursor_no_data = false;
+	gt_cursor_time = 0;
+	gt_cursor_bytes = 0;
+
+	archive_features = 0;
+	gvcf_mode = false;
+	end_key_id = -1;
+	sample_order_mode = false;
+	no_gt_window_variants = 0;
+	row_group_size = 0;
+	no_row_group_variants = 0;
+	sample_order_cache_variants = 0;
+
+	stats = nullptr;
+	use_hot_file = false;
+	append_only = false;
+
+	mem_governor = nullptr;
+	max_cnt_packages = default_max_cnt_packages;
+	cur_buffer_size = max_buffer_size;
+	cur_buffer_gt_size = max_buffer_gt_size;
+	cur_buffer_db_size = max_buffer_db_size;
+	no_variants_since_adapt = 0;
 }
 
 // ************************************************************************************
@@ -118,6 +146,8 @@ bool CCompressedFile::OpenForReading(string file_name)
 	for(auto e : v_data_edges)
 		m_data_edges[e.second] = e.first;
 
+	v_sample_order_next.assign(no_keys, vector<uint32_t>());
+
 	v_packages.resize(no_keys, nullptr);
 	for (uint32_t i = 0; i < no_keys; ++i)
 		q_preparation_ids->Push(make_pair(i, -1));
@@ -140,9 +170,17 @@ bool CCompressedFile::OpenForReading(string file_name)
 	v_bsc_db_data.resize(no_db_fields);
 
 	v_format_compress.resize(no_keys, nullptr);
+	v_ctx_memory.assign(no_keys, 0);
+	v_i_buf_memory.assign(no_keys + no_db_fields, 0);
 
 	rcd = new CRangeDecoder<CVectorIOStream>(*vios_i);
 
+	v_gt_cursor_size.clear();
+	gt_cursor_pos = 0;
+	gt_cursor_no_data = false;
+	gt_cursor_time = 0;
+	gt_cursor_bytes = 0;
+
 	pbwt_initialised = false;
 
 	InitPBWT();
@@ -158,6 +196,7 @@ bool CCompressedFile::OpenForReading(string file_name)
 		{
 			v_format_compress[i] = new CFormatCompress();
 			v_format_compress[i]->SetNoSamples(no_samples);
+			v_format_compress[i]->SetBlockMode(gvcf_mode);
 		}
 
 		switch (keys[i].type)
@@ -185,9 +224,13 @@ bool CCompressedFile::OpenForReading(string file_name)
 		v_bsc_db_data[i]->InitDecompress();
 	}
 
+	init_stats();
+
 	for (uint32_t i = 0; i < no_coder_threads; ++i)
 		v_coder_threads.emplace_back(thread([&]() {
 
+		TRACE_THREAD_NAME("cfile_preparation");
+
 		while (!q_preparation_ids->IsCompleted())
 		{
 			SPackage* pck = new SPackage;
@@ -201,6 +244,13 @@ bool CCompressedFile::OpenForReading(string file_name)
 				break;
 			}
 
+			double t_cpu = 0, t_io = 0;
+			if (stats)
+			{
+				t_cpu = CStats::ThreadTime();
+				t_io = CArchive::GetThreadIOTime();
+			}
+
 			if (p_ids.first >= 0)
 			{
 				pck->stream_id_size = archive->GetStreamId("key_" + to_string(p_ids.first) + "_size");
@@ -226,6 +276,24 @@ bool CCompressedFile::OpenForReading(string file_name)
 						decompress_gt(pck, raw_size);
 					}
 
+					if (stats)
+					{
+						double t_decode = CStats::ThreadTime() - t_cpu - (CArchive::GetThreadIOTime() - t_io);
+
+						// Decoding of GT is completed (and reported) by the GT cursor
+						if (pck->key_id == gt_key_id)
+							pck->encode_time = t_decode;
+						else
+							stats->AddDecode(pck->key_id, pck->v_size.size() * 4 + pck->v_data.size(), t_decode);
+					}
+
+					if (mem_governor)
+					{
+						if (pck->key_id != gt_key_id)
+							update_context_memory(pck->key_id);
+						mem_governor->Add(mem_component_t::packages, package_memory(*pck));
+					}
+
 					lock_guard<mutex> lck(m_packages);
 					v_packages[pck->key_id] = pck;
 				}
@@ -234,6 +302,9 @@ bool CCompressedFile::OpenForReading(string file_name)
 					pck->v_size.clear();
 					pck->v_data.clear();
 
+					if (mem_governor)
+						mem_governor->Add(mem_component_t::packages, package_memory(*pck));
+
 					lock_guard<mutex> lck(m_packages);
 
 					pck->key_id = p_ids.first;
@@ -249,6 +320,14 @@ bool CCompressedFile::OpenForReading(string file_name)
 				if (archive->GetPart(pck->stream_id_size, pck->v_compressed, raw_size))
 				{
 					decompress_db(pck, raw_size, v_tmp);
+
+					if (stats)
+						stats->AddDecode(no_keys + pck->db_id, pck->v_size.size() * 4 + pck->v_data.size(),
+							CStats::ThreadTime() - t_cpu - (CArchive::GetThreadIOTime() - t_io));
+
+					if (mem_governor)
+						mem_governor->Add(mem_component_t::packages, package_memory(*pck));
+
 					lock_guard<mutex> lck(m_packages);
 					v_db_packages[pck->db_id] = pck;
 				}
@@ -257,6 +336,9 @@ bool CCompressedFile::OpenForReading(string file_name)
 					pck->v_size.clear();
 					pck->v_data.clear();
 
+					if (mem_governor)
+						mem_governor->Add(mem_component_t::packages, package_memory(*pck));
+
 					lock_guard<mutex> lck(m_packages);
 					v_db_packages[pck->db_id] = pck;
 				}
@@ -270,7 +352,7 @@ bool CCompressedFile::OpenForReading(string file_name)
 }
 
 // ************************************************************************************
-bool CCompressedFile::OpenForWriting(string file_name, uint32_t _no_keys)
+bool CCompressedFile::OpenForWriting(string file_name, uint32_t _no_keys, CState* resume_state)
 {
 	prev_pos = 0;
 	archive_name = file_name;
@@ -280,12 +362,29 @@ bool CCompressedFile::OpenForWriting(string file_name, uint32_t _no_keys)
 
 	CBSCWrapper::InitLibrary(p_bsc_features);
 
-	if (!archive->Open(file_name))
+	if (resume_state)
+	{
+		// The archive is continued from the checkpoint at which the state was saved
+		uint64_t checkpoint_offset;
+		append_only = true;
+
+		if (!resume_state->Read(checkpoint_offset) || !archive->Reopen(file_name, checkpoint_offset))
+		{
+			cerr << "Cannot resume compression to " << file_name << "\n";
+			return false;
+		}
+	}
+	else if (!archive->Open(file_name, false, append_only))
 	{
 		cerr << "Cannot open " << file_name << "\n";
 		return false;
 	}
 
+	// Streams of a resumed archive are already registered
+	auto register_stream = [&](const string& stream_name) {
+		return resume_state ? archive->GetStreamId(stream_name) : archive->RegisterStream(stream_name);
+	};
+
     no_keys = _no_keys;
     
 	v_o_buf.resize(no_keys);
@@ -298,34 +397,61 @@ bool CCompressedFile::OpenForWriting(string file_name, uint32_t _no_keys)
 	v_bsc_size.resize(no_keys);
 	v_bsc_data.resize(no_keys);
 	v_text_pp.resize(no_keys);
-	v_coder_part_ids.resize(no_keys + no_db_fields, 0);
-	v_text_part_ids.resize(no_keys + no_db_fields, 0);
 
 	v_format_compress.resize(no_keys, nullptr);
+	v_ctx_memory.assign(no_keys, 0);
+
+	plan_memory_budget();
 
 	open_mode = open_mode_t::writing;
 	pbwt_initialised = false;
 	no_variants = 0;
+	archive_features = feature_allele_codec | feature_binary_qual;
+	if (gvcf_mode)
+		archive_features |= feature_gvcf;
+	if (quantizer.IsEnabled())
+		archive_features |= feature_lossy;
+	if (sample_order_mode && gt_key_id >= 0 && !row_group_size)
+		archive_features |= feature_sample_order;
+	else
+		sample_order_mode = false;
+	if (row_group_size)
+		archive_features |= feature_row_groups;
+	no_row_group_variants = 0;
+	v_row_groups.clear();
+
+	v_annot_fields.resize(no_keys, 0);
+	for (uint32_t i = 0; i < no_keys; ++i)
+		if (keys[i].type != BCF_HT_STR || (int) i == gt_key_id)
+			v_annot_fields[i] = 0;
+	if (any_of(v_annot_fields.begin(), v_annot_fields.end(), [](uint32_t x) {return x != 0; }))
+		archive_features |= feature_annot_columns;
+
+	v_sample_order_prev.assign(no_keys, vector<uint32_t>());
+	v_sample_order_cur.assign(no_keys, vector<uint32_t>());
+	v_sample_order_pending.assign(no_keys, 0);
+	allele_codec.SetSymbolicTags(gvcf_mode);
 
 	InitPBWT();
 
 	for (uint32_t i = 0; i < no_keys; i++)
 	{
 		if((int) i != gt_key_id)
-			v_o_buf[i].SetMaxSize(max_buffer_size);
+			v_o_buf[i].SetMaxSize(cur_buffer_size);
 		else
-			v_o_buf[i].SetMaxSize(max_buffer_gt_size);
+			v_o_buf[i].SetMaxSize(cur_buffer_gt_size);
 
 		v_bsc_size[i] = new CBSCWrapper;
 		v_bsc_size[i]->InitCompress(p_bsc_size);
 		v_bsc_data[i] = new CBSCWrapper;
 
-		v_buf_ids_size[i] = archive->RegisterStream("key_" + to_string(i) + "_size");
+		v_buf_ids_size[i] = register_stream("key_" + to_string(i) + "_size");
 
 		if (keys[i].keys_type == key_type_t::fmt || keys[i].keys_type == key_type_t::info)
 		{
 			v_format_compress[i] = new CFormatCompress();
 			v_format_compress[i]->SetNoSamples(no_samples);
+			v_format_compress[i]->SetBlockMode(gvcf_mode);
 		}
 
 		switch (keys[i].type)
@@ -350,19 +476,19 @@ bool CCompressedFile::OpenForWriting(string file_name, uint32_t _no_keys)
 	rce = new CRangeEncoder<CVectorIOStream>(*vios_o);
 
 	for (uint32_t i = 0; i < no_keys; i++)
-		v_buf_ids_data[i] = archive->RegisterStream("key_" + to_string(i) + "_data");
+		v_buf_ids_data[i] = register_stream("key_" + to_string(i) + "_data");
 
 	// Register streams for variant descriptions
 	v_db_ids_size.clear();
 	for(auto x : db_stream_name_size)
-		v_db_ids_size.emplace_back(archive->RegisterStream(x));
+		v_db_ids_size.emplace_back(register_stream(x));
 
 	v_db_ids_data.clear();
 	for (auto x : db_stream_name_data)
-		v_db_ids_data.emplace_back(archive->RegisterStream(x));
+		v_db_ids_data.emplace_back(register_stream(x));
 
 	for(uint32_t i = 0; i < no_db_fields; ++i)
-		v_o_db_buf[i].SetMaxSize(max_buffer_db_size);
+		v_o_db_buf[i].SetMaxSize(cur_buffer_db_size);
 
 	v_bsc_db_size.resize(no_db_fields);
 	v_bsc_db_data.resize(no_db_fields);
@@ -397,27 +523,68 @@ bool CCompressedFile::OpenForWriting(string file_name, uint32_t _no_keys)
 	v_bsc_db_data[id_db_qual] = new CBSCWrapper;
 	v_bsc_db_data[id_db_qual]->InitCompress(p_bsc_db_qual);
 
+	// Text keys are preprocessed and coded in separate stages, so preprocessing of a part can overlap coding of the previous one
+	vector<int> v_no_stages(no_keys + no_db_fields, 1);
+	for (uint32_t i = 0; i < no_keys; ++i)
+		if ((int) i != gt_key_id && keys[i].type == BCF_HT_STR)
+			v_no_stages[i] = 2;
+
 	if (q_packages)
 		delete q_packages;
-	q_packages = new CRegisteringQueue<SPackage>(1);
+	q_packages = new COrderedScheduler<SPackage>(1, v_no_stages);
+
+	if (resume_state)
+	{
+		bool ok = find(v_buf_ids_size.begin(), v_buf_ids_size.end(), -1) == v_buf_ids_size.end() &&
+			find(v_buf_ids_data.begin(), v_buf_ids_data.end(), -1) == v_buf_ids_data.end() &&
+			find(v_db_ids_size.begin(), v_db_ids_size.end(), -1) == v_db_ids_size.end() &&
+			find(v_db_ids_data.begin(), v_db_ids_data.end(), -1) == v_db_ids_data.end();
+
+		if (!ok || !load_state(*resume_state))
+		{
+			cerr << "Incorrect state of compression for " << file_name << "\n";
+			return false;
+		}
+
+		// Parts are numbered after the ones already in the archive
+		string stream_name;
+		size_t no_parts, raw_size, packed_size;
+
+		for (uint32_t i = 0; i < no_keys; ++i)
+		{
+			archive->GetStreamInfo(v_buf_ids_size[i], stream_name, no_parts, raw_size, packed_size);
+			q_packages->SetNextPartId(i, (int) no_parts);
+		}
+
+		for (uint32_t i = 0; i < no_db_fields; ++i)
+		{
+			archive->GetStreamInfo(v_db_ids_size[i], stream_name, no_parts, raw_size, packed_size);
+			q_packages->SetNextPartId(no_keys + i, (int) no_parts);
+		}
+	}
 
 	v_cnt_packages.resize(no_keys, 0);
 	v_cnt_db_packages.resize(no_db_fields, 0);
 
 	v_coder_threads.reserve(no_coder_threads);
 
+	init_stats();
+
 	for (uint32_t i = 0; i < no_coder_threads; ++i)
 		v_coder_threads.emplace_back(thread([&]() {
 		
-		SPackage pck;
+		TRACE_THREAD_NAME("cfile_coder");
+
+		COrderedScheduler<SPackage>::task_t task;
 		vector<uint8_t> v_compressed;
 		vector<uint8_t> v_tmp;
+		int64_t thread_scratch_memory = 0;
 
-		while (!q_packages->IsCompleted())
+		while (q_packages->Pop(task))
 		{
-			if (!q_packages->Pop(pck))
-				continue;
+			SPackage& pck = task.data;
 
+			if (task.stage == 0)
 			{
 				unique_lock<mutex> lck(m_packages);
 
@@ -428,7 +595,22 @@ bool CCompressedFile::OpenForWriting(string file_name, uint32_t _no_keys)
 				cv_packages.notify_all();
 			}
 
-			if (pck.type == SPackage::package_t::fields)
+			bool is_last_stage = task.stage + 1 == q_packages->GetNoStages(task.stream_id);
+			auto t_start = high_resolution_clock::now();
+
+			double t_cpu = 0, t_io = 0;
+			if (stats)
+			{
+				t_cpu = CStats::ThreadTime();
+				t_io = CArchive::GetThreadIOTime();
+			}
+
+			size_t raw_size = pck.v_size.size() * 4 + pck.v_data.size();
+			int64_t pck_memory = mem_governor ? package_memory(pck) : 0;
+
+			if (!is_last_stage)
+				preprocess_field(pck);
+			else if (pck.type == SPackage::package_t::fields)
 			{
 				if(keys[pck.key_id].keys_type == key_type_t::fmt && keys[pck.key_id].type != BCF_HT_STR)
 					compress_format(pck, v_compressed, v_tmp);
@@ -446,7 +628,29 @@ bool CCompressedFile::OpenForWriting(string file_name, uint32_t _no_keys)
 				compress_gt(pck);
 			else
 				compress_db(pck, v_compressed, v_tmp);
+
+			if (stats)
+			{
+				pck.encode_time += CStats::ThreadTime() - t_cpu - (CArchive::GetThreadIOTime() - t_io);
+				if (is_last_stage)
+					stats->AddEncode(pck.type == SPackage::package_t::db ? no_keys + pck.db_id : pck.key_id, raw_size, pck.encode_time);
+			}
+
+			if (mem_governor)
+			{
+				int64_t scratch_memory = (int64_t) (v_compressed.capacity() + v_tmp.capacity());
+
+				// Preprocessed data stay in the package until the next stage
+				mem_governor->Add(mem_component_t::packages, is_last_stage ? -pck_memory : package_memory(pck) - pck_memory);
+				mem_governor->Add(mem_component_t::scratch, scratch_memory - thread_scratch_memory);
+				thread_scratch_memory = scratch_memory;
+			}
+
+			q_packages->Complete(task, duration<double>(high_resolution_clock::now() - t_start).count());
 		}
+
+		if (mem_governor)
+			mem_governor->Add(mem_component_t::scratch, -thread_scratch_memory);
 			}));
 
 	return true;
@@ -476,7 +680,14 @@ bool CCompressedFile::Close()
 
 			SPackage pck((int) i != gt_key_id ? SPackage::package_t::fields : SPackage::package_t::gt, i, -1, v_buf_ids_size[i], v_buf_ids_data[i], part_id, v_size, v_data, v_aux);
 
-			q_packages->Push(pck);
+			if (uses_sample_order(i))
+				pck.v_sample_order = v_sample_order_prev[i];
+
+			if (mem_governor)
+				mem_governor->Add(mem_component_t::packages, package_memory(pck));
+
+			size_t work = package_work(pck);
+			q_packages->Push(i, part_id, move(pck), work);
 		}
 
 		for(uint32_t i = 0; i < no_db_fields; ++i)
@@ -487,20 +698,37 @@ bool CCompressedFile::Close()
 
 			SPackage pck(SPackage::package_t::db, -1, i, v_db_ids_size[i], v_db_ids_data[i], part_id, v_size, v_data, v_aux);
 
-			q_packages->Push(pck);
+			if (mem_governor)
+				mem_governor->Add(mem_component_t::packages, package_memory(pck));
+
+			size_t work = package_work(pck);
+			q_packages->Push(no_keys + i, part_id, move(pck), work);
 		}
 
 		q_packages->MarkCompleted();
 
+		// The last parts form the last row group; they are empty if the no. of variants is a multiple of the group size
+		// (or a checkpoint was just made) and then they are not a group
+		if (row_group_size)
+		{
+			if (no_row_group_variants)
+				v_row_groups.push_back(no_row_group_variants);
+			archive->SetRowGroups(v_row_groups);
+		}
+
 		for (uint32_t i = 0; i < no_coder_threads; ++i)
 			v_coder_threads[i].join();
 
 		save_descriptions();
+		update_stats_sizes();
 
 		delete rce;
 		rce = nullptr;
 
 		archive->Close();
+
+		if (stats)
+			stats->AddStage(stats_stage_t::archive_io, archive->GetIOTime());
 	}
 	else if (open_mode == open_mode_t::reading)
 	{
@@ -508,8 +736,12 @@ bool CCompressedFile::Close()
 
 		for (uint32_t i = 0; i < no_coder_threads; ++i)
 			v_coder_threads[i].join();
-			
+
+		update_stats_sizes();
 		archive->Close();
+
+		if (stats)
+			stats->AddStage(stats_stage_t::archive_io, archive->GetIOTime());
 	}
 
 	open_mode = open_mode_t::none;
@@ -641,6 +873,79 @@ void CCompressedFile::SetNoThreads(int _no_threads)
 		no_coder_threads = 1;
 }
 
+// ************************************************************************************
+void CCompressedFile::SetStats(CStats* _stats)
+{
+	stats = _stats;
+}
+
+// ************************************************************************************
+void CCompressedFile::SetGVCF(bool _gvcf_mode, int _end_key_id)
+{
+	gvcf_mode = _gvcf_mode;
+	end_key_id = _gvcf_mode ? _end_key_id : -1;
+}
+
+// ************************************************************************************
+void CCompressedFile::SetQuantizer(const CQuantizer& _quantizer)
+{
+	quantizer = _quantizer;
+}
+
+// ************************************************************************************
+string CCompressedFile::GetLossyProfile()
+{
+	return quantizer.GetProfile();
+}
+
+// ************************************************************************************
+void CCompressedFile::SetSampleOrder(bool _sample_order_mode)
+{
+	sample_order_mode = _sample_order_mode;
+}
+
+// ************************************************************************************
+void CCompressedFile::SetAnnotationKey(uint32_t key_id, uint32_t no_fields)
+{
+	if (v_annot_fields.size() <= key_id)
+		v_annot_fields.resize(key_id + 1, 0);
+
+	v_annot_fields[key_id] = no_fields;
+}
+
+// ************************************************************************************
+// 0 - parts of each stream are flushed separately (when its buffer is full)
+void CCompressedFile::SetRowGroupSize(uint32_t _row_group_size)
+{
+	row_group_size = _row_group_size;
+}
+
+// ************************************************************************************
+bool CCompressedFile::GetRowGroups(vector<uint64_t>& _v_row_groups)
+{
+	archive->GetRowGroups(_v_row_groups);
+
+	return (archive_features & feature_row_groups) != 0;
+}
+
+// ************************************************************************************
+void CCompressedFile::SetHotFile(bool _use_hot_file)
+{
+	use_hot_file = _use_hot_file;
+}
+
+// ************************************************************************************
+void CCompressedFile::SetAppendOnly(bool _append_only)
+{
+	append_only = _append_only;
+}
+
+// ************************************************************************************
+void CCompressedFile::SetMemoryGovernor(CMemoryGovernor* _mem_governor)
+{
+	mem_governor = _mem_governor;
+}
+
 // ************************************************************************************
 int CCompressedFile::GetNeglectLimit()
 {
@@ -671,45 +976,73 @@ bool CCompressedFile::GetVariant(variant_desc_t &desc, vector<field_desc> &field
 		return false;
 
 	int64_t pos;
+	bool new_parts = false;
 
 	for (uint32_t i = 0; i < no_db_fields; ++i)
 	{
 		if (v_i_db_buf[i].IsEmpty())
 		{
+			new_parts = true;
+
 			unique_lock<mutex> lck(m_packages);
 
-			cv_packages.wait(lck, [&, this] {return v_db_packages[i] != nullptr; });
+			{
+				TRACE_BLOCKED("package_wait", "queue");
+				cv_packages.wait(lck, [&, this] {return v_db_packages[i] != nullptr; });
+			}
+
+			if (mem_governor)
+				mem_governor->Add(mem_component_t::packages, -package_memory(*v_db_packages[i]));
 
 			v_i_db_buf[i].SetBuffer(v_db_packages[i]->v_size, v_db_packages[i]->v_data);
 			delete v_db_packages[i];
 			v_db_packages[i] = nullptr;
 
+			if (mem_governor)
+				update_buffer_memory(no_keys + i, v_i_db_buf[i]);
+
 			q_preparation_ids->Push(make_pair(-1, i));
 		}
 	}
 
-	char* str = nullptr;
-	uint32_t len;
-	
-	v_i_db_buf[id_db_chrom].ReadText(str, len);
-	desc.chrom = string(str, str + len);
-	delete[] str;
+	// With row groups new parts of site-level fields start a new group
+	if (new_parts && (archive_features & feature_row_groups))
+		start_row_group();
 
-	v_i_db_buf[id_db_id].ReadText(str, len);
-	desc.id = string(str, str + len);
-	delete[] str;
+	v_i_db_buf[id_db_chrom].ReadText(desc.chrom);
+	v_i_db_buf[id_db_id].ReadText(desc.id);
 
-	v_i_db_buf[id_db_ref].ReadText(str, len);
-	desc.ref = string(str, str + len);
-	delete[] str;
+	if (archive_features & feature_allele_codec)
+	{
+		const uint8_t* p_allele;
+		uint32_t len;
 
-	v_i_db_buf[id_db_alt].ReadText(str, len);
-	desc.alt = string(str, str + len);
-	delete[] str;
+		v_i_db_buf[id_db_ref].ReadTextView(p_allele, len);
+		allele_codec.DecodeRef(p_allele, len, desc.ref);
 
-	v_i_db_buf[id_db_qual].ReadText(str, len);
-	desc.qual = string(str, str + len);
-	delete[] str;
+		v_i_db_buf[id_db_alt].ReadTextView(p_allele, len);
+		allele_codec.DecodeAlt(p_allele, len, desc.alt);
+	}
+	else
+	{
+		v_i_db_buf[id_db_ref].ReadText(desc.ref);
+		v_i_db_buf[id_db_alt].ReadText(desc.alt);
+	}
+
+	if (archive_features & feature_binary_qual)
+	{
+		if (!v_i_db_buf[id_db_qual].ReadReal(desc.qual))
+			bcf_float_set_missing(desc.qual);
+	}
+	else
+	{
+		// Older archives store QUAL as text
+		v_i_db_buf[id_db_qual].ReadText(str_qual_tmp);
+		if (str_qual_tmp.empty() || str_qual_tmp == ".")
+			bcf_float_set_missing(desc.qual);
+		else
+			desc.qual = (float) strtod(str_qual_tmp.c_str(), nullptr);
+	}
 
 	v_i_db_buf[id_db_pos].ReadInt64(pos);
 	pos += prev_pos;
@@ -721,26 +1054,50 @@ bool CCompressedFile::GetVariant(variant_desc_t &desc, vector<field_desc> &field
     {
 		int ii = v_data_nodes[i].first;		// Change of column ordering
 
-		if (v_i_buf[ii].IsEmpty())
+		if (ii == gt_key_id ? gt_cursor_empty() : v_i_buf[ii].IsEmpty())
 		{
 			unique_lock<mutex> lck(m_packages);
 
-			cv_packages.wait(lck, [&, this] {return v_packages[ii] != nullptr; });
+			{
+				TRACE_BLOCKED("package_wait", "queue");
+				cv_packages.wait(lck, [&, this] {return v_packages[ii] != nullptr; });
+			}
+
+			if (mem_governor)
+				mem_governor->Add(mem_component_t::packages, -package_memory(*v_packages[ii]));
 
 			if (v_packages[ii]->is_func)
 				v_i_buf[ii].SetFunction(v_packages[ii]->fun);
+			else if (ii == gt_key_id)
+				start_gt_cursor(v_packages[ii]);
 			else
 				v_i_buf[ii].SetBuffer(v_packages[ii]->v_size, v_packages[ii]->v_data);
 			delete v_packages[ii];
 			v_packages[ii] = nullptr;
 
+			if (mem_governor)
+			{
+				if (ii == gt_key_id)
+				{
+					update_buffer_memory(ii, (int64_t) (v_vios_i.capacity() + v_gt_cursor_size.capacity() * sizeof(uint32_t)));
+					update_context_memory(ii);
+				}
+				else
+					update_buffer_memory(ii, v_i_buf[ii]);
+			}
+
+			if (uses_sample_order(ii))
+				compute_sample_order(v_sample_order_next[ii]);
+
 			q_preparation_ids->Push(make_pair(ii, -1));
 		}
 
 		switch (keys[ii].type)
 		{
 		case BCF_HT_INT:
-			if(m_data_nodes[ii])
+			if (ii == gt_key_id)
+				decode_gt_variant(fields[ii].data, fields[ii].data_size);
+			else if(m_data_nodes[ii])
 				v_i_buf[ii].ReadInt(fields[ii].data, fields[ii].data_size);
 			else
 				v_i_buf[ii].FuncInt(fields[ii].data, fields[ii].data_size, fields[m_data_edges[ii]].data, fields[m_data_edges[ii]].data_size);
@@ -766,6 +1123,12 @@ bool CCompressedFile::GetVariant(variant_desc_t &desc, vector<field_desc> &field
 			break;
 		}
     }
+
+	if (end_key_id >= 0)
+		delta_end(fields, desc.pos, false);
+
+	if (sample_order_mode)
+		update_gt_window(fields[gt_key_id]);
     
 	++i_variant;
 
@@ -773,47 +1136,189 @@ bool CCompressedFile::GetVariant(variant_desc_t &desc, vector<field_desc> &field
 }
 
 // ************************************************************************************
-bool CCompressedFile::SetVariant(variant_desc_t &desc, vector<field_desc> &fields)
+void CCompressedFile::push_key_part(uint32_t i)
 {
-    // Store variant description
-	v_o_db_buf[id_db_chrom].WriteText((char*) desc.chrom.c_str(), (uint32_t) desc.chrom.size());
-	v_o_db_buf[id_db_pos].WriteInt64(desc.pos - prev_pos);
-	v_o_db_buf[id_db_id].WriteText((char*) desc.id.c_str(), (uint32_t) desc.id.size());
-	v_o_db_buf[id_db_ref].WriteText((char*) desc.ref.c_str(), (uint32_t) desc.ref.size());
-	v_o_db_buf[id_db_alt].WriteText((char*) desc.alt.c_str(), (uint32_t) desc.alt.size());
-	v_o_db_buf[id_db_qual].WriteText((char*) desc.qual.c_str(), (uint32_t) desc.qual.size());
+	auto part_id = archive->AddPartPrepare(v_buf_ids_size[i]);
+	archive->AddPartPrepare(v_buf_ids_data[i]);
+
+	vector<uint32_t> v_size;
+	vector<uint8_t> v_data;
+	vector<uint8_t> v_aux;
+	
+	v_o_buf[i].GetBuffer(v_size, v_data);
+
+	SPackage pck((int) i != gt_key_id ? SPackage::package_t::fields : SPackage::package_t::gt, i, -1, v_buf_ids_size[i], v_buf_ids_data[i], part_id, v_size, v_data, v_aux);
+
+	if (uses_sample_order(i))
+	{
+		pck.v_sample_order = v_sample_order_prev[i];
+		v_sample_order_pending[i] = 1;
+	}
+
+	{
+		unique_lock<mutex> lck(m_packages);
 
-	for(uint32_t i = 0; i < no_db_fields; ++i)
-		if (v_o_db_buf[i].IsFull())
 		{
-			auto part_id = archive->AddPartPrepare(v_db_ids_size[i]);
-			archive->AddPartPrepare(v_db_ids_data[i]);
+			TRACE_BLOCKED("package_backpressure", "queue");
+			cv_packages.wait(lck, [&, this] {return v_cnt_packages[i] < max_cnt_packages; });
+		}
+		++v_cnt_packages[i];
+	}
 
-			vector<uint32_t> v_size;
-			vector<uint8_t> v_data;
-			vector<uint8_t> v_aux;
+	if (mem_governor)
+		mem_governor->Add(mem_component_t::packages, package_memory(pck));
 
-			v_o_db_buf[i].GetBuffer(v_size, v_data);
+	size_t work = package_work(pck);
+	q_packages->Push(i, part_id, move(pck), work);
+}
 
-			SPackage pck(SPackage::package_t::db, -1, i, v_db_ids_size[i], v_db_ids_data[i], part_id, v_size, v_data, v_aux);
+// ************************************************************************************
+void CCompressedFile::push_db_part(uint32_t i)
+{
+	auto part_id = archive->AddPartPrepare(v_db_ids_size[i]);
+	archive->AddPartPrepare(v_db_ids_data[i]);
 
-			{
-				unique_lock<mutex> lck(m_packages);
+	vector<uint32_t> v_size;
+	vector<uint8_t> v_data;
+	vector<uint8_t> v_aux;
 
-				cv_packages.wait(lck, [&, this] {return v_cnt_db_packages[i] < max_cnt_packages; });
-				++v_cnt_db_packages[i];
-			}
+	v_o_db_buf[i].GetBuffer(v_size, v_data);
+
+	SPackage pck(SPackage::package_t::db, -1, i, v_db_ids_size[i], v_db_ids_data[i], part_id, v_size, v_data, v_aux);
+
+	{
+		unique_lock<mutex> lck(m_packages);
 
-			q_packages->Push(pck);
+		{
+			TRACE_BLOCKED("package_backpressure", "queue");
+			cv_packages.wait(lck, [&, this] {return v_cnt_db_packages[i] < max_cnt_packages; });
 		}
+		++v_cnt_db_packages[i];
+	}
+
+	if (mem_governor)
+		mem_governor->Add(mem_component_t::packages, package_memory(pck));
+
+	size_t work = package_work(pck);
+	q_packages->Push(no_keys + i, part_id, move(pck), work);
+}
+
+// ************************************************************************************
+// Parts of all streams end at the current variant
+void CCompressedFile::flush_row_group()
+{
+	for (uint32_t i = 0; i < no_keys; ++i)
+		push_key_part(i);
+
+	for (uint32_t i = 0; i < no_db_fields; ++i)
+		push_db_part(i);
+
+	v_row_groups.push_back(no_row_group_variants);
+	no_row_group_variants = 0;
+
+	start_row_group();
+}
+
+// ************************************************************************************
+// Site-level fields of a row group are coded without the state of the preceding groups
+void CCompressedFile::start_row_group()
+{
+	prev_pos = 0;
+	allele_codec.Reset();
+}
+
+// ************************************************************************************
+// Orders of samples for the parts following the ones just pushed
+void CCompressedFile::update_sample_orders()
+{
+	for (uint32_t i = 0; i < no_keys; ++i)
+		if (v_sample_order_pending[i])
+		{
+			v_sample_order_prev[i] = move(v_sample_order_cur[i]);
+			compute_sample_order(v_sample_order_cur[i]);
+			v_sample_order_pending[i] = 0;
+		}
+}
+
+// ************************************************************************************
+// Append-only archive: all buffered data are pushed as parts and, when they are written, a checkpoint is made;
+// the state of the codecs is stored, so compression can be resumed from this point
+bool CCompressedFile::Checkpoint(CState& state)
+{
+	if (open_mode != open_mode_t::writing || !archive->IsAppendOnly())
+		return false;
+
+	if (row_group_size)
+	{
+		if (no_row_group_variants)
+			flush_row_group();
+	}
+	else
+	{
+		for (uint32_t i = 0; i < no_keys; ++i)
+			if (v_o_buf[i].HasData())
+				push_key_part(i);
+
+		for (uint32_t i = 0; i < no_db_fields; ++i)
+			if (v_o_db_buf[i].HasData())
+				push_db_part(i);
+	}
+
+	if (sample_order_mode)
+		update_sample_orders();
+
+	q_packages->WaitForIdle();
+
+	if (!archive->Checkpoint())
+		return false;
+
+	state.Write((uint64_t) archive->GetCheckpointOffset());
+	save_state(state);
+
+	return true;
+}
+
+// ************************************************************************************
+bool CCompressedFile::SetVariant(variant_desc_t &desc, vector<field_desc> &fields)
+{
+    // Store variant description
+	v_o_db_buf[id_db_chrom].WriteText((char*) desc.chrom.c_str(), (uint32_t) desc.chrom.size());
+	v_o_db_buf[id_db_pos].WriteInt64(desc.pos - prev_pos);
+	v_o_db_buf[id_db_id].WriteText((char*) desc.id.c_str(), (uint32_t) desc.id.size());
+
+	allele_codec.EncodeRef(desc.ref, v_allele_tmp);
+	v_o_db_buf[id_db_ref].WriteText((char*) v_allele_tmp.data(), (uint32_t) v_allele_tmp.size());
+	allele_codec.EncodeAlt(desc.alt, v_allele_tmp);
+	v_o_db_buf[id_db_alt].WriteText((char*) v_allele_tmp.data(), (uint32_t) v_allele_tmp.size());
+
+	if (bcf_float_is_missing(desc.qual))
+		v_o_db_buf[id_db_qual].WriteReal(nullptr, 0);
+	else if (quantizer.IsEnabled())
+	{
+		float qual = desc.qual;
+		quantizer.QuantizeQual(qual);
+		v_o_db_buf[id_db_qual].WriteReal((char*) &qual, 1);
+	}
+	else
+		v_o_db_buf[id_db_qual].WriteReal((char*) &desc.qual, 1);
+
+	if (!row_group_size)
+		for(uint32_t i = 0; i < no_db_fields; ++i)
+			if (v_o_db_buf[i].IsFull())
+				push_db_part(i);
 
 	prev_pos = desc.pos;
 
+	if (end_key_id >= 0)
+		delta_end(fields, desc.pos, true);
+
     for(uint32_t i = 0; i < no_keys; i++)
     {
 		switch (keys[i].type)
 		{
 		case BCF_HT_INT:
+			if (fields[i].present && quantizer.IsBound(i))
+				quantizer.QuantizeInt(i, fields[i].data, fields[i].data_size, no_samples);
 			v_o_buf[i].WriteInt(fields[i].data, fields[i].present ? fields[i].data_size : 0);
 
 #ifdef LOG_INFO
@@ -846,31 +1351,36 @@ bool CCompressedFile::SetVariant(variant_desc_t &desc, vector<field_desc> &field
 			break;
 		}
 
-		if (v_o_buf[i].IsFull())
-		{
-			auto part_id = archive->AddPartPrepare(v_buf_ids_size[i]);
-			archive->AddPartPrepare(v_buf_ids_data[i]);
+		if (!row_group_size && v_o_buf[i].IsFull())
+			push_key_part(i);
+    }
 
-			vector<uint32_t> v_size;
-			vector<uint8_t> v_data;
-			vector<uint8_t> v_aux;
-			
-			v_o_buf[i].GetBuffer(v_size, v_data);
+	if (end_key_id >= 0)
+		delta_end(fields, desc.pos, false);
 
-			SPackage pck((int) i != gt_key_id ? SPackage::package_t::fields : SPackage::package_t::gt, i, -1, v_buf_ids_size[i], v_buf_ids_data[i], part_id, v_size, v_data, v_aux);
+	if (sample_order_mode)
+	{
+		update_gt_window(fields[gt_key_id]);
+		update_sample_orders();
+	}
 
-			{
-				unique_lock<mutex> lck(m_packages);
+	++no_variants;
 
-				cv_packages.wait(lck, [&, this] {return v_cnt_packages[i] < max_cnt_packages; });
-				++v_cnt_packages[i];
-			}
+	if (row_group_size)
+	{
+		bool full = ++no_row_group_variants >= row_group_size;
 
-			q_packages->Push(pck);
-		}
-    }
+		for (uint32_t i = 0; i < no_keys && !full; ++i)
+			full = v_o_buf[i].IsFull();
+		for (uint32_t i = 0; i < no_db_fields && !full; ++i)
+			full = v_o_db_buf[i].IsFull();
 
-	++no_variants;
+		if (full)
+			flush_row_group();
+	}
+
+	if (mem_governor)
+		adapt_to_memory_budget();
 
 	return true;
 }
@@ -30,14 +30,22 @@
 #include "buffer.h"
 #include "queue.h"
 #include "text_pp.h"
+#include "annot.h"
 #include "format.h"
 #include "graph_opt.h"
+#include "allele.h"
+#include "stats.h"
+#include "mem_governor.h"
+#include "quant.h"
+#include "state.h"
 
 using namespace std;
 
 // ************************************************************************************
 class CCompressedFile
 {
+	friend class CBenchAccess;		// microbenchmarks of the GT run-length coder (bench/)
+
 	CVectorIOStream *vios_i;
 	CVectorIOStream *vios_o;
 
@@ -63,6 +71,47 @@ class CCompressedFile
 	const uint32_t id_db_qual = 5;
 	const uint32_t no_db_fields = 6;
 
+	// Optional features of the archive (stored at the end of db_params; absent in older archives)
+	const uint32_t feature_allele_codec = 1u << 0;
+	const uint32_t feature_binary_qual = 1u << 1;
+	const uint32_t feature_gvcf = 1u << 2;
+	const uint32_t feature_lossy = 1u << 3;
+	const uint32_t feature_sample_order = 1u << 4;
+	const uint32_t feature_annot_columns = 1u << 5;
+	const uint32_t feature_row_groups = 1u << 6;
+
+	uint32_t archive_features;
+
+	// gVCF mode: INFO/END (if present) stored as a delta against POS, symbolic ALTs as tags, FORMAT in block mode
+	bool gvcf_mode;
+	int end_key_id;
+
+	// Lossy quantisation of FORMAT fields and QUAL (only the profile is stored in the archive)
+	CQuantizer quantizer;
+
+	// FORMAT values coded in PBWT order of samples: the order for a part is computed from GT of the sample_order_window
+	// variants preceding the start of the previous part, so the decoder knows it when the part is requested
+	const uint32_t sample_order_window = 16;
+	bool sample_order_mode;
+	vector<vector<uint8_t>> v_gt_window;
+	uint64_t no_gt_window_variants;
+	vector<uint32_t> v_sample_order_cache;
+	uint64_t sample_order_cache_variants;
+	vector<vector<uint32_t>> v_sample_order_prev;		// writing: order for the current part of a key
+	vector<vector<uint32_t>> v_sample_order_cur;		// writing: order for the next part of a key
+	vector<uint8_t> v_sample_order_pending;
+	vector<vector<uint32_t>> v_sample_order_next;		// reading: order for the requested part of a key
+
+	// Row groups: parts of all streams of variants end together every row_group_size variants (or earlier if any buffer
+	// is full) and each part is coded without the state of the preceding ones, so every group can be decoded on its own
+	uint32_t row_group_size;
+	uint64_t no_row_group_variants;
+	vector<uint64_t> v_row_groups;		// no. of variants in each completed group
+
+	CAlleleCodec allele_codec;
+	vector<uint8_t> v_allele_tmp;
+	string str_qual_tmp;
+
 	const array<string, 6> db_stream_name_size = { "db_chrom_size", "db_pos_size", "db_id_size", "db_ref_size", "db_alt_size", "db_qual_size" };
 	const array<string, 6> db_stream_name_data = { "idb_chrom_data", "idb_pos_data", "idb_id_data", "idb_ref_data", "idb_alt_data", "idb_qual_data" };
 
@@ -70,18 +119,15 @@ class CCompressedFile
 	vector<CBSCWrapper*> v_bsc_data;
 	vector<CTextPreprocessing> v_text_pp;
 
+	// Structured annotations (CSQ, ANN, BCSQ) are coded in columns: no. of subfields in the schema of a key (0 - plain text)
+	vector<uint32_t> v_annot_fields;
+
 	vector<CBSCWrapper*> v_bsc_db_size;
 	vector<CBSCWrapper*> v_bsc_db_data;
 
 	vector<CFormatCompress*> v_format_compress;
 
 	vector<thread> v_coder_threads;
-	mutex mtx_v_coder;
-	mutex mtx_v_text;
-	condition_variable cv_v_coder;
-	condition_variable cv_v_text;
-	vector<uint32_t> v_coder_part_ids;
-	vector<uint32_t> v_text_part_ids;
 
 #ifdef LOG_INFO
 	unordered_map<int, unordered_set<int>> distinct_values;
@@ -104,8 +150,19 @@ class CCompressedFile
 		int stream_id_src;
 		bool is_func;
 
+		// CPU time of the completed stages of compression (decompression of GT: time of reading the part)
+		double encode_time;
+
+		// Order of samples in which FORMAT values are coded (empty - file order)
+		vector<uint32_t> v_sample_order;
+
+		// Text part coded in columns of annotations (decided in preprocessing)
+		bool annot_columns;
+
 		SPackage()
 		{
+			annot_columns = false;
+			encode_time = 0;
 			type = package_t::fields;
 			key_id = -1;
 			db_id = -1;
@@ -129,6 +186,8 @@ class CCompressedFile
 			v_data = move(_v_data);
 			v_compressed = move(_v_compressed);
 			is_func = false;
+			encode_time = 0;
+			annot_columns = false;
 
 			_v_size.clear();
 			_v_data.clear();
@@ -145,6 +204,8 @@ class CCompressedFile
 			stream_id_src = _stream_id_src;
 			part_id = _part_id;
 			is_func = true;
+			encode_time = 0;
+			annot_columns = false;
 
 			fun = move(_fun);
 		}
@@ -154,7 +215,8 @@ class CCompressedFile
 	CArchive *tmp_archive;
 	string archive_name;
 
-	CRegisteringQueue<SPackage>* q_packages;
+	// Compression: stream ids are key ids followed by db fields; text keys have 2 stages (preprocessing, coding)
+	COrderedScheduler<SPackage>* q_packages;
 	CRegisteringQueue<pair<int, int>>* q_preparation_ids;
 
 	vector<SPackage*> v_packages;
@@ -170,7 +232,25 @@ class CCompressedFile
 	const uint32_t max_buffer_db_size = 8 << 20;
 
 	const size_t pp_compress_flag = 1u << 30;
-	const int max_cnt_packages = 3;
+	const size_t annot_compress_flag = (size_t) 1 << 40;
+	const int default_max_cnt_packages = 3;
+
+	// Smallest part sizes allowed when the memory budget is tight
+	const uint32_t min_buffer_size = 256 << 10;
+	const uint32_t min_buffer_gt_size = 4 << 20;
+
+	// Current limits (may be lowered to fit the memory budget)
+	int max_cnt_packages;
+	uint32_t cur_buffer_size;
+	uint32_t cur_buffer_gt_size;
+	uint32_t cur_buffer_db_size;
+
+	// Optional memory accounting (--max-memory)
+	CMemoryGovernor* mem_governor;
+	vector<int64_t> v_ctx_memory;
+	vector<int64_t> v_i_buf_memory;
+	uint32_t no_variants_since_adapt;
+	const uint32_t adapt_memory_interval = 1024;
 
 	const bsc_params_t p_bsc_size = { 25, 16, 128, LIBBSC_CODER_QLFC_ADAPTIVE };
 	const bsc_params_t p_bsc_data = { 25, 16, 64, LIBBSC_CODER_QLFC_ADAPTIVE };
@@ -196,10 +276,28 @@ class CCompressedFile
 
     CPBWT pbwt;
 	bool pbwt_initialised;
+
+	// Reading: a GT part is kept range-coded and each variant is decoded and PBWT-reversed when requested
+	vector<uint32_t> v_gt_cursor_size;		// no. of haplotypes of variants of the current part
+	size_t gt_cursor_pos;
+	bool gt_cursor_no_data;
+	double gt_cursor_time;
+	size_t gt_cursor_bytes;
+	vector<pair<uint32_t, uint32_t>> v_gt_cursor_rle;
+	vector<uint32_t> v_gt_cursor_output;
 	uint32_t no_coder_threads;
 
 	enum class open_mode_t {none, reading, writing} open_mode;
 
+	// Optional statistics collector (items are keys followed by db fields)
+	CStats* stats;
+
+	// Site-level streams in a companion file (otherwise in a contiguous region of the archive)
+	bool use_hot_file;
+
+	// Append-only variant of the archive (also for the temporary archive written during compression)
+	bool append_only;
+
 	vector<uint8_t> v_rd_header, v_cd_header;
 	vector<uint8_t> v_rd_meta, v_cd_meta;
 	vector<uint8_t> v_rd_samples, v_cd_samples;
@@ -263,8 +361,8 @@ class CCompressedFile
 	inline ctx_map_e_t::value_type find_rce_coder(context_t ctx, uint32_t no_symbols, uint32_t max_log_counter);
 	inline ctx_map_d_t::value_type find_rcd_coder(context_t ctx, uint32_t no_symbols, uint32_t max_log_counter);
 
-	inline void encode_run_len(uint32_t symbol, uint32_t len);
-	inline void decode_run_len(uint32_t &symbol, uint32_t &len);
+	void encode_run_len(uint32_t symbol, uint32_t len);
+	void decode_run_len(uint32_t &symbol, uint32_t &len);
 
 	void append(vector<uint8_t> &v_comp, string x);
 	void append(vector<uint8_t> &v_comp, int64_t x);
@@ -279,12 +377,8 @@ class CCompressedFile
 	bool load_descriptions();
 	bool save_descriptions();
 
-	void lock_coder_compressor(SPackage& pck);
-	void unlock_coder_compressor(SPackage& pck);
-	void lock_text_compressor(SPackage& pck);
-	void unlock_text_compressor(SPackage& pck);
-	void skip_text_compressor(SPackage& pck);
-
+	bool use_text_pp(const SPackage& pck);
+	void preprocess_field(SPackage& pck);
 	void compress_field(SPackage& pck, vector<uint8_t> &v_compressed, vector<uint8_t> &v_tmp);
 	void decompress_field(SPackage* pck, size_t raw_size, vector<uint8_t>& v_tmp);
 
@@ -295,6 +389,9 @@ class CCompressedFile
 
 	void compress_gt(SPackage& pck);
 	void decompress_gt(SPackage* pck, size_t raw_size);
+	void start_gt_cursor(SPackage* pck);
+	bool gt_cursor_empty(void) const;
+	void decode_gt_variant(char* &p, uint32_t &size);
 
 	void compress_db(SPackage& pck, vector<uint8_t>& v_compressed, vector<uint8_t>& v_tmp);
 	void decompress_db(SPackage* pck, size_t raw_size, vector<uint8_t>& v_tmp);
@@ -308,7 +405,34 @@ class CCompressedFile
 	void load_nodes(string stream_name, vector<pair<int, bool>>& v_nodes);
 	void load_edges(string stream_name, vector<pair<int, int>>& v_edges, int no_keys);
 
-	void copy_stream(string stream_name);
+	void plan_memory_budget();
+	void adapt_to_memory_budget();
+	void update_context_memory(int key_id);
+	void update_buffer_memory(uint32_t buf_id, const CBuffer& buf);
+	void update_buffer_memory(uint32_t buf_id, int64_t mem);
+	int64_t package_memory(const SPackage& pck);
+	size_t package_work(const SPackage& pck);
+
+	string codec_name(uint32_t item_id);
+	void init_stats();
+	void update_stats_sizes();
+
+	void copy_stream(string stream_name, bool hot);
+	bool is_hot_key(int key_id);
+	bool is_transformed_key(int key_id);
+	bool uses_sample_order(int key_id);
+	void update_gt_window(const field_desc& gt);
+	void compute_sample_order(vector<uint32_t>& v_order);
+	void permute_samples(vector<uint32_t>& v_size, vector<uint8_t>& v_data, const vector<uint32_t>& v_order, bool forward);
+	void delta_end(vector<field_desc>& fields, int64_t pos, bool encode);
+	void update_sample_orders();
+	void push_key_part(uint32_t i);
+	void push_db_part(uint32_t i);
+	void flush_row_group();
+	void start_row_group();
+	void restart_format_codec(int key_id);
+	void save_state(CState& state);
+	bool load_state(CState& state);
 	void link_stream(string stream_name, string target_name);
 	void store_function(string stream_name, int src_id, function_size_item_t& func);
 	void store_function(string stream_name, int src_id, function_data_item_t& func);
@@ -320,7 +444,8 @@ public:
 	~CCompressedFile();
 
 	bool OpenForReading(string file_name);
-	bool OpenForWriting(string file_name, uint32_t _no_keys);
+	// With resume_state compression is continued from the checkpoint of an append-only archive (see Checkpoint)
+	bool OpenForWriting(string file_name, uint32_t _no_keys, CState* resume_state = nullptr);
 	bool OptimizeDB(function_size_graph_t&_function_size_graph, function_data_graph_t& _function_data_graph);
 	bool Close();
 
@@ -348,6 +473,18 @@ public:
 	void SetPloidy(int _ploidy);
 
 	void SetNoThreads(int _no_threads);
+	void SetStats(CStats* _stats);
+	void SetMemoryGovernor(CMemoryGovernor* _mem_governor);
+	void SetHotFile(bool _use_hot_file);
+	void SetAppendOnly(bool _append_only);
+	void SetGVCF(bool _gvcf_mode, int _end_key_id);
+	void SetQuantizer(const CQuantizer& _quantizer);
+	void SetSampleOrder(bool _sample_order_mode);
+	void SetAnnotationKey(uint32_t key_id, uint32_t no_fields);
+	void SetRowGroupSize(uint32_t _row_group_size);
+	// Reading: no. of variants in each row group (false if the archive is not divided into row groups)
+	bool GetRowGroups(vector<uint64_t>& _v_row_groups);
+	string GetLossyProfile();
 
 	int GetNeglectLimit();
 	void SetNeglectLimit(uint32_t _neglect_limit);
@@ -356,6 +493,9 @@ public:
 
 	bool GetVariant(variant_desc_t &desc, vector<field_desc> &fields);
 	bool SetVariant(variant_desc_t &desc, vector<field_desc> &fields);
+
+	// Append-only archives: write everything compressed so far and store the state needed to resume compression
+	bool Checkpoint(CState& state);
     
     bool InitPBWT();
 };
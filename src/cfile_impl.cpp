@@ -170,6 +170,43 @@ bool CCompressedFile::load_descriptions()
 		keys[i].type = (int8_t) tmp;
 	}
 
+	if (p_desc < v_desc.size())
+		read(v_desc, p_desc, archive_features);
+	else
+		archive_features = 0;
+
+	gvcf_mode = (archive_features & feature_gvcf) != 0;
+	end_key_id = -1;
+	if (gvcf_mode)
+	{
+		read(v_desc, p_desc, tmp32);
+		end_key_id = (int)tmp32;
+	}
+
+	if (archive_features & feature_lossy)
+	{
+		string profile;
+		read(v_desc, p_desc, profile);
+		quantizer.SetProfile(profile);
+	}
+
+	sample_order_mode = (archive_features & feature_sample_order) != 0;
+
+	v_annot_fields.assign(no_keys, 0);
+	if (archive_features & feature_annot_columns)
+	{
+		uint32_t no_annot_keys, key_id;
+
+		read(v_desc, p_desc, no_annot_keys);
+		for (uint32_t i = 0; i < no_annot_keys; ++i)
+		{
+			read(v_desc, p_desc, key_id);
+			read(v_desc, p_desc, tmp32);
+			if (key_id < no_keys)
+				v_annot_fields[key_id] = tmp32;
+		}
+	}
+
 	// Load variant descriptions
 	for (auto d : {
 		make_tuple(ref(v_rd_meta), ref(v_cd_meta), ref(p_meta), 4, "meta"),
@@ -229,6 +266,22 @@ bool CCompressedFile::save_descriptions()
 		append_fixed(v_desc, keys[i].type, 1);
 	}
 
+	append(v_desc, archive_features);
+	if (archive_features & feature_gvcf)
+		append(v_desc, end_key_id);
+	if (archive_features & feature_lossy)
+		append(v_desc, quantizer.GetProfile());
+	if (archive_features & feature_annot_columns)
+	{
+		append(v_desc, (uint32_t) count_if(v_annot_fields.begin(), v_annot_fields.end(), [](uint32_t x) {return x != 0; }));
+		for (uint32_t i = 0; i < no_keys; ++i)
+			if (v_annot_fields[i])
+			{
+				append(v_desc, i);
+				append(v_desc, v_annot_fields[i]);
+			}
+	}
+
 	auto stream_id = archive->RegisterStream("db_params");
 	archive->AddPart(stream_id, v_desc);
 	archive->SetRawSize(stream_id, v_desc.size());
@@ -262,74 +315,44 @@ bool CCompressedFile::save_descriptions()
 }
 
 // ************************************************************************************
-void CCompressedFile::lock_coder_compressor(SPackage& pck)
+bool CCompressedFile::use_text_pp(const SPackage& pck)
 {
-	unique_lock<mutex> lck(mtx_v_coder);
-	cv_v_coder.wait(lck, [&, this] {
-		int sid = pck.key_id;
-		if (pck.type == SPackage::package_t::db)
-			sid = no_keys + pck.db_id;
-
-		return (int) v_coder_part_ids[sid] == pck.part_id;
-		});
+	return keys[pck.key_id].type == BCF_HT_STR && 64 * pck.v_size.size() < pck.v_data.size();
 }
 
 // ************************************************************************************
-void CCompressedFile::unlock_coder_compressor(SPackage& pck)
+// 1st stage of compression of text fields; the preprocessed data are kept in v_compressed
+void CCompressedFile::preprocess_field(SPackage& pck)
 {
-	lock_guard<mutex> lck(mtx_v_coder);
-	int sid = pck.key_id;
-	if (pck.type == SPackage::package_t::db)
-		sid = no_keys + pck.db_id;
+	TRACE_BUSY("preprocess_field", "codec");
 
-	++v_coder_part_ids[sid];
-	cv_v_coder.notify_all();
-}
+	pck.annot_columns = false;
 
-// ************************************************************************************
-void CCompressedFile::lock_text_compressor(SPackage& pck)
-{
-	unique_lock<mutex> lck(mtx_v_text);
-	cv_v_text.wait(lck, [&, this] {
-		int sid = pck.key_id;
-		if (pck.type == SPackage::package_t::db)
-			sid = no_keys + pck.db_id;
-
-		return (int) v_text_part_ids[sid] == pck.part_id;
-		});
-}
-
-// ************************************************************************************
-void CCompressedFile::unlock_text_compressor(SPackage& pck)
-{
-	lock_guard<mutex> lck(mtx_v_text);
-	int sid = pck.key_id;
-	if (pck.type == SPackage::package_t::db)
-		sid = no_keys + pck.db_id;
-
-	++v_text_part_ids[sid];
-	cv_v_text.notify_all();
-}
-
-// ************************************************************************************
-void CCompressedFile::skip_text_compressor(SPackage& pck)
-{
-	unique_lock<mutex> lck(mtx_v_text);
-	int sid = pck.key_id;
-	if (pck.type == SPackage::package_t::db)
-		sid = no_keys + pck.db_id;
+	// Annotations not following the schema are coded as plain text
+	// Packages are already coded in parallel by the coder threads, so the columns of a part are coded in this thread only
+	if (pck.v_data.size() && v_annot_fields[pck.key_id])
+	{
+		CAnnotationCodec annot_codec(v_annot_fields[pck.key_id], 1);
 
-	cv_v_text.wait(lck, [&, this] {
-		return (int) v_text_part_ids[sid] == pck.part_id;
-		});
+		pck.annot_columns = annot_codec.Encode(pck.v_size, pck.v_data, pck.v_compressed);
+	}
 
-	++v_text_part_ids[sid];
-	cv_v_text.notify_all();
+	if (!pck.annot_columns && use_text_pp(pck))
+	{
+		if (archive_features & feature_row_groups)
+		{
+			CTextPreprocessing text_pp;
+			text_pp.EncodeText(pck.v_data, pck.v_compressed);
+		}
+		else
+			v_text_pp[pck.key_id].EncodeText(pck.v_data, pck.v_compressed);
+	}
 }
 
 // ************************************************************************************
 void CCompressedFile::compress_field(SPackage& pck, vector<uint8_t>& v_compressed, vector<uint8_t>& v_tmp)
 {
+	TRACE_BUSY("compress_field", "codec");
 	CBSCWrapper* bsc_size = v_bsc_size[pck.key_id];
 	CBSCWrapper* bsc_data = v_bsc_data[pck.key_id];
 	size_t raw_size;
@@ -338,22 +361,21 @@ void CCompressedFile::compress_field(SPackage& pck, vector<uint8_t>& v_compresse
 	{
 		bool is_pp_compressed = false;
 
-		if (keys[pck.key_id].type == BCF_HT_STR && 64 * pck.v_size.size() < pck.v_data.size())
+		if (pck.annot_columns)
+		{
+			// Columns are already compressed
+			v_compressed = pck.v_compressed;
+			raw_size = pck.v_data.size() + annot_compress_flag;
+		}
+		else if (use_text_pp(pck))
 		{
-			vector<uint8_t> v_pp;
-			lock_text_compressor(pck);
-			v_text_pp[pck.key_id].EncodeText(pck.v_data, v_pp);
-			unlock_text_compressor(pck);
-			lock_coder_compressor(pck);
-			bsc_data->Compress(v_pp, v_compressed);
-			raw_size = v_pp.size();
+			bsc_data->Compress(pck.v_compressed, v_compressed);
+			raw_size = pck.v_compressed.size();
 
 			is_pp_compressed = true;
 		}
 		else
 		{
-			skip_text_compressor(pck);
-			lock_coder_compressor(pck);
 			bsc_data->Compress(pck.v_data, v_compressed);
 			raw_size = pck.v_data.size();
 		}
@@ -363,7 +385,6 @@ void CCompressedFile::compress_field(SPackage& pck, vector<uint8_t>& v_compresse
 	else
 	{
 		v_compressed.clear();
-		skip_text_compressor(pck);
 		archive->AddPartComplete(pck.stream_id_data, pck.part_id, v_compressed, pck.v_data.size());
 	}
 
@@ -372,13 +393,12 @@ void CCompressedFile::compress_field(SPackage& pck, vector<uint8_t>& v_compresse
 
 	bsc_size->Compress(v_tmp, v_compressed);
 	archive->AddPartComplete(pck.stream_id_size, pck.part_id, v_compressed, pck.v_size.size());
-
-	unlock_coder_compressor(pck);
 }
 
 // ************************************************************************************
 void CCompressedFile::decompress_field(SPackage* pck, size_t raw_size, vector<uint8_t>& v_tmp)
 {
+	TRACE_BUSY("decompress_field", "codec");
 	if (pck->is_func)
 	{
 		load_function("func_" + to_string(pck->key_id) + "_data", pck->stream_id_src, pck->fun);
@@ -399,6 +419,19 @@ void CCompressedFile::decompress_field(SPackage* pck, size_t raw_size, vector<ui
 
 	archive->GetPart(pck->stream_id_data, pck->v_compressed, raw_size);
 
+	if (raw_size >= annot_compress_flag)
+	{
+		CAnnotationCodec annot_codec(v_annot_fields[pck->key_id], 1);
+
+		if (!annot_codec.Decode(pck->v_size, pck->v_compressed, pck->v_data) || pck->v_data.size() != raw_size - annot_compress_flag)
+		{
+			std::cerr << "Corrupted archive!\n";
+			exit(1);
+		}
+
+		return;
+	}
+
 	bool is_pp_compressed = false;
 
 	if (raw_size >= pp_compress_flag)
@@ -416,7 +449,14 @@ void CCompressedFile::decompress_field(SPackage* pck, size_t raw_size, vector<ui
 		if (is_pp_compressed)
 		{
 			vector<uint8_t> v_decompressed;
-			v_text_pp[pck->key_id].DecodeText(pck->v_data, v_decompressed);
+
+			if (archive_features & feature_row_groups)
+			{
+				CTextPreprocessing text_pp;
+				text_pp.DecodeText(pck->v_data, v_decompressed);
+			}
+			else
+				v_text_pp[pck->key_id].DecodeText(pck->v_data, v_decompressed);
 			swap(pck->v_data, v_decompressed);
 		}
 	}
@@ -425,14 +465,19 @@ void CCompressedFile::decompress_field(SPackage* pck, size_t raw_size, vector<ui
 // ************************************************************************************
 void CCompressedFile::compress_format(SPackage& pck, vector<uint8_t>& v_compressed, vector<uint8_t>& v_tmp)
 {
+	TRACE_BUSY("compress_format", "codec");
 	CBSCWrapper* bsc_size = v_bsc_size[pck.key_id];
+
+	if (archive_features & feature_row_groups)
+		restart_format_codec(pck.key_id);
 	CFormatCompress* format_compress = v_format_compress[pck.key_id];
 //	size_t raw_size;
 
 	if (pck.v_data.size())
 	{
-		skip_text_compressor(pck);
-		lock_coder_compressor(pck);
+		if (!pck.v_sample_order.empty())
+			permute_samples(pck.v_size, pck.v_data, pck.v_sample_order, true);
+
 		format_compress->EncodeFormat(pck.v_size, pck.v_data, v_compressed);
 
 		archive->AddPartComplete(pck.stream_id_data, pck.part_id, v_compressed, pck.v_data.size());
@@ -440,7 +485,6 @@ void CCompressedFile::compress_format(SPackage& pck, vector<uint8_t>& v_compress
 	else
 	{
 		v_compressed.clear();
-		skip_text_compressor(pck);
 		archive->AddPartComplete(pck.stream_id_data, pck.part_id, v_compressed, pck.v_data.size());
 	}
 
@@ -450,12 +494,13 @@ void CCompressedFile::compress_format(SPackage& pck, vector<uint8_t>& v_compress
 	bsc_size->Compress(v_tmp, v_compressed);
 	archive->AddPartComplete(pck.stream_id_size, pck.part_id, v_compressed, pck.v_size.size());
 
-	unlock_coder_compressor(pck);
+	update_context_memory(pck.key_id);
 }
 
 // ************************************************************************************
 void CCompressedFile::decompress_format(SPackage* pck, size_t raw_size, vector<uint8_t>& v_tmp)
 {
+	TRACE_BUSY("decompress_format", "codec");
 	if (pck->is_func)
 	{
 		load_function("func_" + to_string(pck->key_id) + "_data", pck->stream_id_src, pck->fun);
@@ -467,6 +512,9 @@ void CCompressedFile::decompress_format(SPackage* pck, size_t raw_size, vector<u
 	pck->stream_id_data = archive->GetStreamId("key_" + to_string(pck->key_id) + "_data");
 
 	CBSCWrapper* bsc_size = v_bsc_size[pck->key_id];
+
+	if (archive_features & feature_row_groups)
+		restart_format_codec(pck->key_id);
 	CFormatCompress* format_compress = v_format_compress[pck->key_id];
 
 	bsc_size->Decompress(pck->v_compressed, v_tmp);
@@ -487,20 +535,27 @@ void CCompressedFile::decompress_format(SPackage* pck, size_t raw_size, vector<u
 	pck->v_data.resize(raw_size);
 
 	if (raw_size)
+	{
 		format_compress->DecodeFormat(pck->v_size, pck->v_compressed, pck->v_data);
+
+		if (uses_sample_order(pck->key_id) && !v_sample_order_next[pck->key_id].empty())
+			permute_samples(pck->v_size, pck->v_data, v_sample_order_next[pck->key_id], false);
+	}
 }
 
 // ************************************************************************************
 void CCompressedFile::compress_info(SPackage& pck, vector<uint8_t>& v_compressed, vector<uint8_t>& v_tmp)
 {
+	TRACE_BUSY("compress_info", "codec");
 	CBSCWrapper* bsc_size = v_bsc_size[pck.key_id];
+
+	if (archive_features & feature_row_groups)
+		restart_format_codec(pck.key_id);
 	CFormatCompress* format_compress = v_format_compress[pck.key_id];
 //	size_t raw_size;
 
 	if (pck.v_data.size())
 	{
-		skip_text_compressor(pck);
-		lock_coder_compressor(pck);
 		format_compress->EncodeInfo(pck.v_size, pck.v_data, v_compressed);
 
 		archive->AddPartComplete(pck.stream_id_data, pck.part_id, v_compressed, pck.v_data.size());
@@ -508,7 +563,6 @@ void CCompressedFile::compress_info(SPackage& pck, vector<uint8_t>& v_compressed
 	else
 	{
 		v_compressed.clear();
-		skip_text_compressor(pck);
 		archive->AddPartComplete(pck.stream_id_data, pck.part_id, v_compressed, pck.v_data.size());
 	}
 
@@ -518,12 +572,13 @@ void CCompressedFile::compress_info(SPackage& pck, vector<uint8_t>& v_compressed
 	bsc_size->Compress(v_tmp, v_compressed);
 	archive->AddPartComplete(pck.stream_id_size, pck.part_id, v_compressed, pck.v_size.size());
 
-	unlock_coder_compressor(pck);
+	update_context_memory(pck.key_id);
 }
 
 // ************************************************************************************
 void CCompressedFile::decompress_info(SPackage* pck, size_t raw_size, vector<uint8_t>& v_tmp)
 {
+	TRACE_BUSY("decompress_info", "codec");
 	if (pck->is_func)
 	{
 		load_function("func_" + to_string(pck->key_id) + "_data", pck->stream_id_src, pck->fun);
@@ -535,6 +590,9 @@ void CCompressedFile::decompress_info(SPackage* pck, size_t raw_size, vector<uin
 	pck->stream_id_data = archive->GetStreamId("key_" + to_string(pck->key_id) + "_data");
 
 	CBSCWrapper* bsc_size = v_bsc_size[pck->key_id];
+
+	if (archive_features & feature_row_groups)
+		restart_format_codec(pck->key_id);
 	CFormatCompress* format_compress = v_format_compress[pck->key_id];
 
 	bsc_size->Decompress(pck->v_compressed, v_tmp);
@@ -553,6 +611,7 @@ void CCompressedFile::decompress_info(SPackage* pck, size_t raw_size, vector<uin
 // ************************************************************************************
 void CCompressedFile::compress_db(SPackage& pck, vector<uint8_t>& v_compressed, vector<uint8_t>& v_tmp)
 {
+	TRACE_BUSY("compress_db", "codec");
 	CBSCWrapper* bsc_size = v_bsc_db_size[pck.db_id];
 	CBSCWrapper* bsc_data = v_bsc_db_data[pck.db_id];
 	size_t raw_size;
@@ -560,8 +619,6 @@ void CCompressedFile::compress_db(SPackage& pck, vector<uint8_t>& v_compressed,
 	v_tmp.resize(pck.v_size.size() * 4);
 	copy_n((uint8_t*)pck.v_size.data(), v_tmp.size(), v_tmp.data());
 
-	lock_coder_compressor(pck);
-
 	bsc_size->Compress(v_tmp, v_compressed);
 	archive->AddPartComplete(pck.stream_id_size, pck.part_id, v_compressed, pck.v_size.size());
 
@@ -577,13 +634,12 @@ void CCompressedFile::compress_db(SPackage& pck, vector<uint8_t>& v_compressed,
 		v_compressed.clear();
 		archive->AddPartComplete(pck.stream_id_data, pck.part_id, v_compressed, pck.v_data.size());
 	}
-
-	unlock_coder_compressor(pck);
 }
 
 // ************************************************************************************
 void CCompressedFile::decompress_db(SPackage* pck, size_t raw_size, vector<uint8_t>& v_tmp)
 {
+	TRACE_BUSY("decompress_db", "codec");
 	CBSCWrapper* bsc_size = v_bsc_db_size[pck->db_id];
 	CBSCWrapper* bsc_data = v_bsc_db_data[pck->db_id];
 
@@ -604,13 +660,19 @@ void CCompressedFile::decompress_db(SPackage* pck, size_t raw_size, vector<uint8
 // ************************************************************************************
 void CCompressedFile::compress_gt(SPackage& pck)
 {
+	TRACE_BUSY("compress_gt", "codec");
 	int i_vec = 0;
 	vector<uint32_t> v_tmp_reo;
 	vector<pair<uint32_t, uint32_t>> v_rle;
 
 	vector<uint32_t> v_res;
 
-	lock_coder_compressor(pck);
+	// Row groups: PBWT and models of run lengths start from scratch in every part
+	if ((archive_features & feature_row_groups) && pck.v_data.size())
+	{
+		pbwt.StartForward(no_samples * ploidy, neglect_limit);
+		rce_coders.clear();
+	}
 
 	// *** Reorganization of haplotypes
 	for (size_t i = 0; i < pck.v_data.size(); i += pck.v_size[i_vec++] * 4)
@@ -705,7 +767,7 @@ void CCompressedFile::compress_gt(SPackage& pck)
 		archive->AddPartComplete(pck.stream_id_data, pck.part_id, v_compressed, 0);
 	}
 
-	unlock_coder_compressor(pck);
+	update_context_memory(pck.key_id);
 }
 #endif
 
@@ -713,6 +775,7 @@ void CCompressedFile::compress_gt(SPackage& pck)
 // ************************************************************************************
 void CCompressedFile::compress_gt(SPackage& pck)
 {
+	TRACE_BUSY("compress_gt", "codec");
 	int i_vec = 0;
 	vector<uint32_t> v_tmp_reo;
 	vector<pair<uint32_t, uint32_t>> v_rle;
@@ -727,8 +790,6 @@ void CCompressedFile::compress_gt(SPackage& pck)
 		return;
 	}
 
-	lock_coder_compressor(pck);
-
 	// *** Reorganization of haplotypes
 	for (int i = 0; i < pck.v_data.size(); i += pck.v_size[i_vec++] * 4)
 	{
@@ -819,20 +880,23 @@ void CCompressedFile::compress_gt(SPackage& pck)
 
 	archive->AddPartComplete(pck.stream_id_data, pck.part_id, v_vios_o, raw_size);
 
-	unlock_coder_compressor(pck);
+	update_context_memory(pck.key_id);
 }
 #endif
 
 // ************************************************************************************
+// Only the sizes are decoded here; the run lengths stay range-coded in the package until start_gt_cursor()
 void CCompressedFile::decompress_gt(SPackage* pck, size_t raw_size)
 {
+	TRACE_BUSY("decompress_gt", "codec");
 	CBSCWrapper* bsc_size = v_bsc_size[pck->key_id];
-//	CBSCWrapper* bsc_data = v_bsc_data[pck->key_id];
+
+	pck->v_data.clear();
 
 	if (raw_size == 0)
 	{
-		pck->v_data.clear();
 		pck->v_size.clear();
+		pck->v_compressed.clear();
 
 		return;
 	}
@@ -845,93 +909,105 @@ void CCompressedFile::decompress_gt(SPackage* pck, size_t raw_size)
 
 	pck->stream_id_data = archive->GetStreamId("key_" + to_string(pck->key_id) + "_data");
 
-	archive->GetPart(pck->stream_id_data, pck->v_compressed, raw_size);
-	pck->v_data.resize(raw_size);
-
-	vector<pair<uint32_t, uint32_t>> v_full_rle;
+	size_t data_size;
+	archive->GetPart(pck->stream_id_data, pck->v_compressed, data_size);
 
-	if (raw_size)
-	{
-		v_vios_i = pck->v_compressed;
-		vios_i->RestartRead();
+	if (data_size == 0)
+		pck->v_compressed.clear();
+}
 
-		rcd->Start();
-		ctx_prefix = context_prefix_mask;
-		ctx_symbol = context_symbol_mask;
+// ************************************************************************************
+// Must be called by the thread reading variants (owns the range decoder of GT and the PBWT)
+void CCompressedFile::start_gt_cursor(SPackage* pck)
+{
+	v_gt_cursor_size = move(pck->v_size);
+	gt_cursor_pos = 0;
+	gt_cursor_no_data = v_gt_cursor_size.empty();
+	gt_cursor_time = pck->encode_time;
+	gt_cursor_bytes = v_gt_cursor_size.size() * 4;
 
-		size_t cur_size = 0;
-		int i_variant = 0;
+	if (gt_cursor_no_data)
+		return;
 
-		uint32_t symbol;
-		uint32_t len;
-		uint32_t cur_variant_size = 0;
+	v_vios_i = move(pck->v_compressed);
+	vios_i->RestartRead();
 
-		for (size_t i = 0; i < raw_size; i += 2)
-		{
-			decode_run_len(symbol, len);
-			if (len == 0)
-			{
-				ctx_prefix = context_prefix_mask;
-				ctx_symbol = context_symbol_mask;
-				len = pck->v_size[i_variant++] * no_samples - cur_variant_size;
-				cur_variant_size = 0;
-			}
-			else
-				cur_variant_size += len;
-
-			cur_size += len;
+	if (archive_features & feature_row_groups)
+	{
+		pbwt.StartReverse(no_samples * ploidy, neglect_limit);
+		rcd_coders.clear();
+	}
 
-			v_full_rle.emplace_back(symbol, len);
-		}
+	rcd->Start();
+}
 
-		rcd->End();
-	}
+// ************************************************************************************
+bool CCompressedFile::gt_cursor_empty(void) const
+{
+	return gt_cursor_pos >= v_gt_cursor_size.size() && !gt_cursor_no_data;
+}
 
-	// PBWT decoding
-	size_t total_data_size = 0;
-	for (auto& x : pck->v_size)
+// ************************************************************************************
+void CCompressedFile::decode_gt_variant(char* &p, uint32_t &size)
+{
+	if (gt_cursor_no_data)
 	{
-		x *= no_samples;
+		p = nullptr;
 
-		total_data_size += x;
+		return;
 	}
 
-	pck->v_data.resize(total_data_size * 4);
-
-	size_t i_data = 0;
+	TRACE_BUSY("decode_gt_variant", "codec");
 
-	int i_variant = 0;
-	vector<pair<uint32_t, uint32_t>> v_rle;
-	vector<uint32_t> v_output, vec;
+	double t_cpu = 0;
+	if (stats)
+		t_cpu = CStats::ThreadTime();
 
-	for (size_t i = 0; i < v_full_rle.size();)
-	{
-		uint32_t c_variant_len = 0;
-		uint32_t variant_size = pck->v_size[i_variant++];
+	uint32_t variant_size = v_gt_cursor_size[gt_cursor_pos++] * no_samples;
+	uint32_t cur_variant_size = 0;
+	uint32_t max_val = 0;
+	uint32_t symbol;
+	uint32_t len;
 
-		v_rle.clear();
+	// Runs of a variant are terminated by a run of length 0 (the remaining haplotypes)
+	v_gt_cursor_rle.clear();
+	ctx_prefix = context_prefix_mask;
+	ctx_symbol = context_symbol_mask;
 
-		uint32_t max_val = 0;
+	do
+	{
+		decode_run_len(symbol, len);
 
-		for (; c_variant_len < variant_size; ++i)
+		if (len == 0)
 		{
-			v_rle.emplace_back(v_full_rle[i]);
-			c_variant_len += v_full_rle[i].second;
-
-			if (v_full_rle[i].first > max_val)
-				max_val = v_full_rle[i].first;
+			v_gt_cursor_rle.emplace_back(symbol, variant_size - cur_variant_size);
+			cur_variant_size = variant_size;
+		}
+		else
+		{
+			v_gt_cursor_rle.emplace_back(symbol, len);
+			cur_variant_size += len;
 		}
 
-		pbwt.DecodeFlexible(max_val, v_rle, v_output);
+		if (symbol > max_val)
+			max_val = symbol;
+	} while (len != 0);
 
-		vec.resize(v_output.size());
+	pbwt.DecodeFlexible(max_val, v_gt_cursor_rle, v_gt_cursor_output);
 
-		uint32_t no_haplotypes = (uint32_t) (v_output.size() / no_samples);
+	size = (uint32_t) v_gt_cursor_output.size();
+
+	if (size)
+	{
+		p = new char[size * 4];
+		uint32_t* vec = (uint32_t*) p;
+
+		uint32_t no_haplotypes = size / no_samples;
 
 		for (uint32_t j = 0; j < no_haplotypes; ++j)
 			for (uint32_t k = 0; k < no_samples; ++k)
 			{
-				uint32_t gt_val = v_output[j * no_samples + k];
+				uint32_t gt_val = v_gt_cursor_output[j * no_samples + k];
 
 				if (gt_val == 0)
 					gt_val = 0x80000001u;
@@ -946,10 +1022,20 @@ void CCompressedFile::decompress_gt(SPackage* pck, size_t raw_size)
 			for (uint32_t k = 0; k < no_samples; ++k)
 				if (vec[k * no_haplotypes] & 1)
 					vec[k * no_haplotypes] -= 1;
+	}
+	else
+		p = nullptr;
 
+	if (gt_cursor_pos == v_gt_cursor_size.size())
+		rcd->End();
 
-		copy_n((uint8_t*)vec.data(), vec.size() * 4, pck->v_data.data() + i_data);
-		i_data += v_output.size() * 4;
+	if (stats)
+	{
+		gt_cursor_time += CStats::ThreadTime() - t_cpu;
+		gt_cursor_bytes += size * 4;
+
+		if (gt_cursor_pos == v_gt_cursor_size.size())
+			stats->AddDecode(gt_key_id, gt_cursor_bytes, gt_cursor_time);
 	}
 }
 
@@ -1152,15 +1238,24 @@ bool CCompressedFile::OptimizeDB(function_size_graph_t& _function_size_graph, fu
 	function_size_graph = _function_size_graph;
 	function_data_graph = _function_data_graph;
 
+	// Keys stored after a transformation cannot be sources or targets of functions between keys
+	for (auto p = function_data_graph.begin(); p != function_data_graph.end(); )
+		if (is_transformed_key(p->first.first) || is_transformed_key(p->first.second))
+			p = function_data_graph.erase(p);
+		else
+			++p;
+
 	if (tmp_archive)
 		delete tmp_archive;
 
 	tmp_archive = new CArchive(true);
 
+	double io_time = archive->GetIOTime();
+
 	string tmp_name = archive_name + "_vcfshark_tmp";
 	rename(archive_name.c_str(), tmp_name.c_str());
 
-	if (!tmp_archive->Open(tmp_name) || !archive->Open(archive_name))
+	if (!tmp_archive->Open(tmp_name) || !archive->Open(archive_name, use_hot_file, append_only))
 	{
 		std::cerr << "Cannot open archive\n";
 		exit(1);
@@ -1186,11 +1281,25 @@ bool CCompressedFile::OptimizeDB(function_size_graph_t& _function_size_graph, fu
 	store_nodes("data_nodes", v_data_nodes);
 	store_edges("data_edges", v_data_edges, (int) v_data_nodes.size());
 
-	// Przetwarzanie pl kluczy
+	// Site-level (hot) streams are copied first, so they form a contiguous region (or go to the companion file);
+	// FORMAT streams (cold) follow
+	for (auto sn : meta_stream_names)
+		copy_stream(sn, true);
+
+	for (bool hot : {true, false})
+	{
+		for (uint32_t i = 0; i < no_keys; ++i)
+			if (v_size_nodes[i].second && is_hot_key(v_size_nodes[i].first) == hot)
+				copy_stream("key_" + to_string(v_size_nodes[i].first) + "_size", hot);
+
+		for (uint32_t i = 0; i < no_keys; ++i)
+			if (v_data_nodes[i].second && is_hot_key(v_data_nodes[i].first) == hot)
+				copy_stream("key_" + to_string(v_data_nodes[i].first) + "_data", hot);
+	}
+
+	// Linked streams share parts with the copied ones
 	for (uint32_t i = 0; i < no_keys; ++i)
-		if (v_size_nodes[i].second)
-			copy_stream("key_" + to_string(v_size_nodes[i].first) + "_size");
-		else
+		if (!v_size_nodes[i].second)
 		{
 			pair<int, int> pid;
 
@@ -1202,9 +1311,7 @@ bool CCompressedFile::OptimizeDB(function_size_graph_t& _function_size_graph, fu
 		}
 
 	for (uint32_t i = 0; i < no_keys; ++i)
-		if (v_data_nodes[i].second)
-			copy_stream("key_" + to_string(v_data_nodes[i].first) + "_data");
-		else
+		if (!v_data_nodes[i].second)
 		{
 			pair<int, int> pid;
 
@@ -1216,12 +1323,17 @@ bool CCompressedFile::OptimizeDB(function_size_graph_t& _function_size_graph, fu
 //			store_function("func_" + to_string(v_data_nodes[i].first) + "_data", pid.first, function_data_graph[pid]);
 		}
 
-	for (auto sn : meta_stream_names)
-		copy_stream(sn);
+	// Parts are copied one to one, so the row groups are unchanged
+	vector<uint64_t> v_groups;
+	tmp_archive->GetRowGroups(v_groups);
+	archive->SetRowGroups(v_groups);
 
 	tmp_archive->Close();
 	archive->Close();
 	remove(tmp_name.c_str());
+
+	if (stats)
+		stats->AddStage(stats_stage_t::archive_io, archive->GetIOTime() - io_time + tmp_archive->GetIOTime());
 	cout << endl;
 
 	return true;
@@ -1376,7 +1488,7 @@ bool CCompressedFile::process_function_data_eq_only(int no_keys,
 // ******************************************************************************
 void CCompressedFile::store_nodes(string stream_name, vector<pair<int, bool>>& v_nodes)
 {
-	auto sid = archive->RegisterStream(stream_name);
+	auto sid = archive->RegisterStream(stream_name, true);
 
 	vector<uint8_t> vec;
 	uint32_t nb = (uint32_t) no_bytes(no_keys);
@@ -1420,7 +1532,7 @@ void CCompressedFile::load_nodes(string stream_name, vector<pair<int, bool>>& v_
 // ******************************************************************************
 void CCompressedFile::store_edges(string stream_name, vector<pair<int, int>>& v_edges, int no_keys)
 {
-	auto sid = archive->RegisterStream(stream_name);
+	auto sid = archive->RegisterStream(stream_name, true);
 
 	vector<uint8_t> vec;
 	uint32_t nb = (uint32_t) no_bytes(no_keys);
@@ -1463,10 +1575,10 @@ void CCompressedFile::load_edges(string stream_name, vector<pair<int, int>>& v_e
 }
 
 // ******************************************************************************
-void CCompressedFile::copy_stream(string stream_name)
+void CCompressedFile::copy_stream(string stream_name, bool hot)
 {
 	auto in_iks = tmp_archive->GetStreamId(stream_name);
-	auto out_iks = archive->RegisterStream(stream_name);
+	auto out_iks = archive->RegisterStream(stream_name, hot);
 	vector<uint8_t> vec;
 	size_t meta;
 
@@ -1477,6 +1589,157 @@ void CCompressedFile::copy_stream(string stream_name)
 	archive->SetRawSize(out_iks, tmp_archive->GetRawSize(in_iks));
 }
 
+// ******************************************************************************
+// In gVCF reference blocks END is close to POS, so the difference is stored (modulo 2^32, missing values are kept)
+void CCompressedFile::delta_end(vector<field_desc>& fields, int64_t pos, bool encode)
+{
+	auto& field = fields[end_key_id];
+
+	if (!field.present || field.data_size == 0)
+		return;
+
+	int32_t end;
+	memcpy(&end, field.data, sizeof(int32_t));
+
+	if (end == bcf_int32_missing || end == bcf_int32_vector_end)
+		return;
+
+	if (encode)
+		end = (int32_t)((uint32_t)end - (uint32_t)pos);
+	else
+		end = (int32_t)((uint32_t)end + (uint32_t)pos);
+
+	memcpy(field.data, &end, sizeof(int32_t));
+}
+
+// ******************************************************************************
+// END in gVCF mode and quantised FORMAT fields are stored after a transformation of values
+bool CCompressedFile::is_transformed_key(int key_id)
+{
+	return key_id == end_key_id || quantizer.IsBound(key_id);
+}
+
+// ******************************************************************************
+bool CCompressedFile::uses_sample_order(int key_id)
+{
+	return sample_order_mode && no_samples > 1 && key_id != gt_key_id && keys[key_id].keys_type == key_type_t::fmt && keys[key_id].type != BCF_HT_STR;
+}
+
+// ******************************************************************************
+// Genotype of each sample (first two alleles, 0 - missing, 1 - REF, 2 - ALT1, 3 - other) is stored in a window of recent variants
+void CCompressedFile::update_gt_window(const field_desc& gt)
+{
+	if (v_gt_window.size() != sample_order_window)
+		v_gt_window.assign(sample_order_window, vector<uint8_t>());
+
+	auto& v_codes = v_gt_window[no_gt_window_variants % sample_order_window];
+	v_codes.assign(no_samples, 0);
+
+	uint32_t no_haplotypes = (gt.present && no_samples) ? gt.data_size / no_samples : 0;
+
+	if (no_haplotypes)
+	{
+		const int32_t* p = (const int32_t*)gt.data;
+
+		for (uint32_t i = 0; i < no_samples; ++i, p += no_haplotypes)
+		{
+			uint8_t code = 0;
+
+			for (uint32_t j = 0; j < min(no_haplotypes, 2u); ++j)
+			{
+				int32_t x = p[j] == bcf_int32_vector_end ? 0 : (p[j] >> 1);
+				code = (uint8_t)(code * 4 + min(max(x, 0), 3));
+			}
+
+			v_codes[i] = code;
+		}
+	}
+
+	++no_gt_window_variants;
+}
+
+// ******************************************************************************
+// Samples sorted by genotypes of recent variants, the most recent being the most significant (as in PBWT)
+void CCompressedFile::compute_sample_order(vector<uint32_t>& v_order)
+{
+	if (no_gt_window_variants == 0)
+	{
+		v_order.clear();
+		return;
+	}
+
+	if (sample_order_cache_variants != no_gt_window_variants)
+	{
+		vector<uint32_t> v_tmp(no_samples);
+		array<uint32_t, 17> counts;
+
+		v_sample_order_cache.resize(no_samples);
+		for (uint32_t i = 0; i < no_samples; ++i)
+			v_sample_order_cache[i] = i;
+
+		uint64_t first = no_gt_window_variants > sample_order_window ? no_gt_window_variants - sample_order_window : 0;
+
+		for (uint64_t v = first; v < no_gt_window_variants; ++v)
+		{
+			auto& v_codes = v_gt_window[v % sample_order_window];
+
+			counts.fill(0);
+			for (auto x : v_codes)
+				++counts[x + 1];
+			for (uint32_t i = 1; i < counts.size(); ++i)
+				counts[i] += counts[i - 1];
+
+			for (auto id : v_sample_order_cache)
+				v_tmp[counts[v_codes[id]]++] = id;
+
+			swap(v_tmp, v_sample_order_cache);
+		}
+
+		sample_order_cache_variants = no_gt_window_variants;
+	}
+
+	v_order = v_sample_order_cache;
+}
+
+// ******************************************************************************
+void CCompressedFile::permute_samples(vector<uint32_t>& v_size, vector<uint8_t>& v_data, const vector<uint32_t>& v_order, bool forward)
+{
+	vector<uint8_t> v_tmp(v_data.size());
+	size_t offset = 0;
+
+	for (auto c_size : v_size)
+	{
+		size_t bytes = (size_t)c_size * 4;
+
+		if (c_size % no_samples != 0)
+			copy_n(v_data.data() + offset, bytes, v_tmp.data() + offset);
+		else
+		{
+			size_t entry_bytes = bytes / no_samples;
+			uint8_t* p_src = v_data.data() + offset;
+			uint8_t* p_dest = v_tmp.data() + offset;
+
+			if (forward)
+				for (uint32_t r = 0; r < no_samples; ++r)
+					copy_n(p_src + v_order[r] * entry_bytes, entry_bytes, p_dest + r * entry_bytes);
+			else
+				for (uint32_t r = 0; r < no_samples; ++r)
+					copy_n(p_src + r * entry_bytes, entry_bytes, p_dest + v_order[r] * entry_bytes);
+		}
+
+		offset += bytes;
+	}
+
+	swap(v_data, v_tmp);
+}
+
+// ******************************************************************************
+// FILTER and INFO keys are needed to scan sites, FORMAT keys only when samples are decoded
+bool CCompressedFile::is_hot_key(int key_id)
+{
+	return keys[key_id].keys_type != key_type_t::fmt;
+}
+
 // ******************************************************************************
 void CCompressedFile::link_stream(string stream_name, string target_name)
 {
@@ -1648,4 +1911,320 @@ void CCompressedFile::load_function(string stream_name, int &src_id, function_si
 	}
 }
 
+// ************************************************************************************
+string CCompressedFile::codec_name(uint32_t item_id)
+{
+	if (item_id >= no_keys)
+	{
+		uint32_t db_id = item_id - no_keys;
+
+		if (db_id == id_db_pos)
+			return "delta+bsc";
+		if ((db_id == id_db_ref || db_id == id_db_alt) && (archive_features & feature_allele_codec))
+			return "allele+bsc";
+		return "bsc";
+	}
+
+	if ((int) item_id == gt_key_id)
+		return "pbwt+rc";
+	if (keys[item_id].keys_type == key_type_t::fmt && keys[item_id].type != BCF_HT_STR)
+		return "format_rc+bsc";
+	if (keys[item_id].keys_type == key_type_t::info && (keys[item_id].type == BCF_HT_INT || keys[item_id].type == BCF_HT_REAL))
+		return "info_rc+bsc";
+	if (item_id < v_annot_fields.size() && v_annot_fields[item_id])
+		return "annot_columns+bsc";
+	if (keys[item_id].type == BCF_HT_STR)
+		return "text_pp+bsc";
+
+	return "bsc";
+}
+
+// ************************************************************************************
+void CCompressedFile::init_stats()
+{
+	if (!stats)
+		return;
+
+	const array<string, 6> db_names = { "CHROM", "POS", "ID", "REF", "ALT", "QUAL" };
+
+	stats->SetNoItems(no_keys + no_db_fields);
+
+	for (uint32_t i = 0; i < no_keys; ++i)
+		stats->SetItem(i, "key_" + to_string(i), codec_name(i));
+
+	for (uint32_t i = 0; i < no_db_fields; ++i)
+		stats->SetItem(no_keys + i, db_names[i], codec_name(no_keys + i));
+}
+
+// ************************************************************************************
+void CCompressedFile::update_stats_sizes()
+{
+	if (!stats)
+		return;
+
+	for (uint32_t i = 0; i < no_keys; ++i)
+	{
+		size_t size = 0;
+
+		for (auto name : { "key_" + to_string(i) + "_size", "key_" + to_string(i) + "_data" })
+		{
+			int stream_id = archive->GetStreamId(name);
+			if (stream_id >= 0)
+				size += archive->GetCompressedSize(stream_id);
+		}
+
+		stats->SetCompressedSize(i, size);
+	}
+
+	for (uint32_t i = 0; i < no_db_fields; ++i)
+	{
+		size_t size = 0;
+
+		for (auto name : { db_stream_name_size[i], db_stream_name_data[i] })
+		{
+			int stream_id = archive->GetStreamId(name);
+			if (stream_id >= 0)
+				size += archive->GetCompressedSize(stream_id);
+		}
+
+		stats->SetCompressedSize(no_keys + i, size);
+	}
+}
+
+// ************************************************************************************
+int64_t CCompressedFile::package_memory(const SPackage& pck)
+{
+	return (int64_t) (pck.v_size.capacity() * sizeof(uint32_t) + pck.v_data.capacity() + pck.v_compressed.capacity());
+}
+
+// ************************************************************************************
+// Size of the package used by the scheduler of coders to estimate the remaining work of streams
+size_t CCompressedFile::package_work(const SPackage& pck)
+{
+	return pck.v_size.size() * sizeof(uint32_t) + pck.v_data.size();
+}
+
+// ************************************************************************************
+// Must be called by the thread owning the (de)compressor of the key
+void CCompressedFile::update_context_memory(int key_id)
+{
+	if (!mem_governor || key_id < 0)
+		return;
+
+	int64_t mem = 0;
+
+	if (key_id == gt_key_id)
+		mem = (int64_t) rce_coders.get_memory_usage() + (int64_t) rcd_coders.get_memory_usage();
+	else if (v_format_compress[key_id])
+		mem = (int64_t) v_format_compress[key_id]->GetMemoryUsage();
+
+	mem_governor->Add(mem_component_t::contexts, mem - v_ctx_memory[key_id]);
+	v_ctx_memory[key_id] = mem;
+}
+
+// ************************************************************************************
+// Row groups: FORMAT/INFO parts of a key are coded without the statistics of the preceding parts
+void CCompressedFile::restart_format_codec(int key_id)
+{
+	delete v_format_compress[key_id];
+
+	v_format_compress[key_id] = new CFormatCompress();
+	v_format_compress[key_id]->SetNoSamples(no_samples);
+	v_format_compress[key_id]->SetBlockMode(gvcf_mode);
+}
+
+// ************************************************************************************
+// Called by the thread reading variants after a new part was set in the buffer
+void CCompressedFile::update_buffer_memory(uint32_t buf_id, const CBuffer& buf)
+{
+	update_buffer_memory(buf_id, (int64_t) buf.GetMemoryUsage());
+}
+
+// ************************************************************************************
+void CCompressedFile::update_buffer_memory(uint32_t buf_id, int64_t mem)
+{
+	mem_governor->Add(mem_component_t::buffers, mem - v_i_buf_memory[buf_id]);
+	v_i_buf_memory[buf_id] = mem;
+}
+
+// ************************************************************************************
+// Choose part sizes and the number of packages in flight to fit the memory budget
+void CCompressedFile::plan_memory_budget()
+{
+	max_cnt_packages = default_max_cnt_packages;
+	cur_buffer_size = max_buffer_size;
+	cur_buffer_gt_size = max_buffer_gt_size;
+	cur_buffer_db_size = max_buffer_db_size;
+
+	if (!mem_governor || !mem_governor->GetBudget())
+		return;
+
+	// A quarter of the budget is left for the context models, variant batches and other structures
+	// (context models are reported, but not limited, as the decompressor has to build the same models)
+	double available = mem_governor->GetBudget() * 0.75;
+	uint32_t no_gt_keys = gt_key_id >= 0 ? 1 : 0;
+	double scale = 1.0;
+
+	for (int depth = default_max_cnt_packages; depth >= 1; --depth)
+	{
+		// Every buffer can have up to depth packages in flight, every coder thread keeps about two parts of scratch data
+		double needed = ((no_keys - no_gt_keys) * (double) max_buffer_size + no_gt_keys * (double) max_buffer_gt_size +
+			no_db_fields * (double) max_buffer_db_size) * (1 + depth) +
+			no_coder_threads * 2.0 * (no_gt_keys ? max_buffer_gt_size : max_buffer_size);
+
+		scale = available / needed;
+		max_cnt_packages = depth;
+
+		if (scale >= 0.25)
+			break;
+	}
+
+	if (scale >= 1.0)
+		return;
+
+	cur_buffer_size = max(min_buffer_size, (uint32_t) (max_buffer_size * scale));
+	cur_buffer_gt_size = max(min_buffer_gt_size, (uint32_t) (max_buffer_gt_size * scale));
+	cur_buffer_db_size = max(min_buffer_size, (uint32_t) (max_buffer_db_size * scale));
+
+	cerr << "Memory budget: part size " << (cur_buffer_size >> 10) << " KB (GT: " << (cur_buffer_gt_size >> 10)
+		<< " KB), packages in flight: " << max_cnt_packages << "\n";
+}
+
+// ************************************************************************************
+// Called by the thread adding variants; lowers the limits if the budget is exceeded
+// The usage of the buffers is summed over all keys, so it is sampled only once per adapt_memory_interval variants
+void CCompressedFile::adapt_to_memory_budget()
+{
+	if (++no_variants_since_adapt < adapt_memory_interval)
+		return;
+	no_variants_since_adapt = 0;
+
+	int64_t buffers_mem = 0;
+
+	for (auto& x : v_o_buf)
+		buffers_mem += (int64_t) x.GetMemoryUsage();
+	for (auto& x : v_o_db_buf)
+		buffers_mem += (int64_t) x.GetMemoryUsage();
+
+	mem_governor->Set(mem_component_t::buffers, buffers_mem);
+
+	// Only the buffers and packages in flight are lowered; the memory of context models cannot be recovered this way
+	if (!mem_governor->IsOverBudget())
+		return;
+
+	if (max_cnt_packages > 1)
+	{
+		lock_guard<mutex> lck(m_packages);
+		--max_cnt_packages;
+	}
+	else if (cur_buffer_size > min_buffer_size || cur_buffer_gt_size > min_buffer_gt_size)
+	{
+		// The same limit for all keys, so the keys with identical data still have identical parts
+		cur_buffer_size = max(min_buffer_size, cur_buffer_size / 2);
+		cur_buffer_gt_size = max(min_buffer_gt_size, cur_buffer_gt_size / 2);
+		cur_buffer_db_size = max(min_buffer_size, cur_buffer_db_size / 2);
+
+		for (uint32_t i = 0; i < no_keys; ++i)
+			v_o_buf[i].SetMaxSize((int) i != gt_key_id ? cur_buffer_size : cur_buffer_gt_size);
+		for (auto& x : v_o_db_buf)
+			x.SetMaxSize(cur_buffer_db_size);
+	}
+	else
+		return;
+
+	cerr << "Memory budget exceeded: part size " << (cur_buffer_size >> 10) << " KB (GT: " << (cur_buffer_gt_size >> 10)
+		<< " KB), packages in flight: " << max_cnt_packages << "\n";
+}
+
+// ******************************************************************************
+// State of compression at a checkpoint (all buffers are empty then)
+void CCompressedFile::save_state(CState& state)
+{
+	state.Write(no_variants);
+	state.Write(prev_pos);
+
+	pbwt.SaveState(state);
+	rce_coders.save_state(state);
+	allele_codec.SaveState(state);
+
+	for (uint32_t i = 0; i < no_keys; ++i)
+	{
+		v_text_pp[i].SaveState(state);
+
+		if (v_format_compress[i])
+			v_format_compress[i]->SaveState(state);
+	}
+
+	if (sample_order_mode)
+	{
+		state.Write(no_gt_window_variants);
+		state.Write((uint64_t) v_gt_window.size());
+		for (auto& x : v_gt_window)
+			state.Write(x);
+
+		for (uint32_t i = 0; i < no_keys; ++i)
+		{
+			state.Write(v_sample_order_prev[i]);
+			state.Write(v_sample_order_cur[i]);
+		}
+	}
+
+	if (row_group_size)
+		state.Write(v_row_groups);
+}
+
+// ******************************************************************************
+bool CCompressedFile::load_state(CState& state)
+{
+	if (!state.Read(no_variants) || !state.Read(prev_pos) || !pbwt.LoadState(state))
+		return false;
+
+	auto make_model = [&] {
+		return new CRangeCoderModel<CSimpleModel, CVectorIOStream>(rce, 1, 1, 1 << 1, nullptr, 1, true);
+	};
+
+	if (!rce_coders.load_state(state, make_model) || !allele_codec.LoadState(state))
+		return false;
+
+	for (uint32_t i = 0; i < no_keys; ++i)
+	{
+		if (!v_text_pp[i].LoadState(state))
+			return false;
+
+		if (v_format_compress[i] && !v_format_compress[i]->LoadState(state))
+			return false;
+	}
+
+	if (sample_order_mode)
+	{
+		uint64_t window_size;
+
+		if (!state.Read(no_gt_window_variants) || !state.Read(window_size) || window_size > sample_order_window)
+			return false;
+
+		v_gt_window.resize(window_size);
+		for (auto& x : v_gt_window)
+			if (!state.Read(x))
+				return false;
+
+		for (uint32_t i = 0; i < no_keys; ++i)
+			if (!state.Read(v_sample_order_prev[i]) || !state.Read(v_sample_order_cur[i]))
+				return false;
+
+		sample_order_cache_variants = 0;
+	}
+
+	if (row_group_size)
+	{
+		if (!state.Read(v_row_groups))
+			return false;
+		no_row_group_variants = 0;
+	}
+
+	for (uint32_t i = 0; i < no_keys; ++i)
+		update_context_memory(i);
+
+	return true;
+}
+
 // EOF
@@ -8,9 +8,10 @@
 // Date   : 2020-12-18
 // *******************************************************************************************
 
-#include <mmintrin.h>
 #include <cstdint>
+#ifdef _WIN32
 #include <xmmintrin.h>
+#endif
 #include <iostream> 
 #include <cstddef>
 
@@ -120,6 +121,11 @@ public:
 		return ht_memory;
 	}
 
+	// Approximate memory of the hash table and the models
+	size_t get_memory_usage() const {
+		return ht_memory + size * sizeof(MODEL);
+	}
+
 	void debug_list(vector<CContextHM<MODEL>::item_t> &v_ctx)
 	{
 		v_ctx.clear();
@@ -220,6 +226,63 @@ public:
 	{
 		return size;
 	}
+
+	// Contexts with their models (checkpoints of compression)
+	void save_state(CState& state)
+	{
+		state.Write((uint64_t) size);
+
+		for (size_t i = 0; i < allocated; ++i)
+			if (data[i].rcm)
+			{
+				state.Write(data[i].ctx);
+				state.Write((uint64_t) data[i].counter);
+				data[i].rcm->SaveState(state);
+			}
+	}
+
+	// Removes all contexts with their models
+	void clear(void)
+	{
+		for (size_t i = 0; i < allocated; ++i)
+			if (data[i].rcm)
+			{
+				delete data[i].rcm;
+				data[i].rcm = nullptr;
+			}
+		size = 0;
+	}
+
+	// make_model() creates a model bound to the proper coder; its state is then loaded
+	template<typename FACTORY> bool load_state(CState& state, FACTORY make_model)
+	{
+		clear();
+
+		uint64_t no_items;
+		if (!state.Read(no_items))
+			return false;
+
+		for (uint64_t i = 0; i < no_items; ++i)
+		{
+			context_t ctx;
+			uint64_t counter;
+
+			if (!state.Read(ctx) || !state.Read(counter))
+				return false;
+
+			MODEL* rcm = make_model();
+
+			if (!rcm->LoadState(state))
+			{
+				delete rcm;
+				return false;
+			}
+
+			insert(ctx, rcm, (size_t) counter);
+		}
+
+		return true;
+	}
 }; 
 
 // EOF
@@ -0,0 +1,350 @@
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include "cpu_dispatch.h"
+#include "varint.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+// Variants for x86-64 instruction sets are made with the target attribute, so the files are compiled
+// for the baseline CPU and only the kernels below use newer instructions
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define VCFSHARK_MULTI_ISA
+#define TARGET_SSE4_2	__attribute__((target("sse4.2,popcnt")))
+#define TARGET_AVX2		__attribute__((target("avx2,bmi,bmi2,popcnt")))
+#define TARGET_AVX512	__attribute__((target("avx512f,avx512bw,avx512vl,avx2,bmi,bmi2,popcnt")))
+#include <immintrin.h>
+#endif
+
+// ************************************************************************************
+// Generic implementations of the kernels; compiled separately for each instruction set
+// ************************************************************************************
+static inline void histogram_impl(const uint32_t* data, size_t n, uint32_t* hist, size_t hist_size)
+{
+	// Genotypes are mostly runs of the same symbol; 4 partial histograms break the dependency
+	// between consecutive increments of the same counter
+	const size_t max_small_hist_size = 64;
+
+	if (hist_size > max_small_hist_size)
+	{
+		for (size_t i = 0; i < n; ++i)
+			++hist[data[i]];
+
+		return;
+	}
+
+	uint32_t h[4][max_small_hist_size] = {};
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		++h[0][data[i]];
+		++h[1][data[i + 1]];
+		++h[2][data[i + 2]];
+		++h[3][data[i + 3]];
+	}
+
+	for (; i < n; ++i)
+		++h[0][data[i]];
+
+	for (size_t j = 0; j < hist_size; ++j)
+		hist[j] += h[0][j] + h[1][j] + h[2][j] + h[3][j];
+}
+
+// ************************************************************************************
+static inline void pbwt_forward_impl(const uint32_t* input, const int* perm_prev, int* perm_cur, uint32_t* hist, size_t n,
+	vector<pair<uint32_t, uint32_t>>& v_rle)
+{
+	uint8_t prev_symbol = (uint8_t) input[perm_prev[0]];
+	uint32_t run_len = 0;
+
+	for (size_t i = 0; i < n; ++i)
+	{
+		int id = perm_prev[i];
+		uint8_t cur_symbol = (uint8_t) input[id];
+
+		if (cur_symbol == prev_symbol)
+			++run_len;
+		else
+		{
+			v_rle.emplace_back(prev_symbol, run_len);
+			prev_symbol = cur_symbol;
+			run_len = 1;
+		}
+
+		perm_cur[hist[cur_symbol]++] = id;
+	}
+
+	v_rle.emplace_back(prev_symbol, run_len);
+}
+
+// ************************************************************************************
+static inline void pbwt_reverse_impl(const pair<uint32_t, uint32_t>* rle, const int* perm_prev, int* perm_cur, uint32_t* hist, size_t n,
+	uint32_t* output)
+{
+	auto p_rle = rle;
+	uint8_t cur_symbol = (uint8_t) p_rle->first;
+	uint32_t cur_cnt = p_rle->second;
+
+	for (size_t i = 0; i < n; ++i)
+	{
+		int id = perm_prev[i];
+
+		output[id] = cur_symbol;
+		perm_cur[hist[cur_symbol]++] = id;
+
+		if (--cur_cnt == 0)
+		{
+			++p_rle;
+			if (i + 1 < n)
+			{
+				cur_symbol = (uint8_t) p_rle->first;
+				cur_cnt = p_rle->second;
+			}
+		}
+	}
+}
+
+// ************************************************************************************
+static inline size_t decode_var_ints_impl(const uint8_t* p, uint32_t* output, size_t n)
+{
+	const uint8_t* p0 = p;
+	size_t i = 0;
+
+	// Fast path for single-byte codes (small values are the most common)
+	for (; i + 4 <= n; i += 4)
+	{
+		uint32_t c;
+		memcpy(&c, p, 4);
+
+		// Any byte below 2 (zero, missing) or above 125 (negative, multi-byte) breaks the fast path
+		uint32_t has_less = (c - 0x02020202u) & ~c & 0x80808080u;
+		uint32_t has_more = ((c + 0x02020202u) | c) & 0x80808080u;
+
+		if (has_less | has_more)
+			break;
+
+		output[i] = p[0] - 1;
+		output[i + 1] = p[1] - 1;
+		output[i + 2] = p[2] - 1;
+		output[i + 3] = p[3] - 1;
+		p += 4;
+	}
+
+	for (; i < n; ++i)
+		p += decode_var_int(p, output[i]);
+
+	return (size_t) (p - p0);
+}
+
+// ************************************************************************************
+static inline bool is_word_char(uint8_t c)
+{
+	return (uint8_t) ((c | 0x20) - 'a') < 26 || (uint8_t) (c - '0') < 10 || c == '_' || c == '(' || c == ')' || c == '&' || c == '/';
+}
+
+// ************************************************************************************
+static inline size_t scan_word_chars_impl(const uint8_t* p, size_t n)
+{
+	size_t i = 0;
+
+	while (i < n && is_word_char(p[i]))
+		++i;
+
+	return i;
+}
+
+#ifdef VCFSHARK_MULTI_ISA
+// ************************************************************************************
+// Vector variants of the character-class scan: letters are tested as (c | 0x20) - 'a' < 26, digits as c - '0' < 10
+// (unsigned comparisons made with min), the remaining word characters by equality
+TARGET_SSE4_2 static inline size_t scan_word_chars_sse_impl(const uint8_t* p, size_t n)
+{
+	const __m128i v_case = _mm_set1_epi8(0x20);
+	const __m128i v_a = _mm_set1_epi8('a');
+	const __m128i v_25 = _mm_set1_epi8(25);
+	const __m128i v_0 = _mm_set1_epi8('0');
+	const __m128i v_9 = _mm_set1_epi8(9);
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{
+		__m128i c = _mm_loadu_si128((const __m128i*) (p + i));
+
+		__m128i t = _mm_sub_epi8(_mm_or_si128(c, v_case), v_a);
+		__m128i m = _mm_cmpeq_epi8(_mm_min_epu8(t, v_25), t);
+
+		t = _mm_sub_epi8(c, v_0);
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(t, v_9), t));
+
+		m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('_')), _mm_cmpeq_epi8(c, _mm_set1_epi8('/'))));
+		m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('(')), _mm_cmpeq_epi8(c, _mm_set1_epi8(')'))));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(c, _mm_set1_epi8('&')));
+
+		uint32_t mask = ~(uint32_t) _mm_movemask_epi8(m) & 0xffffu;
+
+		if (mask)
+			return i + (size_t) __builtin_ctz(mask);
+	}
+
+	return i + scan_word_chars_impl(p + i, n - i);
+}
+
+// ************************************************************************************
+TARGET_AVX2 static inline size_t scan_word_chars_avx2_impl(const uint8_t* p, size_t n)
+{
+	const __m256i v_case = _mm256_set1_epi8(0x20);
+	const __m256i v_a = _mm256_set1_epi8('a');
+	const __m256i v_25 = _mm256_set1_epi8(25);
+	const __m256i v_0 = _mm256_set1_epi8('0');
+	const __m256i v_9 = _mm256_set1_epi8(9);
+	size_t i = 0;
+
+	for (; i + 32 <= n; i += 32)
+	{
+		__m256i c = _mm256_loadu_si256((const __m256i*) (p + i));
+
+		__m256i t = _mm256_sub_epi8(_mm256_or_si256(c, v_case), v_a);
+		__m256i m = _mm256_cmpeq_epi8(_mm256_min_epu8(t, v_25), t);
+
+		t = _mm256_sub_epi8(c, v_0);
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_min_epu8(t, v_9), t));
+
+		m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('/'))));
+		m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('(')), _mm256_cmpeq_epi8(c, _mm256_set1_epi8(')'))));
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(c, _mm256_set1_epi8('&')));
+
+		uint32_t mask = ~(uint32_t) _mm256_movemask_epi8(m);
+
+		if (mask)
+			return i + (size_t) __builtin_ctz(mask);
+	}
+
+	return i + scan_word_chars_sse_impl(p + i, n - i);
+}
+#endif
+
+// ************************************************************************************
+// Instantiation of kernels for the instruction sets
+// ************************************************************************************
+#define DEFINE_KERNELS(SUFFIX, TARGET, SCAN_WORD_CHARS) \
+TARGET static void histogram_##SUFFIX(const uint32_t* data, size_t n, uint32_t* hist, size_t hist_size) \
+{ histogram_impl(data, n, hist, hist_size); } \
+TARGET static void pbwt_forward_##SUFFIX(const uint32_t* input, const int* perm_prev, int* perm_cur, uint32_t* hist, size_t n, \
+	vector<pair<uint32_t, uint32_t>>& v_rle) \
+{ pbwt_forward_impl(input, perm_prev, perm_cur, hist, n, v_rle); } \
+TARGET static void pbwt_reverse_##SUFFIX(const pair<uint32_t, uint32_t>* rle, const int* perm_prev, int* perm_cur, uint32_t* hist, size_t n, \
+	uint32_t* output) \
+{ pbwt_reverse_impl(rle, perm_prev, perm_cur, hist, n, output); } \
+TARGET static size_t decode_var_ints_##SUFFIX(const uint8_t* p, uint32_t* output, size_t n) \
+{ return decode_var_ints_impl(p, output, n); } \
+TARGET static size_t scan_word_chars_##SUFFIX(const uint8_t* p, size_t n) \
+{ return SCAN_WORD_CHARS(p, n); } \
+static const cpu_kernels_t kernels_##SUFFIX = { histogram_##SUFFIX, pbwt_forward_##SUFFIX, pbwt_reverse_##SUFFIX, decode_var_ints_##SUFFIX, \
+	scan_word_chars_##SUFFIX };
+
+DEFINE_KERNELS(generic, , scan_word_chars_impl)
+
+#ifdef VCFSHARK_MULTI_ISA
+DEFINE_KERNELS(sse4_2, TARGET_SSE4_2, scan_word_chars_sse_impl)
+DEFINE_KERNELS(avx2, TARGET_AVX2, scan_word_chars_avx2_impl)
+DEFINE_KERNELS(avx512, TARGET_AVX512, scan_word_chars_avx2_impl)
+#endif
+
+// ************************************************************************************
+// CCPUDispatch
+// ************************************************************************************
+CCPUDispatch::CCPUDispatch()
+{
+	isa = detect();
+
+	// VCFSHARK_ISA=generic|sse4.2|avx2|avx512 lowers the instruction set (e.g., to compare variants)
+	const char* forced = getenv("VCFSHARK_ISA");
+	if (forced)
+	{
+		string s(forced);
+		cpu_isa_t req = isa;
+
+		if (s == "generic")
+			req = cpu_isa_t::generic;
+		else if (s == "sse4.2")
+			req = cpu_isa_t::sse4_2;
+		else if (s == "avx2")
+			req = cpu_isa_t::avx2;
+		else if (s == "avx512")
+			req = cpu_isa_t::avx512;
+
+		if ((int) req < (int) isa)
+			isa = req;
+	}
+
+	switch (isa)
+	{
+#ifdef VCFSHARK_MULTI_ISA
+	case cpu_isa_t::avx512:
+		kernels = kernels_avx512;
+		break;
+	case cpu_isa_t::avx2:
+		kernels = kernels_avx2;
+		break;
+	case cpu_isa_t::sse4_2:
+		kernels = kernels_sse4_2;
+		break;
+#endif
+	default:
+		isa = cpu_isa_t::generic;
+		kernels = kernels_generic;
+	}
+}
+
+// ************************************************************************************
+CCPUDispatch& CCPUDispatch::Instance()
+{
+	static CCPUDispatch dispatch;
+
+	return dispatch;
+}
+
+// ************************************************************************************
+cpu_isa_t CCPUDispatch::detect()
+{
+#ifdef VCFSHARK_MULTI_ISA
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl") &&
+		__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"))
+		return cpu_isa_t::avx512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"))
+		return cpu_isa_t::avx2;
+	if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+		return cpu_isa_t::sse4_2;
+#endif
+
+	return cpu_isa_t::generic;
+}
+
+// ************************************************************************************
+string CCPUDispatch::GetISAName() const
+{
+	switch (isa)
+	{
+	case cpu_isa_t::avx512:
+		return "avx512";
+	case cpu_isa_t::avx2:
+		return "avx2";
+	case cpu_isa_t::sse4_2:
+		return "sse4.2";
+	default:
+		return "generic";
+	}
+}
+
+// EOF
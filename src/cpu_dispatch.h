@@ -0,0 +1,77 @@
+#pragma once
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+enum class cpu_isa_t {generic, sse4_2, avx2, avx512};
+
+// ************************************************************************************
+// Hot kernels compiled for several instruction sets; the variant is chosen once at startup
+struct cpu_kernels_t
+{
+	// Adds the counts of symbols to hist
+	void (*histogram)(const uint32_t* data, size_t n, uint32_t* hist, size_t hist_size);
+
+	// Forward PBWT step: new permutation, symbol counts in hist are turned into positions; runs are appended to v_rle
+	void (*pbwt_forward)(const uint32_t* input, const int* perm_prev, int* perm_cur, uint32_t* hist, size_t n,
+		vector<pair<uint32_t, uint32_t>>& v_rle);
+
+	// Reverse PBWT step
+	void (*pbwt_reverse)(const pair<uint32_t, uint32_t>* rle, const int* perm_prev, int* perm_cur, uint32_t* hist, size_t n,
+		uint32_t* output);
+
+	// Decodes n variable-size integers (CBuffer format); returns the no. of bytes read
+	size_t (*decode_var_ints)(const uint8_t* p, uint32_t* output, size_t n);
+
+	// Length of the prefix of word characters (letters, digits, _()&/) of the text tokenizer
+	size_t (*scan_word_chars)(const uint8_t* p, size_t n);
+};
+
+// ************************************************************************************
+class CCPUDispatch
+{
+	cpu_isa_t isa;
+	cpu_kernels_t kernels;
+
+	CCPUDispatch();
+
+	static cpu_isa_t detect();
+
+public:
+	static CCPUDispatch& Instance();
+
+	cpu_isa_t GetISA() const
+	{
+		return isa;
+	}
+
+	string GetISAName() const;
+
+	const cpu_kernels_t& Kernels() const
+	{
+		return kernels;
+	}
+};
+
+// ************************************************************************************
+inline const cpu_kernels_t& CPUKernels()
+{
+	static const cpu_kernels_t& kernels = CCPUDispatch::Instance().Kernels();
+
+	return kernels;
+}
+
+// EOF
@@ -10,13 +10,14 @@
 #include "format.h"
 #include <unordered_map>
 #include <unordered_set>
-#include <map>
 #include <limits>
+#include <algorithm>
 
 // *****************************************************************************************
 CFormatCompress::CFormatCompress()
 {
 	no_samples = 1;
+	block_mode = false;
 
 	vios_i = new CVectorIOStream(v_vios_i);
 	vios_o = new CVectorIOStream(v_vios_o);
@@ -49,6 +50,73 @@ void CFormatCompress::SetNoSamples(uint32_t _no_samples)
 	no_samples = _no_samples;
 }
 
+// *****************************************************************************************
+void CFormatCompress::SetBlockMode(bool _block_mode)
+{
+	block_mode = _block_mode;
+}
+
+// *****************************************************************************************
+size_t CFormatCompress::GetMemoryUsage() const
+{
+	return ctx_map_same.get_memory_usage() + ctx_map_known.get_memory_usage() + ctx_map_plain.get_memory_usage() +
+		ctx_map_code.get_memory_usage() + ctx_map_entropy_type.get_memory_usage() +
+		dict.size() * 2 * sizeof(uint32_t) + v_vios_i.capacity() + v_vios_o.capacity();
+}
+
+// *****************************************************************************************
+// Context models, type of INFO data, context mode and dictionary of the encoder
+void CFormatCompress::SaveState(CState& state)
+{
+	ctx_map_same.save_state(state);
+	ctx_map_known.save_state(state);
+	ctx_map_plain.save_state(state);
+	ctx_map_code.save_state(state);
+	ctx_map_entropy_type.save_state(state);
+
+	state.Write((uint32_t) type.first);
+	state.Write(type.second);
+	state.Write(ctx_mode);
+
+	state.Write((uint64_t) dict.size());
+	for (auto& x : dict)
+	{
+		state.Write(x.first);
+		state.Write(x.second);
+	}
+}
+
+// *****************************************************************************************
+bool CFormatCompress::LoadState(CState& state)
+{
+	auto make_model = [&] {
+		return new CRangeCoderModel<ModelType, CVectorIOStream>(rce, 1, 1, 1 << 1, nullptr, 1, true);
+	};
+
+	if (!ctx_map_same.load_state(state, make_model) || !ctx_map_known.load_state(state, make_model) || !ctx_map_plain.load_state(state, make_model) ||
+		!ctx_map_code.load_state(state, make_model) || !ctx_map_entropy_type.load_state(state, make_model))
+		return false;
+
+	uint32_t type_id;
+	uint64_t dict_size;
+
+	if (!state.Read(type_id) || !state.Read(type.second) || !state.Read(ctx_mode) || !state.Read(dict_size) || type_id > (uint32_t) info_t::any)
+		return false;
+	type.first = (info_t) type_id;
+
+	dict.clear();
+	for (uint64_t i = 0; i < dict_size; ++i)
+	{
+		uint32_t key, val;
+
+		if (!state.Read(key) || !state.Read(val))
+			return false;
+		dict[key] = val;
+	}
+
+	return true;
+}
+
 // *****************************************************************************************
 pair<CFormatCompress::info_t, uint32_t> CFormatCompress::determine_info_type(vector<uint32_t>& v_size)
 {
@@ -84,42 +152,159 @@ pair<CFormatCompress::info_t, uint32_t> CFormatCompress::determine_info_type(vec
 }
 
 // *****************************************************************************************
-template <unsigned SIZE> double CFormatCompress::entropy(vector<array<uint32_t, SIZE>> &vec)
+// Estimated cost of coding the sampled values in the candidate contexts (bit j of candidates is set if j-th is used):
+// . . e - values
+// . d c - values
+// b a x - values
+//     p - pos
+//
+// 0 - x, 1 - a x, 2 - b a x, 3 - c x, 4 - e c x, 5 - a c x, 6 - p a x, 7 - p c x, 8 - p x
+void CFormatCompress::estimate_ctx_costs(const uint32_t* p_data, uint32_t no_rows, uint32_t row_size, uint32_t candidates, array<double, 9>& costs)
 {
-	double r = 0;
-	uint32_t no_uniques = 0;
+	const uint32_t m = numeric_limits<uint32_t>::max();
+	const uint32_t s = row_size;
+
+	// Blocks of rows in the sample (with up to 2 preceding rows needed for contexts)
+	vector<pair<uint32_t, uint32_t>> v_blocks;
+	uint32_t no_sample_rows = max(1u, max_ctx_sample_items / max(1u, s));
+
+	if (no_sample_rows >= no_rows)
+		v_blocks.emplace_back(0, no_rows);
+	else
+	{
+		uint32_t no_blocks = min(max_ctx_sample_blocks, no_sample_rows);
+		uint32_t block_rows = no_sample_rows / no_blocks;
+
+		for (uint32_t b = 0; b < no_blocks; ++b)
+		{
+			uint32_t start = (uint32_t) ((uint64_t) b * no_rows / no_blocks);
+			v_blocks.emplace_back(start, start + block_rows);
+		}
+	}
+
+	// Values are replaced by their ranks, so the tuples fit in 64-bit keys and are counted by sorting
+	vector<uint32_t> v_ctx_values;
+	vector<uint32_t> v_ctx_ranks;
+	array<vector<uint64_t>, 9> v_ctx_keys;
+
+	v_ctx_values.emplace_back(m);
+
+	for (auto& block : v_blocks)
+		v_ctx_values.insert(v_ctx_values.end(), p_data + (size_t) (block.first - min(2u, block.first)) * s, p_data + (size_t) block.second * s);
+
+	sort(v_ctx_values.begin(), v_ctx_values.end());
+	v_ctx_values.erase(unique(v_ctx_values.begin(), v_ctx_values.end()), v_ctx_values.end());
 
-	map<array<uint32_t, SIZE - 1>, map<uint32_t, uint32_t>> stats;
+	auto rank = [&](uint32_t x) {
+		return min<uint64_t>((uint64_t) (lower_bound(v_ctx_values.begin(), v_ctx_values.end(), x) - v_ctx_values.begin()), ctx_key_mask);
+	};
 
-	array<uint32_t, SIZE - 1> arr;
+	const uint64_t rm = rank(m);
 
-	for (auto& x : vec)
+	auto key = [&](uint64_t c1, uint64_t c2, uint64_t x) {
+		return (((c1 << ctx_key_bits) + c2) << ctx_key_bits) + x;
+	};
+
+	for (auto& block : v_blocks)
 	{
-		for (uint32_t i = 0; i < SIZE - 1; ++i)
-			arr[i] = x[i];
+		uint32_t lead = min(2u, block.first);
+		uint32_t first_row = block.first - lead;
+
+		v_ctx_ranks.clear();
+		for (size_t i = (size_t) first_row * s; i < (size_t) block.second * s; ++i)
+			v_ctx_ranks.emplace_back((uint32_t) rank(p_data[i]));
+
+		for (uint32_t i = block.first; i < block.second; ++i)
+		{
+			const uint32_t* r = v_ctx_ranks.data() + (size_t) (i - first_row) * s;
 
-		stats[arr][x.back()] += 1;
+			for (uint32_t j = 0; j < s; ++j)
+			{
+				uint64_t x = r[j];
+				uint64_t a = j == 0 ? rm : r[j - 1];
+				uint64_t b = j < 2 ? rm : r[j - 2];
+				uint64_t c = i == 0 ? rm : r[(int64_t) j - s];
+				uint64_t e = i < 2 ? rm : r[(int64_t) j - 2 * (int64_t) s];
+				uint64_t p = min<uint64_t>(j, ctx_key_mask);
+
+				if (candidates & (1u << 0))		v_ctx_keys[0].emplace_back(key(0, 0, x));
+				if (candidates & (1u << 1))		v_ctx_keys[1].emplace_back(key(0, a, x));
+				if (candidates & (1u << 2))		v_ctx_keys[2].emplace_back(key(b, a, x));
+				if (candidates & (1u << 3))		v_ctx_keys[3].emplace_back(key(0, c, x));
+				if (candidates & (1u << 4))		v_ctx_keys[4].emplace_back(key(e, c, x));
+				if (candidates & (1u << 5))		v_ctx_keys[5].emplace_back(key(a, c, x));
+				if (candidates & (1u << 6))		v_ctx_keys[6].emplace_back(key(p, a, x));
+				if (candidates & (1u << 7))		v_ctx_keys[7].emplace_back(key(p, c, x));
+				if (candidates & (1u << 8))		v_ctx_keys[8].emplace_back(key(0, p, x));
+			}
+		}
 	}
 
-	uint32_t stats_size = (uint32_t) stats.size();
+	// Costs of the sample are extrapolated to the whole part
+	size_t no_sample_items = 0;
+	for (auto& block : v_blocks)
+		no_sample_items += (size_t) (block.second - block.first) * s;
+
+	double scale = no_sample_items ? (double) no_rows * s / no_sample_items : 1.0;
+
+	for (uint32_t c = 0; c < 9; ++c)
+		costs[c] = (candidates & (1u << c)) ? ctx_cost(v_ctx_keys[c], scale) : numeric_limits<double>::max();
+}
+
+// *****************************************************************************************
+// Cost of coding the last components of the keys in contexts given by the remaining components (plus model costs)
+// For a sample (scale > 1) the coding cost is scaled and the numbers of distinct tuples and contexts in the part
+// are extrapolated from the numbers of the ones seen once in the sample (f1): by Good-Turing, f1 / n is the rate
+// at which new ones appear, so the part has up to d + (scale - 1) * f1 of them
+double CFormatCompress::ctx_cost(vector<uint64_t>& v_keys, double scale)
+{
+	double r_data = 0;
+	double r_model = 0;
+	uint64_t no_contexts = 0;
+	uint64_t no_single_contexts = 0;
+	uint64_t no_tuples = 0;
+	uint64_t no_single_tuples = 0;
+	size_t n = v_keys.size();
+
+	sort(v_keys.begin(), v_keys.end());
 
-	for (auto& x : stats)
+	for (size_t i = 0; i < n;)
 	{
-		no_uniques = (uint32_t) x.second.size();
+		uint64_t ctx = v_keys[i] >> ctx_key_bits;
+		size_t ctx_end = i;
 
-		r += (double)no_uniques * max(8.0, log2(no_uniques));
+		while (ctx_end < n && (v_keys[ctx_end] >> ctx_key_bits) == ctx)
+			++ctx_end;
 
-		double sum = 0.0;
+		double sum = (double) (ctx_end - i);
+		uint32_t no_uniques = 0;
 
-		for (auto& y : x.second)
-			sum += y.second;
+		for (size_t j = i; j < ctx_end;)
+		{
+			size_t k = j;
+			while (k < ctx_end && v_keys[k] == v_keys[j])
+				++k;
+
+			r_data -= (double) (k - j) * log2((double) (k - j) / sum);
+			++no_uniques;
+			no_single_tuples += k - j == 1;
+			j = k;
+		}
 
-		for (auto& y : x.second)
-			r -= (double) y.second * log2((double) y.second / sum);
+		r_model += (double) no_uniques * max(8.0, log2(no_uniques));
+		no_tuples += no_uniques;
+		++no_contexts;
+		no_single_contexts += ctx_end - i == 1;
+		i = ctx_end;
 	}
 
-	r += (double) stats_size * log2(stats_size);
-	return r;
+	if (!no_contexts)
+		return 0;
+
+	double est_tuples = (double) no_tuples + (scale - 1.0) * (double) no_single_tuples;
+	double est_contexts = (double) no_contexts + (scale - 1.0) * (double) no_single_contexts;
+
+	return r_data * scale + r_model * est_tuples / no_tuples + est_contexts * log2(est_contexts);
 }
 
 // *****************************************************************************************
@@ -155,28 +340,11 @@ void CFormatCompress::encode_info_one(vector<uint8_t>& v_data, vector<uint8_t>&
 
 	if (ctx_mode == 0)
 	{
-		array<double, 3> ent;
+		// Candidates: none, previous value, 2 previous values
+		array<double, 9> costs;
+		estimate_ctx_costs(p_data, (uint32_t) (v_data.size() / 4), 1, (1u << 0) | (1u << 3) | (1u << 4), costs);
 
-		{
-			vector<array<uint32_t, 1>> vec;
-			for (uint32_t i = 0; i < v_data.size() / 4; ++i)
-				vec.emplace_back(array<uint32_t, 1>{p_data[i]});
-			ent[0] = entropy<1u>(vec);
-		}
-
-		{
-			vector<array<uint32_t, 2>> vec;
-			for (uint32_t i = 1; i < v_data.size() / 4; ++i)
-				vec.emplace_back(array<uint32_t, 2>{p_data[i - 1], p_data[i]});
-			ent[1] = entropy<2u>(vec);
-		}
-
-		{
-			vector<array<uint32_t, 3>> vec;
-			for (uint32_t i = 2; i < v_data.size() / 4; ++i)
-				vec.emplace_back(array<uint32_t, 3>{p_data[i - 2], p_data[i - 1], p_data[i]});
-			ent[2] = entropy<3u>(vec);
-		}
+		array<double, 3> ent = { costs[0], costs[3], costs[4] };
 
 		ctx_mode = (uint32_t) (min_element(ent.begin(), ent.end()) - ent.begin()) + 1;
 
@@ -307,99 +475,7 @@ void CFormatCompress::encode_info_constant(uint32_t val, vector<uint8_t>& v_data
 	if (ctx_mode == 0)
 	{
 		array<double, 9> ent;
-		// Entropy calculation for:
-		// . . e - values
-		// . d c - values
-		// b a x - values
-		//     p - pos
-
-		// 0 - x
-		{
-			vector<array<uint32_t, 1>> vec;
-			for (uint32_t i = 0; i < no_items; ++i)
-				vec.emplace_back(array<uint32_t, 1>{p_data[i]});
-			ent[0] = entropy<1u>(vec);
-		}
-
-		// 1 - a, x
-		{
-			vector<array<uint32_t, 2>> vec;
-
-			for (uint32_t i = 0; i < no_rows; ++i)
-				for (uint32_t j = 0; j < s; ++j)
-					vec.emplace_back(array<uint32_t, 2>{j == 0 ? m : p_data[i * s + j - 1], p_data[i * s + j]});
-			ent[1] = entropy<2u>(vec);
-		}
-
-		// 2 - b, a, x
-		{
-			vector<array<uint32_t, 3>> vec;
-
-			for (uint32_t i = 0; i < no_rows; ++i)
-				for (uint32_t j = 0; j < s; ++j)
-					vec.emplace_back(array<uint32_t, 3>{j < 2 ? m : p_data[i * s + j - 2], j == 0 ? m : p_data[i * s + j - 1], p_data[i * s + j]});
-			ent[2] = entropy<3u>(vec);
-		}
-
-		// 3 - c, x
-		{
-			vector<array<uint32_t, 2>> vec;
-
-			for (uint32_t i = 0; i < no_rows; ++i)
-				for (uint32_t j = 0; j < s; ++j)
-					vec.emplace_back(array<uint32_t, 2>{i == 0 ? m : p_data[i * s + j - s], p_data[i * s + j]});
-			ent[3] = entropy<2u>(vec);
-		}
-
-		// 4 - e, c, x
-		{
-			vector<array<uint32_t, 3>> vec;
-
-			for (uint32_t i = 0; i < no_rows; ++i)
-				for (uint32_t j = 0; j < s; ++j)
-					vec.emplace_back(array<uint32_t, 3>{i < 2 ? m : p_data[i * s + j - 2 * s], i == 0 ? m : p_data[i * s + j - s], p_data[i * s + j]});
-			ent[4] = entropy<3u>(vec);
-		}
-
-		// 5 - a, c, x
-		{
-			vector<array<uint32_t, 3>> vec;
-
-			for (uint32_t i = 0; i < no_rows; ++i)
-				for (uint32_t j = 0; j < s; ++j)
-					vec.emplace_back(array<uint32_t, 3>{j == 0 ? m : p_data[i * s + j - 1], i == 0 ? m : p_data[i * s + j - s], p_data[i * s + j]});
-			ent[5] = entropy<3u>(vec);
-		}
-
-		// 6 - p, a, x
-		{
-			vector<array<uint32_t, 3>> vec;
-
-			for (uint32_t i = 0; i < no_rows; ++i)
-				for (uint32_t j = 0; j < s; ++j)
-					vec.emplace_back(array<uint32_t, 3>{j, j == 0 ? m : p_data[i * s + j - 1], p_data[i * s + j]});
-			ent[6] = entropy<3u>(vec);
-		}
-
-		// 7 - p, c, x
-		{
-			vector<array<uint32_t, 3>> vec;
-
-			for (uint32_t i = 0; i < no_rows; ++i)
-				for (uint32_t j = 0; j < s; ++j)
-					vec.emplace_back(array<uint32_t, 3>{j, i == 0 ? m : p_data[i * s + j - s], p_data[i * s + j]});
-			ent[7] = entropy<3u>(vec);
-		}
-
-		// 8 - p, x
-		{
-			vector<array<uint32_t, 2>> vec;
-
-			for (uint32_t i = 0; i < no_rows; ++i)
-				for (uint32_t j = 0; j < s; ++j)
-					vec.emplace_back(array<uint32_t, 2>{j, p_data[i * s + j]});
-			ent[8] = entropy<2u>(vec);
-		}
+		estimate_ctx_costs(p_data, no_rows, s, (1u << 9) - 1, ent);
 
 		ctx_mode = (uint32_t) (min_element(ent.begin(), ent.end()) - ent.begin()) + 1;
 
@@ -909,6 +985,8 @@ void CFormatCompress::encode_format_many(vector<uint32_t>& v_size, vector<uint8_
 	int cur_items_per_sample = 0;
 	int prev_items_per_sample = 0;
 
+	v_block_same.assign(max(1u, no_samples), 0);
+
 	for (uint32_t i = 0; i < v_size.size(); ++i)
 	{
 		int c_size = v_size[i];
@@ -920,9 +998,14 @@ void CFormatCompress::encode_format_many(vector<uint32_t>& v_size, vector<uint8_
 			{
 				if (i > 0 && prev_items_per_sample == cur_items_per_sample)
 				{
-					auto p_enc = find_rce_coder(ctx_map_same, 0u, 2, 19, 16);
+					size_t ref_dist = block_mode ? v_size[i - 1] : prev_items_per_sample;
+					auto p_enc = find_rce_coder(ctx_map_same, block_mode ? v_block_same[j] : 0u, 2, 19, 16);
 
-					if (memcmp(cur_line, cur_line - prev_items_per_sample, entry_bytes) == 0)
+					bool same = memcmp(cur_line, cur_line - ref_dist, entry_bytes) == 0;
+					if (block_mode)
+						v_block_same[j] = same;
+
+					if (same)
 					{
 						p_enc->Encode(1);
 						cur_line += cur_items_per_sample;
@@ -1032,6 +1115,8 @@ void CFormatCompress::decode_format_many(vector<uint32_t>& v_size, vector<uint8_
 	cout << "Start decode_format_many\n";
 #endif
 
+	v_block_same.assign(max(1u, no_samples), 0);
+
 	for (uint32_t i = 0; i < v_size.size(); ++i)
 	{
 		int c_size = v_size[i];
@@ -1043,15 +1128,19 @@ void CFormatCompress::decode_format_many(vector<uint32_t>& v_size, vector<uint8_
 		{
 			if (i > 0 && prev_items_per_sample == cur_items_per_sample)
 			{
-				auto p_dec = find_rcd_coder(ctx_map_same, 0u, 2, 19, 16);
+				size_t ref_dist = block_mode ? v_size[i - 1] : prev_items_per_sample;
+				auto p_dec = find_rcd_coder(ctx_map_same, block_mode ? v_block_same[j] : 0u, 2, 19, 16);
+
+				bool same = p_dec->Decode() == 1;
+				if (block_mode)
+					v_block_same[j] = same;
 
-				if (p_dec->Decode() == 1)
+				if (same)
 				{
-					int eb4 = entry_bytes / 4;
 					v_data.resize(v_data.size() + entry_bytes);
 					for (int k = 0; k < entry_bytes / 4; ++k)
 					{
-						*cur_line = *(cur_line - eb4);
+						*cur_line = *(cur_line - ref_dist);
 						++cur_line;
 					}
 					continue;
@@ -17,6 +17,7 @@
 #include "rc.h"
 #include "sub_rc.h"
 #include "context_hm.h"
+#include "state.h"
 
 using namespace std;
 
@@ -27,6 +28,10 @@ class CFormatCompress
 
 	uint32_t no_samples;
 
+	// Block mode (gVCF): entries are compared with the same sample of the previous record instead of the previous sample
+	bool block_mode;
+	vector<uint8_t> v_block_same;
+
 	CVectorIOStream* vios_i;
 	CVectorIOStream* vios_o;
 
@@ -56,23 +61,19 @@ class CFormatCompress
 	inline ctx_map_t::value_type find_rce_coder(ctx_map_t &map, context_t ctx, uint32_t no_symbols, uint32_t max_log_counter, uint32_t adder);
 	inline ctx_map_t::value_type find_rcd_coder(ctx_map_t& map, context_t ctx, uint32_t no_symbols, uint32_t max_log_counter, uint32_t adder);
 
-	template <unsigned SIZE> 
-	class array_hash
-	{
-	public:
-		size_t operator()(const array<uint32_t, SIZE>& x) const {
-			size_t r = 0;
-			for (auto a : x)
-				r ^= hash<uint32_t>{}(a);
+	// Context mode is chosen on a sample of rows (evenly spaced blocks) of the part
+	const uint32_t max_ctx_sample_items = 1u << 17;
+	const uint32_t max_ctx_sample_blocks = 16;
 
-			return r;
-		}
-	};
+	// Candidate contexts in sample tuples are packed into 64-bit keys (ranks of values)
+	const uint32_t ctx_key_bits = 21;
+	const uint64_t ctx_key_mask = (1ull << 21) - 1;
 
 	void encode_ctx_type(int ctx_type);
 	int decode_ctx_type();
 
-	template <unsigned SIZE> double entropy(vector<array<uint32_t, SIZE>> &vec);
+	void estimate_ctx_costs(const uint32_t* p_data, uint32_t no_rows, uint32_t row_size, uint32_t candidates, array<double, 9>& costs);
+	double ctx_cost(vector<uint64_t>& v_keys, double scale);
 
 	void encode_info_one(vector<uint8_t>& v_data, vector<uint8_t>& v_compressed);
 	void encode_info_constant(uint32_t val, vector<uint8_t>& v_data, vector<uint8_t>& v_compressed);
@@ -104,6 +105,11 @@ public:
 	~CFormatCompress();
 
 	void SetNoSamples(uint32_t _no_samples);
+	void SetBlockMode(bool _block_mode);
+	size_t GetMemoryUsage() const;
+
+	void SaveState(CState& state);
+	bool LoadState(CState& state);
 
 	void EncodeFormat(vector<uint32_t>& v_size, vector<uint8_t>& v_data, vector<uint8_t>& v_compressed);
 	void EncodeInfo(vector<uint32_t>& v_size, vector<uint8_t>& v_data, vector<uint8_t>& v_compressed);
@@ -10,11 +10,12 @@
 #include <iostream>
 #include <algorithm>
 #include <cstdio>
+#include <cstdlib>
+#include <cctype>
 #include <string>
 #include <vector>
 #include <list>
 #include <unordered_map>
-#include <nmmintrin.h>
 #include <chrono>
 
 #include "params.h"
@@ -25,6 +26,7 @@
 #include "sub_rc.h"
 #include "io.h"
 #include "utils.h"
+#include "trace.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -33,9 +35,11 @@ CParams params;
 CApplication *app;
 
 bool parse_params(int argc, char **argv);
+bool parse_memory_size(const string& str, size_t& size);
 void usage_main();
 void usage_compress();
 void usage_decompress();
+void usage_verify();
 
 // ******************************************************************************
 void usage_main()
@@ -45,6 +49,7 @@ void usage_main()
 	cerr << "  mode - one of:\n";
 	cerr << "    compress   - compress VCF file\n";
 	cerr << "    decompress - decompress VCF file\n";
+	cerr << "    verify     - check integrity of archive\n";
 }
 
 // ******************************************************************************
@@ -57,6 +62,19 @@ void usage_compress()
 	cerr << "Options:\n";
     cerr << "  -nl <value> - ignore rare variants; value is a limit of alternative alleles (default: " << params.neglect_limit << ")\n";
     cerr << "  -t <value>  - max. no. of compressing threads (default: " << params.no_threads << ")\n";
+	cerr << "  --stats <file> - save statistics of compression as JSON\n";
+	cerr << "  --max-memory <size> - memory budget, e.g., 512M, 4G (plain number in MB; default: unlimited)\n";
+	cerr << "  --hot-file - store site-level streams (variant descriptions, FILTER, INFO) in a companion file <archive>.hot\n";
+	cerr << "  --gvcf - gVCF mode: dedicated coding of reference blocks (END, <NON_REF>/<*> ALT, block-constant FORMAT values)\n";
+	cerr << "  --pbwt-format-order - code FORMAT fields in PBWT order of samples (samples with similar haplotypes are adjacent)\n";
+	cerr << "  --row-groups <n> - flush parts of all streams together every n variants (or earlier if any part is full); groups are coded independently (not with --pbwt-format-order)\n";
+	cerr << "  --lossy <profile> - quantise FORMAT fields and QUAL; profile: moderate, aggressive or list of rules, e.g., GQ:bin,DP:cap=100,PL:top=2,QUAL:round (default: lossless)\n";
+	cerr << "  --append-only - write append-only archive with periodic checkpoints (readable up to the last checkpoint if interrupted; not with --hot-file)\n";
+	cerr << "  --checkpoint <n> - save state of compression to <archive>.resume every n variants (implies --append-only)\n";
+	cerr << "  --resume - continue interrupted compression from the state saved in <archive>.resume (implies --append-only)\n";
+#ifdef VCFSHARK_TRACE
+	cerr << "  --trace <file> - save pipeline trace (Chrome trace-event JSON)\n";
+#endif
 }
 
 // ******************************************************************************
@@ -64,12 +82,71 @@ void usage_decompress()
 {
 	cerr << "vcfshark decompress [options] <archive> <output_vcf>\n";
 	cerr << "Parameters:\n";
-	cerr << "  archive   - path to input file with compressed VCF file\n";
-	cerr << "  output_vcf - path to output VCF file\n";
+	cerr << "  archive   - path to input file with compressed VCF file (- for append-only archive read from stdin)\n";
+	cerr << "  output_vcf - path to output VCF file (BGZF-compressed if ending with .gz)\n";
     cerr << "Options:\n";
     cerr << "  -b - output BCF file (VCF file by default)\n";
     cerr << "  -c [0-9]   set level of compression of the output bcf (number from 0 to 9; 1 by default; 0 means no compression)\n";
-	cerr << "  -t <value>  - max. no. of compressing threads (default: " << params.no_threads << ")\n";
+	cerr << "  -t <value>  - max. no. of decompressing and record formatting threads (default: " << params.no_threads << ")\n";
+	cerr << "  --split-by-chrom - save each contig in a separate file; output_vcf is a prefix of file names\n";
+	cerr << "  --index - build CSI (BCF) or TBI (VCF, output_vcf ending with .gz) index during writing\n";
+	cerr << "  --stats <file> - save statistics of decompression as JSON\n";
+	cerr << "  --max-memory <size> - report memory usage against the budget, e.g., 512M, 4G\n";
+#ifdef VCFSHARK_TRACE
+	cerr << "  --trace <file> - save pipeline trace (Chrome trace-event JSON)\n";
+#endif
+}
+
+// ******************************************************************************
+void usage_verify()
+{
+	cerr << "vcfshark verify [options] <archive>\n";
+	cerr << "Parameters:\n";
+	cerr << "  archive - path to compressed VCF file\n";
+	cerr << "Options:\n";
+	cerr << "  -t <value>  - max. no. of threads reading parts and decoding (default: " << params.no_threads << ")\n";
+	cerr << "  --decode - decode all variants (without formatting VCF records) after checking signatures of parts\n";
+}
+
+// ******************************************************************************
+// Size with optional K/M/G suffix; a plain number is in MB
+bool parse_memory_size(const string& str, size_t& size)
+{
+	char* end;
+	double val = strtod(str.c_str(), &end);
+
+	if (end == str.c_str() || val <= 0)
+		return false;
+
+	switch (toupper(*end))
+	{
+	case 'K':
+		val *= 1ull << 10;
+		break;
+	case 'G':
+		val *= 1ull << 30;
+		break;
+	case 'M':
+	case '\0':
+		val *= 1ull << 20;
+		break;
+	default:
+		return false;
+	}
+
+	// Nothing may follow the unit and the optional 'B'
+	if (*end)
+	{
+		++end;
+		if (toupper(*end) == 'B')
+			++end;
+		if (*end)
+			return false;
+	}
+
+	size = (size_t) val;
+
+	return true;
 }
 
 // ******************************************************************************
@@ -86,6 +163,8 @@ bool parse_params(int argc, char **argv)
 		params.work_mode = work_mode_t::compress;
 	else if (string(argv[1]) == "decompress")
 		params.work_mode = work_mode_t::decompress;
+	else if (string(argv[1]) == "verify")
+		params.work_mode = work_mode_t::verify;
 
 	// Compress
 	if (params.work_mode == work_mode_t::compress)
@@ -109,10 +188,101 @@ bool parse_params(int argc, char **argv)
 				params.no_threads = atoi(argv[i + 1]);
 				i += 2;
 			}
+			else if (string(argv[i]) == "--stats" && i + 1 < argc - 2)
+			{
+				params.stats_file_name = argv[i + 1];
+				i += 2;
+			}
+			else if (string(argv[i]) == "--max-memory" && i + 1 < argc - 2)
+			{
+				if (!parse_memory_size(argv[i + 1], params.max_memory))
+				{
+					cerr << "Incorrect memory size : " << argv[i + 1] << endl;
+					return false;
+				}
+				i += 2;
+			}
+			else if (string(argv[i]) == "--hot-file")
+			{
+				params.hot_file = true;
+				i++;
+			}
+			else if (string(argv[i]) == "--gvcf")
+			{
+				params.gvcf = true;
+				i++;
+			}
+			else if (string(argv[i]) == "--pbwt-format-order")
+			{
+				params.sample_order = true;
+				i++;
+			}
+			else if (string(argv[i]) == "--row-groups" && i + 1 < argc - 2)
+			{
+				params.row_group_size = (uint32_t) atoi(argv[i + 1]);
+				if (!params.row_group_size)
+				{
+					cerr << "Incorrect row group size : " << argv[i + 1] << endl;
+					return false;
+				}
+				i += 2;
+			}
+			else if (string(argv[i]) == "--append-only")
+			{
+				params.append_only = true;
+				i++;
+			}
+			else if (string(argv[i]) == "--checkpoint" && i + 1 < argc - 2)
+			{
+				params.checkpoint_interval = (size_t) atoll(argv[i + 1]);
+				if (!params.checkpoint_interval)
+				{
+					cerr << "Incorrect checkpoint interval : " << argv[i + 1] << endl;
+					return false;
+				}
+				params.append_only = true;
+				i += 2;
+			}
+			else if (string(argv[i]) == "--resume")
+			{
+				params.resume = true;
+				params.append_only = true;
+				i++;
+			}
+			else if (string(argv[i]) == "--lossy" && i + 1 < argc - 2)
+			{
+				params.lossy_profile = argv[i + 1];
+				i += 2;
+			}
+#ifdef VCFSHARK_TRACE
+			else if (string(argv[i]) == "--trace" && i + 1 < argc - 2)
+			{
+				params.trace_file_name = argv[i + 1];
+				i += 2;
+			}
+#endif
+			else
+			{
+				cerr << "Unknown option : " << argv[i] << endl;
+				usage_compress();
+				return false;
+			}
         }
 
 		params.vcf_file_name = string(argv[i]);
 		params.db_file_name = string(argv[i+1]);
+
+		if (params.append_only && params.hot_file)
+		{
+			cerr << "Options --append-only (also implied by --checkpoint and --resume) and --hot-file cannot be combined\n";
+			return false;
+		}
+
+		if (params.row_group_size && params.sample_order)
+		{
+			cerr << "Options --row-groups and --pbwt-format-order cannot be combined\n";
+			return false;
+		}
 	}
 	else if (params.work_mode == work_mode_t::decompress)
 	{
@@ -135,6 +305,37 @@ bool parse_params(int argc, char **argv)
 				params.no_threads = atoi(argv[i + 1]);
 				i += 2;
 			}
+			else if (string(argv[i]) == "--split-by-chrom")
+			{
+				params.split_by_chrom = true;
+				i++;
+			}
+			else if (string(argv[i]) == "--index")
+			{
+				params.build_index = true;
+				i++;
+			}
+			else if (string(argv[i]) == "--stats" && i + 1 < argc - 2)
+			{
+				params.stats_file_name = argv[i + 1];
+				i += 2;
+			}
+			else if (string(argv[i]) == "--max-memory" && i + 1 < argc - 2)
+			{
+				if (!parse_memory_size(argv[i + 1], params.max_memory))
+				{
+					cerr << "Incorrect memory size : " << argv[i + 1] << endl;
+					return false;
+				}
+				i += 2;
+			}
+#ifdef VCFSHARK_TRACE
+			else if (string(argv[i]) == "--trace" && i + 1 < argc - 2)
+			{
+				params.trace_file_name = argv[i + 1];
+				i += 2;
+			}
+#endif
 			else if (string(argv[i]) == "-c")
             {
                 i++;
@@ -170,6 +371,37 @@ bool parse_params(int argc, char **argv)
 		params.db_file_name = string(argv[i]);
 		params.vcf_file_name = string(argv[i+1]);
 	}
+	else if (params.work_mode == work_mode_t::verify)
+	{
+		if (argc < 3)
+		{
+			usage_verify();
+			return false;
+		}
+
+		int i = 2;
+		while (i < argc - 1)
+		{
+			if (string(argv[i]) == "-t" && i + 1 < argc - 1)
+			{
+				params.no_threads = atoi(argv[i + 1]);
+				i += 2;
+			}
+			else if (string(argv[i]) == "--decode")
+			{
+				params.verify_decode = true;
+				i++;
+			}
+			else
+			{
+				cerr << "Unknown option : " << argv[i] << endl;
+				usage_verify();
+				return false;
+			}
+		}
+
+		params.db_file_name = string(argv[i]);
+	}
 	else
 	{
 		cerr << "Unknown mode : " << argv[2] << endl;
@@ -189,6 +421,14 @@ int main(int argc, char **argv)
 
 	high_resolution_clock::time_point t1 = high_resolution_clock::now();
 
+#ifdef VCFSHARK_TRACE
+	if (!params.trace_file_name.empty())
+	{
+		CTracer::Instance().Enable();
+		TRACE_THREAD_NAME("main");
+	}
+#endif
+
 	app = new CApplication(params);
 
 	bool result = true;
@@ -197,21 +437,29 @@ int main(int argc, char **argv)
 		result = app->CompressDB();
 	else if (params.work_mode == work_mode_t::decompress)
 		result = app->DecompressDB();
+	else if (params.work_mode == work_mode_t::verify)
+		result = app->VerifyDB();
 
 	delete app;
 
+#ifdef VCFSHARK_TRACE
+	if (!params.trace_file_name.empty() && !CTracer::Instance().Save(params.trace_file_name))
+		cerr << "Cannot save trace to: " << params.trace_file_name << endl;
+#endif
+
 	high_resolution_clock::time_point t2 = high_resolution_clock::now();
 
 	duration<double> time_span = duration_cast<duration<double>>(t2 - t1);
 
-	if (!result)
+	if (!result && params.work_mode != work_mode_t::verify)
 		std::cout << "Critical error!\n";
 
 	std::cout << "Processing time: " << time_span.count() << " seconds.\n";
 
 	fflush(stdout);
 
-	return 0;
+	// Failed verification is reported in the exit code (for scripts checking copied archives)
+	return params.work_mode == work_mode_t::verify && !result ? 1 : 0;
 }
 
 // EOF
@@ -0,0 +1,95 @@
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include "mem_governor.h"
+
+#include <iomanip>
+
+// ************************************************************************************
+CMemoryGovernor::CMemoryGovernor(size_t _budget)
+{
+	budget = _budget;
+
+	current.fill(0);
+	peak.fill(0);
+	current_total = 0;
+	peak_total = 0;
+}
+
+// ************************************************************************************
+CMemoryGovernor::~CMemoryGovernor()
+{
+}
+
+// ************************************************************************************
+void CMemoryGovernor::update_peaks(size_t id)
+{
+	if (current[id] > peak[id])
+		peak[id] = current[id];
+
+	if (current_total > peak_total)
+		peak_total = current_total;
+}
+
+// ************************************************************************************
+void CMemoryGovernor::Add(mem_component_t component, int64_t delta)
+{
+	lock_guard<mutex> lck(mtx);
+
+	size_t id = (size_t) component;
+
+	current[id] += delta;
+	current_total += delta;
+
+	update_peaks(id);
+}
+
+// ************************************************************************************
+void CMemoryGovernor::Set(mem_component_t component, int64_t value)
+{
+	lock_guard<mutex> lck(mtx);
+
+	size_t id = (size_t) component;
+
+	current_total += value - current[id];
+	current[id] = value;
+
+	update_peaks(id);
+}
+
+// ************************************************************************************
+int64_t CMemoryGovernor::GetTotal()
+{
+	lock_guard<mutex> lck(mtx);
+
+	return current_total;
+}
+
+// ************************************************************************************
+bool CMemoryGovernor::IsOverBudget()
+{
+	lock_guard<mutex> lck(mtx);
+
+	return budget && current_total > (int64_t) budget;
+}
+
+// ************************************************************************************
+void CMemoryGovernor::Report(ostream& out)
+{
+	lock_guard<mutex> lck(mtx);
+
+	out << "Peak memory usage [MB] (budget: " << (budget >> 20) << " MB)\n";
+
+	for (size_t i = 0; i < no_components; ++i)
+		out << "  " << left << setw(10) << component_names[i] << right << fixed << setprecision(1) << setw(10) << peak[i] / 1048576.0 << "\n";
+
+	out << "  " << left << setw(10) << "total" << right << fixed << setprecision(1) << setw(10) << peak_total / 1048576.0 << "\n";
+}
+
+// EOF
@@ -0,0 +1,58 @@
+#pragma once
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include <cstdint>
+#include <string>
+#include <array>
+#include <mutex>
+#include <iostream>
+
+using namespace std;
+
+enum class mem_component_t {buffers, packages, contexts, scratch, batches};
+
+// ************************************************************************************
+// Accounting of the memory used by the main components (--max-memory)
+// The components report their current usage, the owner of the budget (CCompressedFile)
+// adapts part sizes and the number of packages in flight to the reported total
+class CMemoryGovernor
+{
+	static const size_t no_components = 5;
+	const array<string, no_components> component_names = { "buffers", "packages", "contexts", "scratch", "batches" };
+
+	mutex mtx;
+
+	size_t budget;
+	array<int64_t, no_components> current;
+	array<int64_t, no_components> peak;
+	int64_t current_total;
+	int64_t peak_total;
+
+	void update_peaks(size_t id);
+
+public:
+	CMemoryGovernor(size_t _budget = 0);
+	~CMemoryGovernor();
+
+	size_t GetBudget() const
+	{
+		return budget;
+	}
+
+	void Add(mem_component_t component, int64_t delta);
+	void Set(mem_component_t component, int64_t value);
+
+	int64_t GetTotal();
+	bool IsOverBudget();
+
+	void Report(ostream& out);
+};
+
+// EOF
@@ -13,7 +13,7 @@
 
 using namespace std;
 
-enum class work_mode_t {none, compress, decompress};
+enum class work_mode_t {none, compress, decompress, verify};
 enum class file_type {VCF, BCF};
 
 // ************************************************************************************
@@ -30,6 +30,21 @@ struct CParams
     file_type out_type;
     char bcf_compression_level;
 	bool extra_variants;
+	bool split_by_chrom;		// decompression: one output file per contig, vcf_file_name is a prefix
+	bool build_index;			// decompression: CSI (BCF) or TBI (VCF.gz) index built during writing
+	bool hot_file;				// compression: site-level streams in a companion file <archive>.hot
+	bool gvcf;					// compression: gVCF-aware coding of reference blocks
+	string lossy_profile;		// compression: quantisation of FORMAT fields and QUAL (empty - lossless)
+	bool sample_order;			// compression: FORMAT values coded in PBWT order of samples
+	uint32_t row_group_size;	// compression: no. of variants in a row group (0 - parts of streams flushed separately)
+	bool append_only;			// compression: append-only archive (recoverable up to the last checkpoint)
+	size_t checkpoint_interval;	// compression: no. of variants between saved states of compression (0 - none)
+	bool resume;				// compression: continue from the saved state of an interrupted run
+	bool verify_decode;			// verification: also decode all variants (without formatting)
+
+	string stats_file_name;
+	string trace_file_name;
+	size_t max_memory;			// 0 - unlimited
 
 	// internal params
 	uint32_t neglect_limit;
@@ -44,7 +59,18 @@ struct CParams
         out_type = file_type::VCF;
         bcf_compression_level = '1';
 		extra_variants = false;
+		split_by_chrom = false;
+		build_index = false;
+		hot_file = false;
+		gvcf = false;
+		sample_order = false;
+		row_group_size = 0;
+		append_only = false;
+		checkpoint_interval = 0;
+		resume = false;
+		verify_decode = false;
 		no_threads = 8;
+		max_memory = 0;
 
 		// internal params
 		neglect_limit = 10;
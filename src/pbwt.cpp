@@ -12,6 +12,7 @@
 #include <algorithm>
 #include <iterator>
 #include "utils.h"
+#include "cpu_dispatch.h"
 
 #include <iostream>
 
@@ -122,30 +123,10 @@ bool CPBWT::EncodeFlexible(const uint32_t max_val, vector<uint32_t> &v_input, ve
 
 	v_perm_cur.resize(c_size);
 
-	uint8_t prev_symbol = (uint8_t) v_input[v_perm_prev[0]];
-	uint32_t run_len = 0;
-
 	v_rle.clear();
 
 	// Make PBWT
-	for (size_t i = 0; i < c_size; ++i)
-	{
-		uint8_t cur_symbol = (uint8_t) v_input[v_perm_prev[i]];
-
-		if (cur_symbol == prev_symbol)
-			++run_len;
-		else
-		{
-			v_rle.emplace_back(prev_symbol, run_len);
-			prev_symbol = cur_symbol;
-			run_len = 1;
-		}
-
-		v_perm_cur[v_hist[cur_symbol]] = v_perm_prev[i];
-		++v_hist[cur_symbol];
-	}
-
-	v_rle.emplace_back(prev_symbol, run_len);
+	CPUKernels().pbwt_forward(v_input.data(), v_perm_prev.data(), v_perm_cur.data(), v_hist.data(), c_size, v_rle);
 
 	// Swap only if no. of non-zeros is larger than neglect_limit
 	if (c_size - max_count >= neglect_limit)
@@ -186,30 +167,10 @@ bool CPBWT::DecodeFlexible(const uint32_t max_val, const vector<pair<uint32_t, u
 	else
 		v_perm_prev0.clear();
 
-	auto p_rle = v_rle.begin();
-	uint8_t cur_symbol = (uint8_t) p_rle->first;
-	uint32_t cur_cnt = p_rle->second;
-
 	v_perm_cur.resize(no_items);
 
 	// Make PBWT
-	for (size_t i = 0; i < no_items; ++i)
-	{
-		v_output[v_perm_prev[i]] = cur_symbol;
-
-		v_perm_cur[v_hist[cur_symbol]] = v_perm_prev[i];
-		++v_hist[cur_symbol];
-
-		if (--cur_cnt == 0)
-		{
-			++p_rle;
-			if (i + 1 < no_items)
-			{
-				cur_symbol = (uint8_t) p_rle->first;
-				cur_cnt = p_rle->second;
-			}
-		}
-	}
+	CPUKernels().pbwt_reverse(v_rle.data(), v_perm_prev.data(), v_perm_cur.data(), v_hist.data(), no_items, v_output.data());
 
 	// Swap only if no. of non-zeros is larger than neglect_limit
 	if (no_items - max_count >= neglect_limit)
@@ -220,4 +181,29 @@ bool CPBWT::DecodeFlexible(const uint32_t max_val, const vector<pair<uint32_t, u
 	return true;
 }
 
+// ************************************************************************************
+void CPBWT::SaveState(CState& state)
+{
+	state.Write((uint64_t) no_items);
+	state.Write((uint64_t) neglect_limit);
+	state.Write(v_perm_cur);
+	state.Write(v_perm_prev);
+	state.Write(v_removed_ids);
+}
+
+// ************************************************************************************
+bool CPBWT::LoadState(CState& state)
+{
+	uint64_t _no_items, _neglect_limit;
+
+	if (!state.Read(_no_items) || !state.Read(_neglect_limit) || !state.Read(v_perm_cur) || !state.Read(v_perm_prev) || !state.Read(v_removed_ids))
+		return false;
+
+	no_items = (size_t) _no_items;
+	neglect_limit = (size_t) _neglect_limit;
+	v_tmp.resize(no_items);
+
+	return true;
+}
+
 // EOF
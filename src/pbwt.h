@@ -10,6 +10,7 @@
 
 #include <vector>
 #include "defs.h"
+#include "state.h"
 
 using namespace std;
 
@@ -39,6 +40,9 @@ public:
 
 	bool EncodeFlexible(const uint32_t max_val, vector<uint32_t> &v_input, vector<pair<uint32_t, uint32_t>> &v_rle);
 	bool DecodeFlexible(const uint32_t max_val, const vector<pair<uint32_t, uint32_t>> &v_rle, vector<uint32_t> &v_output);
+
+	void SaveState(CState& state);
+	bool LoadState(CState& state);
 };
 
 // EOF
@@ -0,0 +1,268 @@
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include "quant.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+// ************************************************************************************
+CQuantizer::CQuantizer()
+{
+}
+
+// ************************************************************************************
+CQuantizer::~CQuantizer()
+{
+}
+
+// ************************************************************************************
+bool CQuantizer::parse_rule(const string& str, rule_t& rule)
+{
+	auto p_colon = str.find(':');
+	if (p_colon == string::npos || p_colon == 0)
+		return false;
+
+	rule.field = str.substr(0, p_colon);
+
+	string name = str.substr(p_colon + 1);
+	string value;
+
+	auto p_eq = name.find('=');
+	if (p_eq != string::npos)
+	{
+		value = name.substr(p_eq + 1);
+		name.resize(p_eq);
+	}
+
+	rule.param = 0;
+
+	if (name == "bin")
+	{
+		rule.type = quant_rule_type_t::bin;
+
+		return value.empty();
+	}
+
+	if (name == "round")
+	{
+		rule.type = quant_rule_type_t::round;
+
+		return value.empty() && rule.field == "QUAL";
+	}
+
+	// cap and top are defined for integer fields only
+	if ((name != "cap" && name != "top") || rule.field == "QUAL")
+		return false;
+
+	rule.type = name == "cap" ? quant_rule_type_t::cap : quant_rule_type_t::top;
+
+	char* end;
+	long x = strtol(value.c_str(), &end, 10);
+
+	if (value.empty() || *end || x < 0 || x > INT32_MAX || (rule.type == quant_rule_type_t::top && x == 0))
+		return false;
+
+	rule.param = (uint32_t)x;
+
+	return true;
+}
+
+// ************************************************************************************
+bool CQuantizer::SetProfile(const string& _profile)
+{
+	static const map<string, string> m_presets = {
+		{"moderate", "GQ:bin,DP:cap=255,MIN_DP:cap=255,PL:top=2,QUAL:round"},
+		{"aggressive", "GQ:bin,DP:cap=100,MIN_DP:cap=100,AD:cap=100,PL:top=1,PL:cap=99,QUAL:bin"}
+	};
+
+	auto p = m_presets.find(_profile);
+	string spec = p != m_presets.end() ? p->second : _profile;
+
+	v_rules.clear();
+	v_key_rules.clear();
+	v_qual_rules.clear();
+	profile.clear();
+
+	if (spec.empty())
+		return true;
+
+	for (size_t i = 0; i <= spec.size(); )
+	{
+		size_t j = spec.find(',', i);
+		if (j == string::npos)
+			j = spec.size();
+
+		rule_t rule;
+		if (!parse_rule(spec.substr(i, j - i), rule))
+		{
+			v_rules.clear();
+			v_qual_rules.clear();
+			return false;
+		}
+
+		if (rule.field == "QUAL")
+			v_qual_rules.emplace_back((uint32_t)v_rules.size());
+		v_rules.emplace_back(rule);
+
+		i = j + 1;
+	}
+
+	profile = spec;
+
+	return true;
+}
+
+// ************************************************************************************
+const string& CQuantizer::GetProfile() const
+{
+	return profile;
+}
+
+// ************************************************************************************
+bool CQuantizer::IsEnabled() const
+{
+	return !v_rules.empty();
+}
+
+// ************************************************************************************
+vector<string> CQuantizer::GetFields() const
+{
+	vector<string> v_fields;
+
+	for (auto& x : v_rules)
+		if (x.field != "QUAL" && find(v_fields.begin(), v_fields.end(), x.field) == v_fields.end())
+			v_fields.emplace_back(x.field);
+
+	return v_fields;
+}
+
+// ************************************************************************************
+void CQuantizer::BindKey(const string& field, uint32_t key_id, uint32_t no_keys)
+{
+	v_key_rules.resize(no_keys);
+
+	for (uint32_t i = 0; i < (uint32_t)v_rules.size(); ++i)
+		if (v_rules[i].field == field)
+			v_key_rules[key_id].emplace_back(i);
+}
+
+// ************************************************************************************
+bool CQuantizer::IsBound(uint32_t key_id) const
+{
+	return key_id < v_key_rules.size() && !v_key_rules[key_id].empty();
+}
+
+// ************************************************************************************
+int32_t CQuantizer::bin(int32_t x) const
+{
+	if (x < 2)
+		return x;
+	if (x < 10)
+		return 6;
+	if (x < 20)
+		return 15;
+	if (x < 25)
+		return 22;
+	if (x < 30)
+		return 27;
+	if (x < 35)
+		return 33;
+	if (x < 40)
+		return 37;
+
+	return 40;
+}
+
+// ************************************************************************************
+void CQuantizer::apply(const rule_t& rule, int32_t* p, uint32_t size, uint32_t no_samples)
+{
+	auto is_value = [&](int32_t x) {return x != int_missing && x != int_vector_end; };
+
+	switch (rule.type)
+	{
+	case quant_rule_type_t::bin:
+		for (uint32_t i = 0; i < size; ++i)
+			if (is_value(p[i]))
+				p[i] = bin(p[i]);
+		break;
+	case quant_rule_type_t::cap:
+		for (uint32_t i = 0; i < size; ++i)
+			if (is_value(p[i]) && p[i] > (int32_t)rule.param)
+				p[i] = (int32_t)rule.param;
+		break;
+	case quant_rule_type_t::top:
+	{
+		uint32_t per_sample = size / max(1u, no_samples);
+
+		if (per_sample <= rule.param)
+			break;
+
+		for (uint32_t i = 0; i + per_sample <= size; i += per_sample)
+		{
+			v_tmp.clear();
+			for (uint32_t j = 0; j < per_sample; ++j)
+				if (is_value(p[i + j]))
+					v_tmp.emplace_back(p[i + j]);
+
+			if (v_tmp.size() <= rule.param)
+				continue;
+
+			// The (K+1)-th smallest value is the smallest of the replaced ones
+			nth_element(v_tmp.begin(), v_tmp.begin() + rule.param, v_tmp.end());
+			int32_t limit = v_tmp[rule.param];
+
+			for (uint32_t j = 0; j < per_sample; ++j)
+				if (is_value(p[i + j]) && p[i + j] > limit)
+					p[i + j] = limit;
+		}
+		break;
+	}
+	case quant_rule_type_t::round:
+		break;
+	}
+}
+
+// ************************************************************************************
+void CQuantizer::QuantizeInt(uint32_t key_id, char* data, uint32_t size, uint32_t no_samples)
+{
+	if (!IsBound(key_id) || !data || !size)
+		return;
+
+	// Field data may be unaligned
+	v_values.resize(size);
+	memcpy(v_values.data(), data, size * sizeof(int32_t));
+
+	for (auto id : v_key_rules[key_id])
+		apply(v_rules[id], v_values.data(), size, no_samples);
+
+	memcpy(data, v_values.data(), size * sizeof(int32_t));
+}
+
+// ************************************************************************************
+void CQuantizer::QuantizeQual(float& qual)
+{
+	for (auto id : v_qual_rules)
+		switch (v_rules[id].type)
+		{
+		case quant_rule_type_t::bin:
+			qual = (float)bin((int32_t)roundf(qual));
+			break;
+		case quant_rule_type_t::round:
+			qual = roundf(qual);
+			break;
+		default:
+			break;
+		}
+}
+
+// EOF
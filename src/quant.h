@@ -0,0 +1,72 @@
+#pragma once
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum class quant_rule_type_t {bin, cap, top, round};
+
+// ************************************************************************************
+// Lossy quantisation of FORMAT fields and QUAL (opt-in, --lossy)
+// A profile is a comma-separated list of rules FIELD:rule[=value] applied in the given order:
+//   bin    - Illumina-style 8-level binning (2-9: 6, 10-19: 15, 20-24: 22, 25-29: 27, 30-34: 33, 35-39: 37, 40+: 40)
+//   cap=N  - values above N are replaced by N
+//   top=K  - per sample only the K smallest values (most likely genotypes for PL) are kept,
+//            the remaining ones are replaced by the smallest of them
+//   round  - rounding to integer (QUAL)
+// FIELD is a name of an integer FORMAT field or QUAL; missing values are never changed
+class CQuantizer
+{
+	struct rule_t {
+		string field;
+		quant_rule_type_t type;
+		uint32_t param;
+	};
+
+	// Special values of integer fields (as in htslib)
+	static const int32_t int_missing = INT32_MIN;
+	static const int32_t int_vector_end = INT32_MIN + 1;
+
+	string profile;
+	vector<rule_t> v_rules;
+	vector<vector<uint32_t>> v_key_rules;		// ids of rules for each key
+	vector<uint32_t> v_qual_rules;
+
+	vector<int32_t> v_values;
+	vector<int32_t> v_tmp;
+
+	bool parse_rule(const string& str, rule_t& rule);
+	int32_t bin(int32_t x) const;
+	void apply(const rule_t& rule, int32_t* p, uint32_t size, uint32_t no_samples);
+
+public:
+	CQuantizer();
+	~CQuantizer();
+
+	// Set profile (name of a preset or list of rules); false for incorrect profile
+	bool SetProfile(const string& _profile);
+	const string& GetProfile() const;
+	bool IsEnabled() const;
+
+	// Names of fields used in rules (except QUAL)
+	vector<string> GetFields() const;
+
+	// Bind rules for field to key of given id
+	void BindKey(const string& field, uint32_t key_id, uint32_t no_keys);
+	bool IsBound(uint32_t key_id) const;
+
+	void QuantizeInt(uint32_t key_id, char* data, uint32_t size, uint32_t no_samples);
+	void QuantizeQual(float& qual);
+};
+
+// EOF
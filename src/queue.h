@@ -18,6 +18,9 @@
 #include <atomic>
 #include <vector>
 #include <map>
+#include <algorithm>
+
+#include "trace.h"
 
 using namespace std;
 
@@ -164,6 +167,7 @@ public:
 	//
 	void Push(T data)
 	{
+		TRACE_BUSY("queue_push", "queue");
 		unique_lock<mutex> lck(mtx);
 		bool was_empty = n_elements == 0;
 		q.push(data);
@@ -186,6 +190,7 @@ public:
 	//
 	void PushRange(vector<T> &data)
 	{
+		TRACE_BUSY("queue_push", "queue");
 		unique_lock<mutex> lck(mtx);
 		bool was_empty = n_elements == 0;
 		
@@ -201,8 +206,12 @@ public:
 	//
 	bool Pop(T &data)
 	{
+		TRACE_BUSY("queue_pop", "queue");
 		unique_lock<mutex> lck(mtx);
-		cv_queue_empty.wait(lck, [this]{return !this->q.empty() || !this->n_producers;}); 
+		{
+			TRACE_BLOCKED("queue_pop_wait", "queue");
+			cv_queue_empty.wait(lck, [this]{return !this->q.empty() || !this->n_producers;}); 
+		}
 
 		if(n_elements == 0)
 			return false;
@@ -224,4 +233,273 @@ public:
 	}
 };
 
+// ************************************************************************************
+// Multithreading scheduler of ordered work:
+//   * each item is a part of a stream and is processed in one or more stages
+//   * stage s of part k becomes runnable only once stage s of part k-1 (same stream) and stage s-1 of part k are completed,
+//     so idle threads never wait for a predecessor and always get runnable work
+//   * among runnable tasks the one of the stream with the largest remaining work (backlog x measured cost per unit) goes first,
+//     so the longest sequential chains start as early as possible
+template<typename T> class COrderedScheduler
+{
+public:
+	struct task_t {
+		T data;
+		int stream_id;
+		int part_id;
+		int stage;
+		size_t work;							// size of the task (e.g., no. of bytes)
+	};
+
+private:
+	const double cost_rate_smoothing = 0.25;
+
+	vector<int> v_no_stages;
+	vector<vector<int>> v_next_part_ids;		// [stream][stage] - part allowed to be processed next
+	vector<map<int, task_t>> v_waiting;			// tasks waiting for a predecessor (key: part id)
+	vector<task_t> v_ready;
+
+	vector<size_t> v_backlog;					// work of tasks pushed but not completed (per stream)
+	vector<vector<double>> v_cost_rates;		// [stream][stage] - measured time per unit of work (0 - not measured yet)
+
+	int n_producers;
+	size_t n_tasks;								// tasks pushed but not completed in all stages
+
+	mutable mutex mtx;
+	condition_variable cv_ready;
+	condition_variable cv_idle;
+
+	// *****************************************************************************************
+	// Must be called under the lock
+	void make_ready(task_t &&task)
+	{
+		v_ready.emplace_back(move(task));
+		cv_ready.notify_one();
+	}
+
+	// *****************************************************************************************
+	// Estimated time to complete all the pushed tasks of the stream; must be called under the lock
+	double remaining_cost(int stream_id, double default_rate) const
+	{
+		double rate = 0;
+
+		for (auto x : v_cost_rates[stream_id])
+			rate += x > 0 ? x : default_rate;
+
+		return rate * (double) v_backlog[stream_id];
+	}
+
+	// *****************************************************************************************
+	// Average of the measured cost rates (used for streams without measurements); must be called under the lock
+	double default_cost_rate() const
+	{
+		double sum = 0;
+		int cnt = 0;
+
+		for (auto &v : v_cost_rates)
+			for (auto x : v)
+				if (x > 0)
+				{
+					sum += x;
+					++cnt;
+				}
+
+		return cnt ? sum / cnt : 1.0;
+	}
+
+	// *****************************************************************************************
+	// Must be called under the lock
+	void schedule(task_t &&task)
+	{
+		if (v_next_part_ids[task.stream_id][task.stage] == task.part_id)
+			make_ready(move(task));
+		else
+			v_waiting[task.stream_id].emplace(task.part_id, move(task));
+	}
+
+public:
+	// *****************************************************************************************
+	//
+	COrderedScheduler(int _n_producers, const vector<int> &_v_no_stages)
+	{
+		Restart(_n_producers, _v_no_stages);
+	}
+
+	// *****************************************************************************************
+	//
+	~COrderedScheduler()
+	{};
+
+	// *****************************************************************************************
+	//
+	void Restart(int _n_producers, const vector<int> &_v_no_stages)
+	{
+		lock_guard<mutex> lck(mtx);
+
+		n_producers = _n_producers;
+		n_tasks = 0;
+
+		v_no_stages = _v_no_stages;
+		v_next_part_ids.clear();
+		for (auto x : v_no_stages)
+			v_next_part_ids.emplace_back(x, 0);
+
+		v_waiting.clear();
+		v_waiting.resize(v_no_stages.size());
+		v_ready.clear();
+
+		v_backlog.assign(v_no_stages.size(), 0);
+		v_cost_rates.clear();
+		for (auto x : v_no_stages)
+			v_cost_rates.emplace_back(x, 0.0);
+	}
+
+	// *****************************************************************************************
+	//
+	bool IsCompleted()
+	{
+		lock_guard<mutex> lck(mtx);
+
+		return n_tasks == 0 && n_producers == 0;
+	}
+
+	// *****************************************************************************************
+	//
+	void MarkCompleted()
+	{
+		lock_guard<mutex> lck(mtx);
+		n_producers--;
+
+		if (!n_producers)
+			cv_ready.notify_all();
+	}
+
+	// *****************************************************************************************
+	//
+	void Push(int stream_id, int part_id, T &&data, size_t work)
+	{
+		TRACE_BUSY("queue_push", "queue");
+		lock_guard<mutex> lck(mtx);
+
+		++n_tasks;
+		v_backlog[stream_id] += work;
+		schedule(task_t{move(data), stream_id, part_id, 0, work});
+	}
+
+	// *****************************************************************************************
+	// Returns false when all tasks are completed and there will be no new ones
+	bool Pop(task_t &task)
+	{
+		TRACE_BUSY("queue_pop", "queue");
+		unique_lock<mutex> lck(mtx);
+		{
+			TRACE_BLOCKED("queue_pop_wait", "queue");
+			cv_ready.wait(lck, [this] {return !this->v_ready.empty() || (!this->n_producers && !this->n_tasks); });
+		}
+
+		if (v_ready.empty())
+			return false;
+
+		// There is at most one runnable task per stream and stage, so a linear scan is cheap
+		double default_rate = default_cost_rate();
+		size_t best = 0;
+		double best_cost = remaining_cost(v_ready[0].stream_id, default_rate);
+
+		for (size_t i = 1; i < v_ready.size(); ++i)
+		{
+			double cost = remaining_cost(v_ready[i].stream_id, default_rate);
+			if (cost > best_cost)
+			{
+				best = i;
+				best_cost = cost;
+			}
+		}
+
+		task = move(v_ready[best]);
+		v_ready.erase(v_ready.begin() + best);
+
+		return true;
+	}
+
+	// *****************************************************************************************
+	// Marks the current stage of the task as completed (time - time of processing the stage);
+	// the task is scheduled for its next stage (if any)
+	void Complete(task_t &task, double time)
+	{
+		lock_guard<mutex> lck(mtx);
+
+		if (task.work)
+		{
+			double &rate = v_cost_rates[task.stream_id][task.stage];
+			double cur_rate = max(time, 0.0) / (double) task.work;
+
+			if (rate > 0)
+				rate += cost_rate_smoothing * (cur_rate - rate);
+			else
+				rate = cur_rate;
+		}
+
+		int next_part_id = ++v_next_part_ids[task.stream_id][task.stage];
+
+		auto &waiting = v_waiting[task.stream_id];
+		auto p = waiting.find(next_part_id);
+		if (p != waiting.end() && p->second.stage == task.stage)
+		{
+			make_ready(move(p->second));
+			waiting.erase(p);
+		}
+
+		if (task.stage + 1 < v_no_stages[task.stream_id])
+		{
+			++task.stage;
+			schedule(move(task));
+		}
+		else
+		{
+			v_backlog[task.stream_id] -= task.work;
+
+			if (--n_tasks == 0)
+			{
+				cv_idle.notify_all();
+				if (!n_producers)
+					cv_ready.notify_all();
+			}
+		}
+	}
+
+	// *****************************************************************************************
+	// Waits until all the pushed tasks are completed in all stages
+	void WaitForIdle()
+	{
+		unique_lock<mutex> lck(mtx);
+		cv_idle.wait(lck, [this] {return this->n_tasks == 0; });
+	}
+
+	// *****************************************************************************************
+	// Parts of the stream are numbered from part_id (e.g., when appending to an existing archive)
+	void SetNextPartId(int stream_id, int part_id)
+	{
+		lock_guard<mutex> lck(mtx);
+
+		for (auto &x : v_next_part_ids[stream_id])
+			x = part_id;
+	}
+
+	// *****************************************************************************************
+	//
+	int GetNoStages(int stream_id) const
+	{
+		return v_no_stages[stream_id];
+	}
+
+	// *****************************************************************************************
+	//
+	size_t GetSize()
+	{
+		lock_guard<mutex> lck(mtx);
+
+		return n_tasks;
+	}
+};
+
 // EOF
@@ -10,6 +10,7 @@
 
 #include "defs.h"
 #include "sub_rc.h"
+#include "state.h"
 #include <cmath>
 #include <algorithm>
 #include <numeric>
@@ -170,6 +171,30 @@ public:
 		for (uint32_t i = 0; i < n_symbols; ++i)
 			total += stats[i] = stats_to_set[i];
 	}
+
+	void SaveState(CState& state)
+	{
+		state.Write(n_symbols);
+		state.Write(max_total);
+		state.Write(total);
+		state.Write(adder);
+		state.Write(vector<uint32_t>(stats, stats + n_symbols));
+	}
+
+	bool LoadState(CState& state)
+	{
+		vector<uint32_t> v_stats;
+
+		if (!state.Read(n_symbols) || !state.Read(max_total) || !state.Read(total) || !state.Read(adder) || !state.Read(v_stats) || v_stats.size() != n_symbols)
+			return false;
+
+		if (stats)
+			delete[] stats;
+		stats = new uint32_t[n_symbols];
+		copy_n(v_stats.data(), n_symbols, stats);
+
+		return true;
+	}
 };
 
 // *******************************************************************************************
@@ -597,6 +622,23 @@ public:
 	{
 		return stats;
 	}
+
+	void SaveState(CState& state)
+	{
+		state.Write(n_symbols);
+		state.Write(compact);
+		state.Write(compact_limit);
+		state.Write(max_total);
+		state.Write(total);
+		state.Write(adder);
+		state.Write(stats);
+	}
+
+	bool LoadState(CState& state)
+	{
+		return state.Read(n_symbols) && state.Read(compact) && state.Read(compact_limit) && state.Read(max_total) && 
+			state.Read(total) && state.Read(adder) && state.Read(stats);
+	}
 };
 
 
@@ -692,6 +734,22 @@ public:
 	{
 		model.Init(no_symbols, init, rescale, adder);
 	}
+
+	void SaveState(CState& state)
+	{
+		state.Write(no_symbols);
+		state.Write(lg_totf);
+		state.Write(totf);
+		state.Write(rescale);
+		state.Write(adder);
+		model.SaveState(state);
+	}
+
+	bool LoadState(CState& state)
+	{
+		return state.Read(no_symbols) && state.Read(lg_totf) && state.Read(totf) && state.Read(rescale) && state.Read(adder) && 
+			model.LoadState(state);
+	}
 };
 
 // *******************************************************************************************
@@ -0,0 +1,177 @@
+#pragma once
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+using namespace std;
+
+// ************************************************************************************
+// Serialised state of the compressor (checkpoints of compression, --resume)
+// Values are stored in the native byte order, so a state can be resumed only on the same platform
+class CState
+{
+	const string magic = "VCFSHARK_STATE_1";
+
+	vector<uint8_t> v_data;
+	size_t pos;
+	bool ok;
+
+public:
+	CState() : pos(0), ok(true)
+	{};
+
+	bool Ok() const
+	{
+		return ok;
+	}
+
+	// ************************************************************************************
+	template<typename T> void Write(const T x)
+	{
+		static_assert(is_trivially_copyable<T>::value, "Only plain values can be stored directly");
+
+		v_data.insert(v_data.end(), (const uint8_t*) &x, (const uint8_t*) &x + sizeof(T));
+	}
+
+	// ************************************************************************************
+	void Write(const string& s)
+	{
+		Write<uint64_t>(s.size());
+		v_data.insert(v_data.end(), s.begin(), s.end());
+	}
+
+	// ************************************************************************************
+	template<typename T> void Write(const vector<T>& v)
+	{
+		static_assert(is_trivially_copyable<T>::value, "Only vectors of plain values can be stored directly");
+
+		Write<uint64_t>(v.size());
+		if (!v.empty())
+			v_data.insert(v_data.end(), (const uint8_t*) v.data(), (const uint8_t*) (v.data() + v.size()));
+	}
+
+	// ************************************************************************************
+	template<typename T> bool Read(T& x)
+	{
+		static_assert(is_trivially_copyable<T>::value, "Only plain values can be read directly");
+
+		if (!ok || pos + sizeof(T) > v_data.size())
+			return ok = false;
+
+		memcpy(&x, v_data.data() + pos, sizeof(T));
+		pos += sizeof(T);
+
+		return true;
+	}
+
+	// ************************************************************************************
+	bool Read(string& s)
+	{
+		uint64_t size;
+
+		if (!Read(size) || pos + size > v_data.size())
+			return ok = false;
+
+		s.assign((const char*) v_data.data() + pos, size);
+		pos += size;
+
+		return true;
+	}
+
+	// ************************************************************************************
+	template<typename T> bool Read(vector<T>& v)
+	{
+		static_assert(is_trivially_copyable<T>::value, "Only vectors of plain values can be read directly");
+
+		uint64_t size;
+
+		if (!Read(size) || size > (v_data.size() - pos) / sizeof(T))
+			return ok = false;
+
+		v.resize(size);
+		if (size)
+			memcpy(v.data(), v_data.data() + pos, size * sizeof(T));
+		pos += size * sizeof(T);
+
+		return true;
+	}
+
+	// ************************************************************************************
+	// The state is written to a temporary file and renamed, so the previous state survives an interruption
+	bool Save(const string& file_name)
+	{
+		string tmp_name = file_name + ".tmp";
+		FILE* f = fopen(tmp_name.c_str(), "wb");
+
+		if (!f)
+			return false;
+
+		uint64_t size = v_data.size();
+
+		bool r = fwrite(magic.c_str(), 1, magic.size(), f) == magic.size();
+		r &= fwrite(&size, sizeof(size), 1, f) == 1;
+		r &= v_data.empty() || fwrite(v_data.data(), 1, v_data.size(), f) == v_data.size();
+		r &= fflush(f) == 0;
+		r &= fclose(f) == 0;
+
+		if (!r)
+		{
+			remove(tmp_name.c_str());
+			return false;
+		}
+
+#ifdef _WIN32
+		remove(file_name.c_str());
+#endif
+
+		return rename(tmp_name.c_str(), file_name.c_str()) == 0;
+	}
+
+	// ************************************************************************************
+	bool Load(const string& file_name)
+	{
+		FILE* f = fopen(file_name.c_str(), "rb");
+
+		v_data.clear();
+		pos = 0;
+		ok = false;
+
+		if (!f)
+			return false;
+
+		string file_magic(magic.size(), ' ');
+		uint64_t size = 0;
+
+		fseek(f, 0, SEEK_END);
+		uint64_t file_size = (uint64_t) ftell(f);
+		fseek(f, 0, SEEK_SET);
+
+		bool r = fread(&file_magic[0], 1, magic.size(), f) == magic.size() && file_magic == magic;
+		r = r && fread(&size, sizeof(size), 1, f) == 1;
+		r = r && size == file_size - magic.size() - sizeof(size);
+
+		if (r)
+		{
+			v_data.resize(size);
+			r = size == 0 || fread(v_data.data(), 1, size, f) == size;
+		}
+
+		fclose(f);
+
+		return ok = r;
+	}
+};
+
+// EOF
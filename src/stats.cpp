@@ -0,0 +1,286 @@
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include "stats.h"
+#include "cpu_dispatch.h"
+
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+using namespace std;
+
+// ************************************************************************************
+CStats::CStats()
+{
+	no_threads = 0;
+	no_variants = 0;
+	no_samples = 0;
+	total_time = 0;
+
+	stage_times.fill(0);
+}
+
+// ************************************************************************************
+CStats::~CStats()
+{
+}
+
+// ************************************************************************************
+// CPU time of the calling thread (wall time if not available)
+double CStats::ThreadTime()
+{
+#ifndef _WIN32
+	timespec ts;
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+		return (double) ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ************************************************************************************
+void CStats::SetRun(const string& _mode, const string& _input_file_name, const string& _output_file_name, uint32_t _no_threads)
+{
+	lock_guard<mutex> lck(mtx);
+
+	mode = _mode;
+	input_file_name = _input_file_name;
+	output_file_name = _output_file_name;
+	no_threads = _no_threads;
+}
+
+// ************************************************************************************
+void CStats::SetDataset(uint64_t _no_variants, uint32_t _no_samples)
+{
+	lock_guard<mutex> lck(mtx);
+
+	no_variants = _no_variants;
+	no_samples = _no_samples;
+}
+
+// ************************************************************************************
+void CStats::SetTotalTime(double _total_time)
+{
+	lock_guard<mutex> lck(mtx);
+
+	total_time = _total_time;
+}
+
+// ************************************************************************************
+void CStats::SetNoItems(size_t no_items)
+{
+	lock_guard<mutex> lck(mtx);
+
+	v_items.resize(no_items);
+}
+
+// ************************************************************************************
+void CStats::SetItem(size_t item_id, const string& name, const string& codec)
+{
+	lock_guard<mutex> lck(mtx);
+
+	if (item_id >= v_items.size())
+		v_items.resize(item_id + 1);
+
+	v_items[item_id].name = name;
+	v_items[item_id].codec = codec;
+}
+
+// ************************************************************************************
+void CStats::SetItemName(size_t item_id, const string& name)
+{
+	lock_guard<mutex> lck(mtx);
+
+	if (item_id < v_items.size())
+		v_items[item_id].name = name;
+}
+
+// ************************************************************************************
+void CStats::SetCompressedSize(size_t item_id, size_t compressed_bytes)
+{
+	lock_guard<mutex> lck(mtx);
+
+	if (item_id < v_items.size())
+		v_items[item_id].compressed_bytes = compressed_bytes;
+}
+
+// ************************************************************************************
+void CStats::AddEncode(size_t item_id, size_t raw_bytes, double time)
+{
+	lock_guard<mutex> lck(mtx);
+
+	if (item_id >= v_items.size())
+		return;
+
+	v_items[item_id].raw_bytes += raw_bytes;
+	v_items[item_id].encode_time += time > 0 ? time : 0;
+	v_items[item_id].no_parts++;
+
+	stage_times[(size_t) stats_stage_t::codec] += time > 0 ? time : 0;
+}
+
+// ************************************************************************************
+void CStats::AddDecode(size_t item_id, size_t raw_bytes, double time)
+{
+	lock_guard<mutex> lck(mtx);
+
+	if (item_id >= v_items.size())
+		return;
+
+	v_items[item_id].raw_bytes += raw_bytes;
+	v_items[item_id].decode_time += time > 0 ? time : 0;
+	v_items[item_id].no_parts++;
+
+	stage_times[(size_t) stats_stage_t::codec] += time > 0 ? time : 0;
+}
+
+// ************************************************************************************
+void CStats::AddStage(stats_stage_t stage, double time)
+{
+	lock_guard<mutex> lck(mtx);
+
+	stage_times[(size_t) stage] += time > 0 ? time : 0;
+}
+
+// ************************************************************************************
+void CStats::AddArchiveStreams(CArchive& archive)
+{
+	lock_guard<mutex> lck(mtx);
+
+	v_streams.clear();
+
+	for (size_t i = 0; i < archive.GetNoStreams(); ++i)
+	{
+		stream_t s;
+
+		if (archive.GetStreamInfo((int) i, s.name, s.no_parts, s.raw_bytes, s.compressed_bytes))
+			v_streams.emplace_back(s);
+	}
+}
+
+// ************************************************************************************
+string CStats::escape(const string& str)
+{
+	const char* hex = "0123456789abcdef";
+	string r;
+
+	for (auto c : str)
+	{
+		if (c == '"' || c == '\\')
+			r.push_back('\\');
+		else if ((unsigned char) c < 0x20)
+		{
+			// Control characters are not allowed in JSON strings
+			r += "\\u00";
+			r.push_back(hex[(unsigned char) c >> 4]);
+			r.push_back(hex[c & 0xf]);
+			continue;
+		}
+		r.push_back(c);
+	}
+
+	return r;
+}
+
+// ************************************************************************************
+double CStats::throughput(size_t bytes, double time)
+{
+	if (time <= 0)
+		return 0;
+
+	return bytes / time;
+}
+
+// ************************************************************************************
+bool CStats::SaveJSON(const string& file_name)
+{
+	lock_guard<mutex> lck(mtx);
+
+	ofstream ofs(file_name);
+
+	if (!ofs)
+		return false;
+
+	ofs << fixed << setprecision(6);
+
+	ofs << "{\n";
+	ofs << "  \"mode\": \"" << escape(mode) << "\",\n";
+	ofs << "  \"input\": \"" << escape(input_file_name) << "\",\n";
+	ofs << "  \"output\": \"" << escape(output_file_name) << "\",\n";
+	ofs << "  \"threads\": " << no_threads << ",\n";
+	ofs << "  \"cpu_isa\": \"" << CCPUDispatch::Instance().GetISAName() << "\",\n";
+	ofs << "  \"variants\": " << no_variants << ",\n";
+	ofs << "  \"samples\": " << no_samples << ",\n";
+	ofs << "  \"total_time_s\": " << total_time << ",\n";
+
+	ofs << "  \"stages\": {\n";
+	for (size_t i = 0; i < no_stages; ++i)
+		ofs << "    \"" << stage_names[i] << "\": { \"time_s\": " << stage_times[i] << " }" << (i + 1 < no_stages ? "," : "") << "\n";
+	ofs << "  },\n";
+
+	size_t tot_raw = 0, tot_compressed = 0;
+	double tot_encode = 0, tot_decode = 0;
+
+	ofs << "  \"keys\": [\n";
+	for (size_t i = 0; i < v_items.size(); ++i)
+	{
+		auto& x = v_items[i];
+
+		tot_raw += x.raw_bytes;
+		tot_compressed += x.compressed_bytes;
+		tot_encode += x.encode_time;
+		tot_decode += x.decode_time;
+
+		ofs << "    { \"id\": " << i
+			<< ", \"name\": \"" << escape(x.name) << "\""
+			<< ", \"codec\": \"" << escape(x.codec) << "\""
+			<< ", \"raw_bytes\": " << x.raw_bytes
+			<< ", \"compressed_bytes\": " << x.compressed_bytes
+			<< ", \"parts\": " << x.no_parts
+			<< ", \"encode_time_s\": " << x.encode_time
+			<< ", \"decode_time_s\": " << x.decode_time
+			<< ", \"encode_bytes_per_s\": " << throughput(x.raw_bytes, x.encode_time)
+			<< ", \"decode_bytes_per_s\": " << throughput(x.raw_bytes, x.decode_time)
+			<< " }" << (i + 1 < v_items.size() ? "," : "") << "\n";
+	}
+	ofs << "  ],\n";
+
+	ofs << "  \"keys_total\": { \"raw_bytes\": " << tot_raw
+		<< ", \"compressed_bytes\": " << tot_compressed
+		<< ", \"encode_time_s\": " << tot_encode
+		<< ", \"decode_time_s\": " << tot_decode
+		<< ", \"encode_bytes_per_s\": " << throughput(tot_raw, tot_encode)
+		<< ", \"decode_bytes_per_s\": " << throughput(tot_raw, tot_decode)
+		<< " },\n";
+
+	ofs << "  \"streams\": [\n";
+	for (size_t i = 0; i < v_streams.size(); ++i)
+	{
+		auto& x = v_streams[i];
+
+		ofs << "    { \"name\": \"" << escape(x.name) << "\""
+			<< ", \"parts\": " << x.no_parts
+			<< ", \"raw_bytes\": " << x.raw_bytes
+			<< ", \"compressed_bytes\": " << x.compressed_bytes
+			<< " }" << (i + 1 < v_streams.size() ? "," : "") << "\n";
+	}
+	ofs << "  ]\n";
+
+	ofs << "}\n";
+
+	return (bool) ofs;
+}
+
+// EOF
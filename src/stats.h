@@ -0,0 +1,91 @@
+#pragma once
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <array>
+#include <mutex>
+
+#include "archive.h"
+
+using namespace std;
+
+enum class stats_stage_t {parse, buffer, codec, archive_io, vcf_output};
+
+// ************************************************************************************
+// Collector of compression/decompression statistics saved as a JSON report (--stats)
+// Times are CPU times of the threads doing the work summed over threads (archive I/O is the time of file operations)
+class CStats
+{
+	struct item_t {
+		string name;
+		string codec;
+		size_t raw_bytes;
+		size_t compressed_bytes;
+		size_t no_parts;
+		double encode_time;
+		double decode_time;
+
+		item_t() : raw_bytes(0), compressed_bytes(0), no_parts(0), encode_time(0), decode_time(0)
+		{};
+	};
+
+	struct stream_t {
+		string name;
+		size_t no_parts;
+		size_t raw_bytes;
+		size_t compressed_bytes;
+	};
+
+	static const size_t no_stages = 5;
+	const array<string, no_stages> stage_names = { "parse", "buffer", "codec", "archive_io", "vcf_output" };
+
+	mutex mtx;
+
+	string mode;
+	string input_file_name;
+	string output_file_name;
+	uint32_t no_threads;
+	uint64_t no_variants;
+	uint32_t no_samples;
+	double total_time;
+
+	vector<item_t> v_items;
+	vector<stream_t> v_streams;
+	array<double, no_stages> stage_times;
+
+	string escape(const string& str);
+	double throughput(size_t bytes, double time);
+
+public:
+	CStats();
+	~CStats();
+
+	static double ThreadTime();
+
+	void SetRun(const string& _mode, const string& _input_file_name, const string& _output_file_name, uint32_t _no_threads);
+	void SetDataset(uint64_t _no_variants, uint32_t _no_samples);
+	void SetTotalTime(double _total_time);
+
+	void SetNoItems(size_t no_items);
+	void SetItem(size_t item_id, const string& name, const string& codec);
+	void SetItemName(size_t item_id, const string& name);
+	void SetCompressedSize(size_t item_id, size_t compressed_bytes);
+	void AddEncode(size_t item_id, size_t raw_bytes, double time);
+	void AddDecode(size_t item_id, size_t raw_bytes, double time);
+
+	void AddStage(stats_stage_t stage, double time);
+	void AddArchiveStreams(CArchive& archive);
+
+	bool SaveJSON(const string& file_name);
+};
+
+// EOF
@@ -0,0 +1,165 @@
+#pragma once
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// ************************************************************************************
+// Dictionary of strings: open addressing with linear probing over ids of entries; keys are stored one after another
+// in an arena, so there is no allocation per key. Ids are consecutive in the order of insertion.
+class CStringDict
+{
+	typedef struct {
+		uint64_t offset;
+		uint32_t len;
+		uint32_t hash;
+	} entry_t;
+
+	const double max_fill_factor = 0.5;
+
+	vector<uint8_t> v_arena;
+	vector<entry_t> v_entries;
+	vector<uint32_t> v_slots;		// id + 1 (0 - empty slot)
+	size_t slots_mask;
+	size_t size_when_restruct;
+
+	// ************************************************************************************
+	static uint32_t hash(const uint8_t* p, uint32_t len)
+	{
+		uint64_t h = 0x9e3779b97f4a7c15ull ^ len;
+		uint64_t w;
+		uint32_t i = 0;
+
+		for (; i + 8 <= len; i += 8)
+		{
+			memcpy(&w, p + i, 8);
+			h = (h ^ w) * 0xff51afd7ed558ccdull;
+			h ^= h >> 32;
+		}
+
+		if (i < len)
+		{
+			w = 0;
+			memcpy(&w, p + i, len - i);
+			h = (h ^ w) * 0xc4ceb9fe1a85ec53ull;
+		}
+
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+
+		return (uint32_t) h;
+	}
+
+	// ************************************************************************************
+	bool equal(const entry_t& e, const uint8_t* p, uint32_t len, uint32_t h) const
+	{
+		return e.hash == h && e.len == len && (len == 0 || memcmp(v_arena.data() + e.offset, p, len) == 0);
+	}
+
+	// ************************************************************************************
+	void restruct(size_t no_slots)
+	{
+		v_slots.assign(no_slots, 0);
+		slots_mask = no_slots - 1;
+		size_when_restruct = (size_t) ((double) no_slots * max_fill_factor);
+
+		for (uint32_t id = 0; id < (uint32_t) v_entries.size(); ++id)
+		{
+			size_t i = v_entries[id].hash & slots_mask;
+
+			while (v_slots[i])
+				i = (i + 1) & slots_mask;
+
+			v_slots[i] = id + 1;
+		}
+	}
+
+public:
+	static const uint32_t npos = ~0u;
+
+	// ************************************************************************************
+	CStringDict()
+	{
+		Clear();
+	}
+
+	// ************************************************************************************
+	void Clear()
+	{
+		v_arena.clear();
+		v_entries.clear();
+		restruct(1024);
+	}
+
+	// ************************************************************************************
+	size_t Size() const
+	{
+		return v_entries.size();
+	}
+
+	// ************************************************************************************
+	uint32_t Find(const uint8_t* p, uint32_t len) const
+	{
+		uint32_t h = hash(p, len);
+
+		for (size_t i = h & slots_mask; v_slots[i]; i = (i + 1) & slots_mask)
+			if (equal(v_entries[v_slots[i] - 1], p, len, h))
+				return v_slots[i] - 1;
+
+		return npos;
+	}
+
+	// ************************************************************************************
+	uint32_t FindOrInsert(const uint8_t* p, uint32_t len, bool& inserted)
+	{
+		uint32_t h = hash(p, len);
+		size_t i = h & slots_mask;
+
+		for (; v_slots[i]; i = (i + 1) & slots_mask)
+			if (equal(v_entries[v_slots[i] - 1], p, len, h))
+			{
+				inserted = false;
+				return v_slots[i] - 1;
+			}
+
+		uint32_t id = (uint32_t) v_entries.size();
+
+		v_entries.push_back(entry_t{ (uint64_t) v_arena.size(), len, h });
+		v_arena.insert(v_arena.end(), p, p + len);
+		v_slots[i] = id + 1;
+
+		if (v_entries.size() > size_when_restruct)
+			restruct(v_slots.size() * 2);
+
+		inserted = true;
+
+		return id;
+	}
+
+	// ************************************************************************************
+	const uint8_t* Get(uint32_t id, uint32_t& len) const
+	{
+		len = v_entries[id].len;
+
+		return v_arena.data() + v_entries[id].offset;
+	}
+
+	// ************************************************************************************
+	size_t GetMemoryUsage() const
+	{
+		return v_arena.capacity() + v_entries.capacity() * sizeof(entry_t) + v_slots.capacity() * sizeof(uint32_t);
+	}
+};
+
+// EOF
@@ -8,6 +8,7 @@
 // *******************************************************************************************
 
 #include "text_pp.h"
+#include "cpu_dispatch.h"
 
 // ************************************************************************************
 CTextPreprocessing::CTextPreprocessing()
@@ -41,52 +42,140 @@ void CTextPreprocessing::DecodeText(vector<uint8_t>& v_input, vector<uint8_t>& v
 	decompress_part(v_input, pos, v_output);
 }
 
+// ************************************************************************************
+// Dictionary of the encoder (words are stored in the order of codes) and counters of candidate words
+void CTextPreprocessing::SaveState(CState& state)
+{
+	const uint8_t* p;
+	uint32_t len;
+
+	state.Write(dict_id);
+	state.Write((uint64_t) v_code_word.size());
+	for (auto id : v_code_word)
+	{
+		p = words.Get(id, len);
+		state.Write(string((const char*) p, len));
+	}
+
+	state.Write((uint64_t) (words.Size() - v_code_word.size()));
+	for (uint32_t id = 0; id < (uint32_t) words.Size(); ++id)
+		if (v_word_code[id] == no_code)
+		{
+			p = words.Get(id, len);
+			state.Write(string((const char*) p, len));
+			state.Write(v_word_cnt[id]);
+		}
+}
+
+// ************************************************************************************
+bool CTextPreprocessing::LoadState(CState& state)
+{
+	uint64_t size;
+	string str;
+	uint32_t cnt;
+
+	words.Clear();
+	v_word_cnt.clear();
+	v_word_code.clear();
+	v_code_word.clear();
+
+	if (!state.Read(dict_id) || !state.Read(size) || size != dict_id)
+		return false;
+
+	for (uint32_t i = 0; i < dict_id; ++i)
+	{
+		if (!state.Read(str))
+			return false;
+		add_word((const uint8_t*) str.data(), (uint32_t) str.size(), min_word_cnt);
+	}
+
+	if (!state.Read(size))
+		return false;
+
+	for (uint64_t i = 0; i < size; ++i)
+	{
+		if (!state.Read(str) || !state.Read(cnt))
+			return false;
+		add_word((const uint8_t*) str.data(), (uint32_t) str.size(), cnt);
+	}
+
+	return v_code_word.size() == dict_id;
+}
+
+// ************************************************
+// Used when the dictionary is restored (words with min_word_cnt occurrences get the next codes)
+void CTextPreprocessing::add_word(const uint8_t* p, uint32_t len, uint32_t cnt)
+{
+	bool inserted;
+	uint32_t id = words.FindOrInsert(p, len, inserted);
+
+	if (!inserted)
+		return;
+
+	v_word_cnt.emplace_back(cnt);
+	v_word_code.emplace_back(no_code);
+
+	if (cnt >= min_word_cnt)
+	{
+		v_word_code[id] = (uint32_t) v_code_word.size();
+		v_code_word.emplace_back(id);
+	}
+}
+
 // ************************************************
 void CTextPreprocessing::update_dict(vector<uint8_t> &v_input)
 {
-	string str;
-	token_t token;
+	const uint8_t* p = v_input.data();
+	uint32_t size = (uint32_t) v_input.size();
 	uint32_t pos = 0;
+	uint32_t start;
+	uint32_t len;
+	token_t token;
 
 	v_new_words.clear();
 	v_tokens.clear();
 
-	while (pos < v_input.size())
+	while (pos < size)
 	{
-		token = get_token(v_input, pos, str);
-
-		v_tokens.emplace_back(token, str);
+		start = pos;
+		token = get_token(p, size, pos, len);
 
 		if (token == token_t::word)
 		{
-			auto p = m_dict.find(str);
+			bool inserted;
+			uint32_t id = words.FindOrInsert(p + start, len, inserted);
 
-			if (p == m_dict.end())
+			if (inserted)
 			{
-				auto q = t_dict.find(str);
-				if (q == t_dict.end())
-					t_dict.emplace(str, 1);
-				else
-				{
-					q->second++;
-					if (q->second == min_word_cnt)
-					{
-						m_dict.emplace(q->first, dict_id++);
-						v_new_words.emplace_back(q->first);
-						t_dict.erase(q);
-					}
-				}
+				v_word_cnt.emplace_back(1);
+				v_word_code.emplace_back(no_code);
 			}
+			else if (v_word_code[id] == no_code && ++v_word_cnt[id] == min_word_cnt)
+			{
+				v_word_code[id] = dict_id++;
+				v_code_word.emplace_back(id);
+				v_new_words.emplace_back(id);
+			}
+
+			v_tokens.push_back(token_desc_t{ token, start, len, id });
 		}
+		else if (token == token_t::nothing && !v_tokens.empty() && v_tokens.back().type == token_t::nothing)
+			v_tokens.back().len += len;			// plain tokens are adjacent
+		else
+			v_tokens.push_back(token_desc_t{ token, start, len, 0 });
 	}
 }
 
 // ************************************************
 void CTextPreprocessing::store_dict(vector<uint8_t>& v_output)
 {
-	for (auto& s : v_new_words)
+	const uint8_t* p;
+	uint32_t len;
+
+	for (auto id : v_new_words)
 	{
-		v_output.insert(v_output.end(), s.begin(), s.end());
+		p = words.Get(id, len);
+		v_output.insert(v_output.end(), p, p + len);
 		v_output.emplace_back('\n');
 	}
 
@@ -96,54 +185,53 @@ void CTextPreprocessing::store_dict(vector<uint8_t>& v_output)
 // ************************************************
 void CTextPreprocessing::load_dict(vector<uint8_t>& v_input, size_t& pos)
 {
-	string s;
+	if (v_dict_pos.empty())
+		v_dict_pos.emplace_back(0);
 
 	while (true)
 	{
-		uint8_t c = v_input[pos++];
+		size_t start = pos;
 
-		if (c == 0)
-		{
-			if (!s.empty())
-				v_dict.emplace_back(s);
-			s.clear();
-			break;
-		}
-		else if (c == '\n')
+		while (v_input[pos] != '\n' && v_input[pos] != 0)
+			++pos;
+
+		if (pos > start)
 		{
-			if (!s.empty())
-				v_dict.emplace_back(s);
-			s.clear();
+			v_dict_data.insert(v_dict_data.end(), v_input.begin() + start, v_input.begin() + pos);
+			v_dict_pos.emplace_back((uint32_t) v_dict_data.size());
 		}
-		else
-			s.push_back(c);
+
+		if (v_input[pos++] == 0)
+			break;
 	}
 }
 
 // ************************************************
 void CTextPreprocessing::compress_part(vector<uint8_t>& v_input, vector<uint8_t>& v_output)
 {
+	const uint8_t* p = v_input.data();
+
 	for (auto& t : v_tokens)
 	{
-		if (t.first == token_t::word)
+		if (t.type == token_t::word)
 		{
-			auto p = m_dict.find(t.second);
+			uint32_t code = v_word_code[t.word_id];
 
-			if (p != m_dict.end())
-				encode_word(v_output, p->second);
+			if (code != no_code)
+				encode_word(v_output, code);
 			else
-				encode_plain(v_output, t.second);
+				encode_plain(v_output, p + t.pos, t.len);
 		}
-		else if (t.first == token_t::base)
-			encode_base(v_output, t.second);
-		else if (t.first == token_t::number)
-			encode_number(v_output, t.second);
-		else if (t.first == token_t::bars)
-			encode_bars(v_output, (uint32_t) t.second.size());
-		else if (t.first == token_t::zero_run)
-			encode_zero_run(v_output, (uint32_t) t.second.size());
+		else if (t.type == token_t::base)
+			encode_base(v_output, p[t.pos]);
+		else if (t.type == token_t::number)
+			encode_number(v_output, p + t.pos, t.len);
+		else if (t.type == token_t::bars)
+			encode_bars(v_output, t.len);
+		else if (t.type == token_t::zero_run)
+			encode_zero_run(v_output, t.len);
 		else
-			encode_plain(v_output, t.second);
+			encode_plain(v_output, p + t.pos, t.len);
 	}
 }
 
@@ -182,106 +270,65 @@ void CTextPreprocessing::decompress_part(vector<uint8_t>& v_input, size_t& pos,
 }
 
 // ************************************************
-CTextPreprocessing::token_t CTextPreprocessing::get_token(vector<uint8_t>& v, uint32_t& pos, string& str)
+// Returns the token starting at pos (its length in len); pos is moved past the token
+CTextPreprocessing::token_t CTextPreprocessing::get_token(const uint8_t* p, uint32_t size, uint32_t& pos, uint32_t& len)
 {
-	auto c = v[pos];
-
-	str.clear();
+	auto c = p[pos];
+	uint32_t start = pos;
 
 	if (c >= '1' && c <= '9')
 	{
-		parse_number(v, pos, str);
+		for (++pos; pos < size && p[pos] >= '0' && p[pos] <= '9'; ++pos)
+			;
+		len = pos - start;
 
 		return token_t::number;
 	}
 	else if (c == '0')
 	{
-		parse_zero_run(v, pos, str);
+		pos = scan_run(p, size, pos, '0');
+		len = pos - start;
 
 		return token_t::zero_run;
 	}
 	else if (c == '|')
 	{
-		parse_bars(v, pos, str);
+		pos = scan_run(p, size, pos, '|');
+		len = pos - start;
 
 		return token_t::bars;
 	}
 	else if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_')
 	{
-		auto t = parse_word(v, pos, str);
-
-		if (t == token_t::base)
-			return t;
-
-		if (str.size() >= min_word_len)
-			return token_t::word;
-		else
-			return token_t::nothing;
-	}
-
-	str.push_back((char)c);
-	++pos;
-
-	return token_t::nothing;
-}
-
-// ************************************************
-CTextPreprocessing::token_t CTextPreprocessing::parse_word(vector<uint8_t>& v, uint32_t& pos, string& str)
-{
-	str.push_back(v[pos++]);
-
-	if (pos == v.size())
-		return token_t::word;
-
-	if (v[pos] == ':' && (str[0] == 'A' || str[0] == 'C' || str[0] == 'G' || str[0] == 'T'))
-	{
-		str.push_back(v[pos]);
 		++pos;
 
-		return token_t::base;
-	}
-
-	while (pos < v.size())
-	{
-		auto c = v[pos++];
-
-		if (c >= 'A' && c <= 'Z')
-			str.push_back((char)c);
-		else if (c >= 'a' && c <= 'z')
-			str.push_back((char)c);
-		else if (c >= '0' && c <= '9')
-			str.push_back((char)c);
-		else if (c == '_' || c == '(' || c == ')' || c == '&' || c == '/')
-			str.push_back((char)c);
-		else
+		if (pos < size && p[pos] == ':' && (c == 'A' || c == 'C' || c == 'G' || c == 'T'))
 		{
-			--pos;
-			break;
+			++pos;
+			len = 2;
+
+			return token_t::base;
 		}
+
+		pos += (uint32_t) CPUKernels().scan_word_chars(p + pos, size - pos);
+		len = pos - start;
+
+		return len >= min_word_len ? token_t::word : token_t::nothing;
 	}
 
-	return token_t::word;
-}
+	++pos;
+	len = 1;
 
-// ************************************************
-void CTextPreprocessing::parse_number(vector<uint8_t>& v, uint32_t& pos, string& str)
-{
-	for (; pos < v.size() && v[pos] >= '0' && v[pos] <= '9'; ++pos)
-		str.push_back(v[pos]);
+	return token_t::nothing;
 }
 
 // ************************************************
-void CTextPreprocessing::parse_bars(vector<uint8_t>& v, uint32_t& pos, string& str)
+uint32_t CTextPreprocessing::scan_run(const uint8_t* p, uint32_t size, uint32_t pos, uint8_t c)
 {
-	for (; pos < v.size() && v[pos] == '|'; ++pos)
-		str.push_back('|');
-}
+	for (; pos < size && p[pos] == c; ++pos)
+		;
 
-// ************************************************
-void CTextPreprocessing::parse_zero_run(vector<uint8_t>& v, uint32_t& pos, string& str)
-{
-	for (; pos < v.size() && v[pos] == '0'; ++pos)
-		str.push_back('0');
+	return pos;
 }
 
 // ************************************************
@@ -324,31 +371,30 @@ void CTextPreprocessing::encode_word(vector<uint8_t>& v, uint32_t x)
 }
 
 // ************************************************
-void CTextPreprocessing::encode_base(vector<uint8_t>& v, string str)
+void CTextPreprocessing::encode_base(vector<uint8_t>& v, uint8_t c)
 {
-	if (str[0] == 'A')
+	if (c == 'A')
 		v.emplace_back(1);
-	else if (str[0] == 'C')
+	else if (c == 'C')
 		v.emplace_back(2);
-	else if (str[0] == 'G')
+	else if (c == 'G')
 		v.emplace_back(3);
-	else if (str[0] == 'T')
+	else if (c == 'T')
 		v.emplace_back(4);
 }
 
 // ************************************************
-void CTextPreprocessing::encode_plain(vector<uint8_t>& v, string str)
+void CTextPreprocessing::encode_plain(vector<uint8_t>& v, const uint8_t* p, uint32_t len)
 {
-	for (auto c : str)
-		v.emplace_back(c);
+	v.insert(v.end(), p, p + len);
 }
 
 // ************************************************
-void CTextPreprocessing::encode_number(vector<uint8_t>& v, string str)
+void CTextPreprocessing::encode_number(vector<uint8_t>& v, const uint8_t* p, uint32_t len)
 {
-	if (str.size() > 15)
+	if (len > 15)
 	{
-		encode_plain(v, str);
+		encode_plain(v, p, len);
 		return;
 	}
 
@@ -356,8 +402,8 @@ void CTextPreprocessing::encode_number(vector<uint8_t>& v, string str)
 	size_t x = 0;
 	const size_t base = 100;
 
-	for (auto c : str)
-		x = x * 10 + (size_t)(c - '0');
+	for (uint32_t i = 0; i < len; ++i)
+		x = x * 10 + (size_t)(p[i] - '0');
 
 	char t[16];
 	int t_len = 0;
@@ -417,7 +463,7 @@ void CTextPreprocessing::decode_word(vector<uint8_t>& v_input, size_t& pos, vect
 		code += (int)v_input[pos++];
 	}
 
-	v_output.insert(v_output.end(), v_dict[code].begin(), v_dict[code].end());
+	v_output.insert(v_output.end(), v_dict_data.begin() + v_dict_pos[code], v_dict_data.begin() + v_dict_pos[code + 1]);
 }
 
 // ************************************************
@@ -440,9 +486,17 @@ void CTextPreprocessing::decode_number(vector<uint8_t>& v_input, size_t &pos, ve
 		x = x * base + (size_t)(c - 128);
 	}
 
-	string s = to_string(x);
+	char t[24];
+	int t_len = 0;
+
+	do
+	{
+		t[t_len++] = (char) ('0' + x % 10);
+		x /= 10;
+	} while (x);
 
-	v_output.insert(v_output.end(), s.begin(), s.end());
+	while (t_len)
+		v_output.emplace_back(t[--t_len]);
 }
 
 // ************************************************
@@ -458,10 +512,7 @@ void CTextPreprocessing::decode_zero_run(vector<uint8_t>& v_input, size_t& pos,
 			break;
 		}
 
-		int len = 238 - c;
-
-		for (int i = 0; i < len; ++i)
-			v_output.emplace_back('0');
+		v_output.insert(v_output.end(), (size_t) (238 - c), '0');
 	}
 }
 
@@ -478,10 +529,7 @@ void CTextPreprocessing::decode_bars(vector<uint8_t>& v_input, size_t& pos, vect
 			break;
 		}
 
-		int len = 253 - c;
-
-		for (int i = 0; i < len; ++i)
-			v_output.emplace_back('|');
+		v_output.insert(v_output.end(), (size_t) (253 - c), '|');
 	}
 }
 
@@ -19,6 +19,9 @@
 #include <map>
 #include <cstdint>
 
+#include "state.h"
+#include "string_dict.h"
+
 using namespace std;
 
 // ************************************************************************************
@@ -26,18 +29,32 @@ class CTextPreprocessing
 {
 	const uint32_t min_word_cnt = 16;
 	const uint32_t min_word_len = 6;
+	const uint32_t no_code = ~0u;
 
 	enum class token_t { nothing, word, number, bars, zero_run, base };
 
-	unordered_map<string, uint32_t> m_dict;
-	unordered_map<string, uint32_t> t_dict;
+	// Tokens refer to the input text (word_id is the id of a word in the dictionary)
+	typedef struct {
+		token_t type;
+		uint32_t pos;
+		uint32_t len;
+		uint32_t word_id;
+	} token_desc_t;
+
+	// Encoder: words seen so far with their counters; words seen min_word_cnt times get codes
+	CStringDict words;
+	vector<uint32_t> v_word_cnt;
+	vector<uint32_t> v_word_code;
+	vector<uint32_t> v_code_word;
 	
-	vector<string> v_new_words;
+	vector<uint32_t> v_new_words;
 	
-	vector<string> v_dict;
+	// Decoder: words (in the order of codes) stored one after another
+	vector<uint8_t> v_dict_data;
+	vector<uint32_t> v_dict_pos;
 	uint32_t dict_id;
 
-	vector<pair<token_t, string>> v_tokens;
+	vector<token_desc_t> v_tokens;
 
 	// ************************************************
 	template <size_t BASE, size_t RANGE>
@@ -53,12 +70,12 @@ class CTextPreprocessing
 		}
 	}
 
-	token_t get_token(vector<uint8_t> &v, uint32_t& pos, string& str);
+	token_t get_token(const uint8_t* p, uint32_t size, uint32_t& pos, uint32_t& len);
 
 	void encode_word(vector<uint8_t>& v, uint32_t x);
-	void encode_base(vector<uint8_t>& v, string str);
-	void encode_plain(vector<uint8_t>& v, string str);
-	void encode_number(vector<uint8_t>& v, string str);
+	void encode_base(vector<uint8_t>& v, uint8_t c);
+	void encode_plain(vector<uint8_t>& v, const uint8_t* p, uint32_t len);
+	void encode_number(vector<uint8_t>& v, const uint8_t* p, uint32_t len);
 	void encode_bars(vector<uint8_t>& v, uint32_t len);
 	void encode_zero_run(vector<uint8_t>& v, uint32_t len);
 
@@ -68,10 +85,8 @@ class CTextPreprocessing
 	void decode_bars(vector<uint8_t>& v_input, size_t& pos, vector<uint8_t>& v_output);
 	void decode_base(vector<uint8_t>& v, uint32_t c);
 
-	token_t parse_word(vector<uint8_t>& v, uint32_t& pos, string& str);
-	void parse_number(vector<uint8_t>& v, uint32_t& pos, string& str);
-	void parse_bars(vector<uint8_t>& v, uint32_t& pos, string& str);
-	void parse_zero_run(vector<uint8_t>& v, uint32_t& pos, string& str);
+	uint32_t scan_run(const uint8_t* p, uint32_t size, uint32_t pos, uint8_t c);
+	void add_word(const uint8_t* p, uint32_t len, uint32_t cnt);
 
 	void update_dict(vector<uint8_t> &v_input);
 	void store_dict(vector<uint8_t> &v_output);
@@ -85,6 +100,9 @@ public:
 
 	void EncodeText(vector<uint8_t>& v_input, vector<uint8_t>& v_output);
 	void DecodeText(vector<uint8_t>& v_input, vector<uint8_t>& v_output);
+
+	void SaveState(CState& state);
+	bool LoadState(CState& state);
 };
 
 // EOF
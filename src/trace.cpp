@@ -0,0 +1,203 @@
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include "trace.h"
+
+#ifdef VCFSHARK_TRACE
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <algorithm>
+
+using namespace std;
+
+thread_local CTracer::thread_data_t* CTracer::tl_data = nullptr;
+
+// ************************************************************************************
+CTracer::CTracer()
+{
+	enabled = false;
+	t_start = chrono::steady_clock::now();
+}
+
+// ************************************************************************************
+CTracer& CTracer::Instance()
+{
+	static CTracer tracer;
+
+	return tracer;
+}
+
+// ************************************************************************************
+void CTracer::Enable()
+{
+	t_start = chrono::steady_clock::now();
+	enabled = true;
+}
+
+// ************************************************************************************
+CTracer::thread_data_t* CTracer::get_thread_data()
+{
+	if (!tl_data)
+	{
+		lock_guard<mutex> lck(mtx);
+
+		v_threads.emplace_back(new thread_data_t);
+		tl_data = v_threads.back().get();
+		tl_data->tid = (uint32_t) v_threads.size();
+		tl_data->name = "thread_" + to_string(tl_data->tid);
+		tl_data->depth = 0;
+		tl_data->events.reserve(1 << 12);
+		tl_data->no_dropped = 0;
+		tl_data->busy = 0;
+		tl_data->blocked = 0;
+	}
+
+	return tl_data;
+}
+
+// ************************************************************************************
+void CTracer::SetThreadName(const string& name)
+{
+	if (!IsEnabled())
+		return;
+
+	auto td = get_thread_data();
+
+	lock_guard<mutex> lck(mtx);
+	td->name = name;
+}
+
+// ************************************************************************************
+// Time in ns since the tracer was enabled
+int64_t CTracer::Now()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t_start).count();
+}
+
+// ************************************************************************************
+void CTracer::Enter()
+{
+	get_thread_data()->depth++;
+}
+
+// ************************************************************************************
+void CTracer::Leave(const char* name, const char* category, event_kind_t kind, int64_t t_begin)
+{
+	auto td = get_thread_data();
+	int64_t t_end = Now();
+
+	td->depth--;
+
+	// Busy time is the time of outermost busy scopes without the blocked scopes nested in them
+	int64_t dur = t_end - t_begin;
+
+	if (kind == event_kind_t::blocked)
+	{
+		td->blocked += dur;
+		td->m_blocked[name] += dur;
+		if (td->depth > 0)
+			td->busy -= dur;
+	}
+	else if (td->depth == 0)
+		td->busy += dur;
+
+	if (td->events.size() < max_events_per_thread)
+		td->events.push_back(event_t{ name, category, t_begin, t_end, td->depth, kind });
+	else
+		++td->no_dropped;
+}
+
+// ************************************************************************************
+// Must be called when all traced threads are finished
+bool CTracer::Save(const string& file_name)
+{
+	lock_guard<mutex> lck(mtx);
+
+	ofstream ofs(file_name);
+
+	if (!ofs)
+		return false;
+
+	ofs << fixed << setprecision(3);
+	ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+
+	bool first = true;
+
+	for (auto& td : v_threads)
+	{
+		ofs << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << td->tid
+			<< ", \"args\": {\"name\": \"" << td->name << "\"}}";
+		first = false;
+
+		for (auto& e : td->events)
+			ofs << ",\n{\"name\": \"" << e.name << "\", \"cat\": \"" << e.category
+				<< (e.kind == event_kind_t::blocked ? ",blocked" : "")
+				<< "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << td->tid
+				<< ", \"ts\": " << e.t_begin / 1000.0 << ", \"dur\": " << (e.t_end - e.t_begin) / 1000.0 << "}";
+	}
+
+	ofs << "\n],\n\"summary\": [\n";
+
+	cerr << "Thread                   busy [s]  blocked [s]  main blocking reason\n";
+
+	uint64_t no_dropped = 0;
+
+	for (size_t i = 0; i < v_threads.size(); ++i)
+	{
+		auto& td = v_threads[i];
+		int64_t busy = max<int64_t>(td->busy, 0);
+		int64_t blocked = td->blocked;
+		map<string, int64_t> m_blocked;
+
+		// The same name can be at different addresses in different translation units
+		for (auto& x : td->m_blocked)
+			m_blocked[x.first] += x.second;
+
+		no_dropped += td->no_dropped;
+
+		string main_reason;
+		int64_t main_reason_time = 0;
+
+		ofs << "{\"tid\": " << td->tid << ", \"name\": \"" << td->name << "\", \"busy_s\": " << busy * 1e-9 << ", \"blocked_s\": " << blocked * 1e-9
+			<< ", \"dropped_events\": " << td->no_dropped << ", \"blocked_by\": {";
+
+		bool first_reason = true;
+		for (auto& x : m_blocked)
+		{
+			ofs << (first_reason ? "" : ", ") << "\"" << x.first << "\": " << x.second * 1e-9;
+			first_reason = false;
+
+			if (x.second > main_reason_time)
+			{
+				main_reason = x.first;
+				main_reason_time = x.second;
+			}
+		}
+
+		ofs << "}}" << (i + 1 < v_threads.size() ? "," : "") << "\n";
+
+		cerr << left << setw(24) << td->name << right << fixed << setprecision(3)
+			<< setw(9) << busy * 1e-9 << setw(13) << blocked * 1e-9 << "  " << main_reason << "\n";
+	}
+
+	ofs << "]}\n";
+
+	if (no_dropped)
+		cerr << "Trace: " << no_dropped << " events over the limit of " << max_events_per_thread
+			<< " per thread were not saved (the summary includes them)\n";
+
+	return (bool) ofs;
+}
+
+#endif
+
+// EOF
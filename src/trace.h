@@ -0,0 +1,131 @@
+#pragma once
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+// Pipeline tracing (Chrome trace-event JSON + busy/blocked summary per thread)
+// Compiled only if VCFSHARK_TRACE is defined (make TRACE=1); otherwise all macros are empty
+
+#ifdef VCFSHARK_TRACE
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+using namespace std;
+
+// ************************************************************************************
+class CTracer
+{
+public:
+	enum class event_kind_t {busy, blocked};
+
+private:
+	struct event_t {
+		const char* name;
+		const char* category;
+		int64_t t_begin;
+		int64_t t_end;
+		uint32_t depth;
+		event_kind_t kind;
+	};
+
+	// Events are kept up to max_events_per_thread (the later ones are only counted); the summary covers all events
+	struct thread_data_t {
+		uint32_t tid;
+		string name;
+		uint32_t depth;
+		vector<event_t> events;
+		uint64_t no_dropped;
+		int64_t busy;
+		int64_t blocked;
+		map<const char*, int64_t> m_blocked;
+	};
+
+	const size_t max_events_per_thread = 1 << 18;
+
+	static thread_local thread_data_t* tl_data;
+
+	mutex mtx;
+	vector<unique_ptr<thread_data_t>> v_threads;
+	atomic<bool> enabled;
+	chrono::steady_clock::time_point t_start;
+
+	CTracer();
+
+	thread_data_t* get_thread_data();
+
+public:
+	static CTracer& Instance();
+
+	void Enable();
+	bool IsEnabled() const
+	{
+		return enabled.load(memory_order_relaxed);
+	}
+
+	void SetThreadName(const string& name);
+
+	int64_t Now();
+	void Enter();
+	void Leave(const char* name, const char* category, event_kind_t kind, int64_t t_begin);
+
+	bool Save(const string& file_name);
+};
+
+// ************************************************************************************
+class CTraceScope
+{
+	const char* name;
+	const char* category;
+	CTracer::event_kind_t kind;
+	int64_t t_begin;
+	bool active;
+
+public:
+	CTraceScope(const char* _name, const char* _category, CTracer::event_kind_t _kind) :
+		name(_name), category(_category), kind(_kind), t_begin(0)
+	{
+		CTracer& tracer = CTracer::Instance();
+
+		active = tracer.IsEnabled();
+		if (active)
+		{
+			tracer.Enter();
+			t_begin = tracer.Now();
+		}
+	}
+
+	~CTraceScope()
+	{
+		if (active)
+			CTracer::Instance().Leave(name, category, kind, t_begin);
+	}
+};
+
+#define TRACE_CONCAT_IMPL(a, b)		a##b
+#define TRACE_CONCAT(a, b)			TRACE_CONCAT_IMPL(a, b)
+
+#define TRACE_BUSY(name, category)		CTraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name, category, CTracer::event_kind_t::busy)
+#define TRACE_BLOCKED(name, category)	CTraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name, category, CTracer::event_kind_t::blocked)
+#define TRACE_THREAD_NAME(name)			CTracer::Instance().SetThreadName(name)
+
+#else
+
+#define TRACE_BUSY(name, category)
+#define TRACE_BLOCKED(name, category)
+#define TRACE_THREAD_NAME(name)
+
+#endif
+
+// EOF
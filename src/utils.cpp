@@ -8,6 +8,10 @@
 // *******************************************************************************************
 
 #include "utils.h"
+#include "cpu_dispatch.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 #include <iostream>
 #include <memory>
 #include <sstream>
@@ -101,11 +105,23 @@ string trim(string s)
 }
 
 // ************************************************************************************
-uint64_t popcnt(uint64_t x)
+void calc_cumulate_histogram(const vector<uint32_t>& data, vector<uint32_t>& v_hist, uint32_t& max_count)
 {
-	return _mm_popcnt_u64(x);
+	fill(v_hist.begin(), v_hist.end(), 0u);
+
+	CPUKernels().histogram(data.data(), data.size(), v_hist.data(), v_hist.size());
+
+	cumulate_sums(v_hist, max_count);
+}
 
-	return 0;
+// ************************************************************************************
+uint64_t popcnt(uint64_t x)
+{
+#ifdef _MSC_VER
+	return __popcnt64(x);
+#else
+	return __builtin_popcountll(x);
+#endif
 }
 
 // EOF
@@ -11,10 +11,11 @@
 #include "defs.h"
 #include <mutex>
 #include <condition_variable>
-#include <nmmintrin.h>
 #include <string>
 #include <vector>
 
+#include "trace.h"
+
 using namespace std;
 
 #ifdef OUR_STRTOL
@@ -30,6 +31,9 @@ void cumulate_sums(array<uint32_t, SIGMA> &a_hist, uint32_t &max_count);
 void cumulate_sums(vector<uint32_t> &v_hist, uint32_t &max_count);
 
 
+// ************************************************************************************
+void calc_cumulate_histogram(const vector<uint32_t>& data, vector<uint32_t>& v_hist, uint32_t& max_count);
+
 // ************************************************************************************
 template <typename T>
 void calc_cumulate_histogram(const vector<T>& data, vector<uint32_t>& v_hist, uint32_t& max_count)
@@ -68,6 +72,7 @@ public:
 	}
 	void count_down_and_wait()
 	{
+		TRACE_BLOCKED("barrier_wait", "sync");
 		std::unique_lock< std::mutex > lock(m_mutex);
 		unsigned int gen = m_generation;
 		if (--m_count == 0)
@@ -0,0 +1,96 @@
+#pragma once
+// *******************************************************************************************
+// This file is a part of VCFShark software distributed under GNU GPL 3 licence.
+// The homepage of the VCFShark project is https://github.com/refresh-bio/VCFShark
+//
+// Author : Sebastian Deorowicz and Agnieszka Danek
+// Version: 1.0
+// Date   : 2020-12-18
+// *******************************************************************************************
+
+#include <cstdint>
+
+// ************************************************************************************
+// Variable-size integer used by CBuffer:
+// 0 - zero, 1 - missing (0x80000000), 2..125 - small positive, 126..249 - small negative,
+// 250..255 - 2, 3 or 4 bytes (big endian) of a positive or negative value
+// Returns the no. of bytes read
+inline uint32_t decode_var_int(const uint8_t* p, uint32_t& val)
+{
+	int code = p[0];
+
+	val = 0;
+
+	if (code == 0)
+		return 1;
+	else if (code == 1)
+	{
+		val = 0x80000000u;
+		return 1;
+	}
+	else if (code < 126)
+	{
+		val = code - 1;
+		return 1;
+	}
+	else if (code < 250)
+	{
+		val = (uint32_t) (((int)code) - 250);
+		return 1;
+	}
+	else if (code == 250)
+	{
+		val += (uint32_t)p[1];		val <<= 8;
+		val += (uint32_t)p[2];
+		return 3;
+	}
+	else if (code == 251)
+	{
+		val += (uint32_t)p[1];		val <<= 8;
+		val += (uint32_t)p[2];
+
+		val = (uint32_t) -((int)val);
+
+		return 3;
+	}
+	else if (code == 252)
+	{
+		val += (uint32_t)p[1];		val <<= 8;
+		val += (uint32_t)p[2];		val <<= 8;
+		val += (uint32_t)p[3];
+		return 4;
+	}
+	else if (code == 253)
+	{
+		val += (uint32_t)p[1];		val <<= 8;
+		val += (uint32_t)p[2];		val <<= 8;
+		val += (uint32_t)p[3];
+
+		val = (uint32_t) -((int)val);
+
+		return 4;
+	}
+	else if (code == 254)
+	{
+		val += (uint32_t)p[1];		val <<= 8;
+		val += (uint32_t)p[2];		val <<= 8;
+		val += (uint32_t)p[3];		val <<= 8;
+		val += (uint32_t)p[4];
+		return 5;
+	}
+	else if (code == 255)
+	{
+		val += (uint32_t)p[1];		val <<= 8;
+		val += (uint32_t)p[2];		val <<= 8;
+		val += (uint32_t)p[3];		val <<= 8;
+		val += (uint32_t)p[4];
+
+		val = (uint32_t) -((int)val);
+
+		return 5;
+	}
+
+	return 0;
+}
+
+// EOF
@@ -10,6 +10,8 @@
 #include "vcf.h"
 #include <iostream>
 #include <cassert>
+#include <htslib/hfile.h>
+#include <htslib/bgzf.h>
 
 // ************************************************************************************
 CVCF::CVCF()
@@ -47,8 +49,17 @@ bool CVCF::OpenForReading(string & file_name)
 // ************************************************************************************
 bool CVCF::OpenForWriting(string & file_name, file_type type, char bcf_compression_level)
 {
-    if(type == file_type::VCF)
+    bool is_gz = file_name.size() > 3 && file_name.compare(file_name.size() - 3, 3, ".gz") == 0;
+
+    if(type == file_type::VCF && !is_gz)
         vcf_file = hts_open(file_name.c_str(), "w");
+    else if(type == file_type::VCF)
+    {
+        char write_mode[5] = "wz";
+        write_mode[2] = bcf_compression_level != 'u' ? bcf_compression_level : '\0';
+        write_mode[3] = '\0';
+        vcf_file = hts_open(file_name.c_str(), write_mode);
+    }
     else  // file_type::BCF
     {
         char write_mode[5] = "wb";
@@ -66,6 +77,18 @@ bool CVCF::OpenForWriting(string & file_name, file_type type, char bcf_compressi
 // ************************************************************************************
 bool CVCF::Close()
 {
+    bool ok = true;
+
+    if (vcf_file && !index_file_name.empty())
+    {
+        if (bcf_idx_save(vcf_file) < 0)
+        {
+            cerr << "Cannot save index " << index_file_name << "\n";
+            ok = false;
+        }
+        index_file_name.clear();
+    }
+
     if (vcf_file)
     {
         if (hts_close(vcf_file) < 0)
@@ -113,7 +136,7 @@ bool CVCF::Close()
         dst_flag = nullptr;
     }
 
-    return true;
+    return ok;
 }
 
 // ************************************************************************************
@@ -125,6 +148,15 @@ int CVCF::GetNoSamples()
     return bcf_hdr_nsamples(vcf_hdr);
 }
 
+// ************************************************************************************
+int CVCF::GetKeyId(const string& key_name)
+{
+    if(!vcf_file || !vcf_hdr)
+        return -1;
+
+    return bcf_hdr_id2int(vcf_hdr, BCF_DT_ID, key_name.c_str());
+}
+
 // ************************************************************************************
 bool CVCF::GetSamplesList(vector<string> &s_list)
 {
@@ -212,6 +244,18 @@ bool CVCF::WriteHeader()
     return false;
 }
 
+// ************************************************************************************
+string CVCF::GetKeyName(const key_desc &key)
+{
+    string prefix = key.keys_type == key_type_t::flt ? "FILTER/" : (key.keys_type == key_type_t::info ? "INFO/" : "FORMAT/");
+
+    if(!vcf_hdr)
+        return prefix + to_string(key.key_id);
+
+    return prefix + bcf_hdr_int2id(vcf_hdr, BCF_DT_ID, key.key_id);
+}
+
+// ************************************************************************************
 bool CVCF::GetFilterInfoFormatKeys(int &no_flt_keys, int &no_info_keys, int &no_fmt_keys, vector<key_desc> &keys, int & gt_key_id)
 {
     if(!vcf_file || !vcf_hdr)
@@ -263,6 +307,30 @@ bool CVCF::GetFilterInfoFormatKeys(int &no_flt_keys, int &no_info_keys, int &no_
     }
     return true;
 }
+// ************************************************************************************
+uint64_t CVCF::SkipVariants(uint64_t no_variants)
+{
+	if (!vcf_file || !vcf_hdr)
+		return 0;
+
+	uint64_t i;
+
+	for (i = 0; i < no_variants; ++i)
+	{
+		bcf_clear(rec);
+		if (bcf_read(vcf_file, vcf_hdr, rec) == -1)
+			break;
+
+		if (rec->errcode)
+		{
+			std::cerr << "Error in VCF file\n";
+			exit(1);
+		}
+	}
+
+	return i;
+}
+
 // ************************************************************************************
 bool CVCF::GetVariant(variant_desc_t &desc,  vector<field_desc> &fields, std::unordered_map<int, uint32_t> &FilterIdToFieldId, std::unordered_map<int, uint32_t> &InfoIdToFieldId,  
     std::unordered_map<int, uint32_t> &FormatIdToFieldId)
@@ -309,16 +377,10 @@ bool CVCF::GetVariant(variant_desc_t &desc,  vector<field_desc> &fields, std::un
     else
         desc.alt = ".";
         
-    desc.qual.erase(); // QUAL
-    if ( bcf_float_is_missing(rec->qual) )
-        desc.qual = ".";
+    if ( bcf_float_is_missing(rec->qual) ) // QUAL
+        bcf_float_set_missing(desc.qual);
     else
-    {
-        kstring_t s = {0,0,0};
-        kputd(rec->qual, &s);
-        desc.qual += s.s;
-        free(s.s);
-    }    
+        desc.qual = rec->qual;
     
     //FILTER
     if (rec->d.n_flt) {
@@ -468,18 +530,21 @@ bool CVCF::GetVariant(variant_desc_t &desc,  vector<field_desc> &fields, std::un
 }
 
 // ************************************************************************************
-bool CVCF::SetVariant(variant_desc_t &desc, vector<field_desc> &fields, vector<key_desc> keys)
+// Fill the record with variant data - used by both the writer and the formatters
+static void build_record(bcf_hdr_t *vcf_hdr, bcf1_t *rec, variant_desc_t &desc, vector<field_desc> &fields, const vector<key_desc> &keys)
 {
     bcf_clear(rec);
     
     string record;
-    record = desc.chrom + "\t0\t" + desc.id + "\t" + desc.ref + "\t" + desc.alt + "\t" + desc.qual +"\t" + "." + "\t" + ".";
+    record = desc.chrom + "\t0\t" + desc.id + "\t" + desc.ref + "\t" + desc.alt + "\t.\t.\t.";
     kstring_t s;
     s.s = (char*)record.c_str();
     s.m = record.length();
     s.l = 0;
     vcf_parse(&s, vcf_hdr, rec);
     rec->pos = (int32_t) (desc.pos - 1);
+    if (!bcf_float_is_missing(desc.qual))
+        rec->qual = desc.qual;
   
     for(size_t j = 0; j < fields.size(); j++){
         if(keys[j].keys_type == key_type_t::flt)
@@ -510,9 +575,140 @@ bool CVCF::SetVariant(variant_desc_t &desc, vector<field_desc> &fields, vector<k
             }
         }
     }
+}
+
+// ************************************************************************************
+bool CVCF::SetVariant(variant_desc_t &desc, vector<field_desc> &fields, vector<key_desc> keys)
+{
+    build_record(vcf_hdr, rec, desc, fields, keys);
+
     if(bcf_write(vcf_file, vcf_hdr, rec) != 0)
         return false;
     return true;
 }
 
+// ************************************************************************************
+bool CVCF::WriteFormatted(CVCFFormatter &formatter)
+{
+    if(!vcf_file)
+        return false;
+
+    if(formatter.text_output)
+    {
+        // The same as in vcf_write(), but for the whole range of records
+        if(!formatter.text.l)
+            return true;
+
+        ssize_t written;
+        if(vcf_file->is_bgzf)
+            written = bgzf_write(vcf_file->fp.bgzf, formatter.text.s, formatter.text.l);
+        else
+            written = hwrite(vcf_file->fp.hfile, formatter.text.s, formatter.text.l);
+
+        return written == (ssize_t) formatter.text.l;
+    }
+
+    for(size_t i = 0; i < formatter.no_recs; ++i)
+        if(bcf_write(vcf_file, vcf_hdr, formatter.v_recs[i]) != 0)
+            return false;
+
+    return true;
+}
+
+// ************************************************************************************
+bool CVCF::EnableIndexing()
+{
+    if(!vcf_file || !vcf_hdr)
+        return false;
+
+    // The index is built by htslib in bcf_write(), which also handles multithreaded BGZF compression
+    bool is_bcf = vcf_file->format.format == bcf;
+    string name = string(vcf_file->fn) + (is_bcf ? ".csi" : ".tbi");
+
+    index_file_name = name;
+    if(bcf_idx_init(vcf_file, vcf_hdr, is_bcf ? 14 : 0, index_file_name.c_str()) < 0)
+    {
+        index_file_name.clear();
+        return false;
+    }
+
+    return true;
+}
+
+// ************************************************************************************
+bool CVCF::SetNoCompressionThreads(int no_threads)
+{
+    if(!vcf_file || !vcf_file->is_bgzf || no_threads < 1)
+        return false;
+
+    return hts_set_threads(vcf_file, no_threads) == 0;
+}
+
+// ************************************************************************************
+// CVCFFormatter
+// ************************************************************************************
+CVCFFormatter::CVCFFormatter(const bcf_hdr_t *_vcf_hdr, bool _text_output)
+{
+    // vcf_parse() can modify the header (e.g., for undeclared contigs), so each formatter has its own copy
+    vcf_hdr = bcf_hdr_dup(_vcf_hdr);
+    text_output = _text_output;
+    no_recs = 0;
+
+    text.l = 0;
+    text.m = 0;
+    text.s = nullptr;
+}
+
+// ************************************************************************************
+CVCFFormatter::~CVCFFormatter()
+{
+    for(auto p : v_recs)
+        bcf_destroy(p);
+
+    if(text.s)
+        free(text.s);
+
+    if(vcf_hdr)
+        bcf_hdr_destroy(vcf_hdr);
+}
+
+// ************************************************************************************
+bool CVCFFormatter::Format(vector<pair<variant_desc_t, vector<field_desc>>> &v_variants, size_t first, size_t last, const vector<key_desc> &keys)
+{
+    bool ok = true;
+
+    text.l = 0;
+    no_recs = 0;
+
+    // For VCF output a single record is reused as only the text is kept
+    size_t no_needed = text_output ? 1 : last - first;
+    while(v_recs.size() < no_needed)
+        v_recs.emplace_back(bcf_init());
+
+    for(size_t i = first; i < last; ++i)
+    {
+        bcf1_t *rec = v_recs[text_output ? 0 : no_recs];
+
+        build_record(vcf_hdr, rec, v_variants[i].first, v_variants[i].second, keys);
+
+        if(text_output)
+        {
+            if(vcf_format(vcf_hdr, rec, &text) < 0)
+                ok = false;
+        }
+        else
+            ++no_recs;
+
+        for(auto &field : v_variants[i].second)
+            if(field.data_size)
+            {
+                delete[] field.data;
+                field.data = nullptr;
+                field.data_size = 0;
+            }
+    }
+
+    return ok;
+}
+
 // EOF
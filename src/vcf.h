@@ -41,7 +41,7 @@ typedef struct variant_desc_tag {
 	string id;
 	string ref;
 	string alt;
-	string qual;
+	float qual;			// bcf_float_missing if absent
 	uint32_t n_allele;
 
 	bool operator==(const struct variant_desc_tag &x)
@@ -75,12 +75,15 @@ typedef struct variant_desc_tag {
 	}
 } variant_desc_t;
 
+class CVCFFormatter;
+
 // ************************************************************************************
 class CVCF
 {
     htsFile * vcf_file;
     bcf1_t * rec;
     int ploidy;
+    string index_file_name;     // non-empty if the index is built during writing
     
     bool first_variant;
     int curr_alt_number; //allele from ALT field (from 1)
@@ -104,15 +107,21 @@ public:
 	// Open VCF file for reading
 	bool OpenForReading(string & file_name);
 
-	// Open VCF file for writing
+	// Open VCF file for writing (VCF file names ending with .gz are BGZF-compressed)
 	bool OpenForWriting(string & file_name, file_type type, char bcf_compression_level);
 
+	// Build CSI (BCF) or TBI (VCF.gz) index during writing; must be called after WriteHeader; the index is saved at Close
+	bool EnableIndexing();
+
 	// Close VCF file
 	bool Close();
 
 	// If open, return no. of samples
 	int GetNoSamples();
 
+	// If open, return header id of FILTER/INFO/FORMAT key (-1 if absent)
+	int GetKeyId(const string& key_name);
+
 	// Get complete header as a string
 	bool GetHeader(string &v_header);
 	
@@ -130,6 +139,9 @@ public:
     
     // If open, return no. of possible FLT/INFO/FORMAT fields and the keys in vector keys
     bool GetFilterInfoFormatKeys(int &no_flt_keys, int &no_info_keys, int &no_fmt_keys, vector<key_desc> &keys, int & gt_key_id);
+
+	// Name of the key as given in the header (e.g., INFO/DP)
+	string GetKeyName(const key_desc &key);
     
 	// If file open give the next variant:
 	// desc - variant description
@@ -146,8 +158,17 @@ public:
 	bool GetVariant(variant_desc_t &desc, vector<field_desc> &fields,  std::unordered_map<int, uint32_t> &FilterIdToFieldId, std::unordered_map<int, uint32_t> &InfoIdToFieldId, 
 		std::unordered_map<int, uint32_t> &FormatIdToFieldId);
 
+	// Skip no_variants records (without unpacking them); returns the number of records actually skipped
+	uint64_t SkipVariants(uint64_t no_variants);
+
 	// Store info about variant - parameters the same as for GetVariant
 	bool SetVariant(variant_desc_t &desc, vector<field_desc> &fields, vector<key_desc> keys);
+
+	// Store variants prepared by the formatter (in the order of formatting)
+	bool WriteFormatted(CVCFFormatter &formatter);
+
+	// Use extra threads for BGZF compression of the output
+	bool SetNoCompressionThreads(int no_threads);
 	
 	// Get vector with sample names
 	bool GetSamplesList(vector<string> &s_list);
@@ -159,4 +180,27 @@ public:
 	bool AddSample(string &s_name);
 };
 
+// ************************************************************************************
+// Converts decoded variants into records (and VCF text) independently of the writer, so a batch can be
+// formatted by several threads, each taking a contiguous range of variants
+class CVCFFormatter
+{
+	bcf_hdr_t *vcf_hdr;
+	bool text_output;
+
+	vector<bcf1_t*> v_recs;
+	size_t no_recs;
+	kstring_t text;
+
+	friend class CVCF;
+
+public:
+	// text_output - render VCF text (otherwise only records are built, e.g., for BCF or indexed output)
+	CVCFFormatter(const bcf_hdr_t *_vcf_hdr, bool _text_output);
+	~CVCFFormatter();
+
+	// Format variants [first, last) and release their fields
+	bool Format(vector<pair<variant_desc_t, vector<field_desc>>> &v_variants, size_t first, size_t last, const vector<key_desc> &keys);
+};
+
 // EOF